@@ -0,0 +1,116 @@
+#!/usr/bin/env python3
+#
+# Copyright 2026 NXP
+#
+# Permission is hereby granted, free of charge, to any person obtaining a
+# copy of this software and associated documentation files (the "Software"),
+# to deal in the Software without restriction, including without limitation
+# the rights to use, copy, modify, merge, publish, distribute, sub license,
+# and/or sell copies of the Software, and to permit persons to whom the
+# Software is furnished to do so, subject to the following conditions:
+#
+# The above copyright notice and this permission notice (including the
+# next paragraph) shall be included in all copies or substantial portions
+# of the Software.
+#
+# THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+# IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+# FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT. IN NO EVENT SHALL
+# THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+# LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+# FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+# DEALINGS IN THE SOFTWARE.
+
+"""Run length encode the planes of a raw frame into C, for asset.h
+(see the frame-*.c files for the license header and comment to add):
+
+    asset-pack.py RAW NAME:WIDTHxHEIGHT:CPP [NAME:WIDTHxHEIGHT:CPP...]
+
+The planes are taken from RAW one after the other, eg. for NV12:
+
+    asset-pack.py frame-512x512-NV12.raw asset_nv12_y_512x512:512x512:1 \\
+            asset_nv12_uv_512x512:256x256:2
+"""
+
+import sys
+
+
+def varint(value):
+    out = bytearray()
+    while True:
+        byte = value & 0x7f
+        value >>= 7
+        if not value:
+            out.append(byte)
+            return out
+        out.append(byte | 0x80)
+
+
+def encode(data, cpp):
+    pixels = [data[i:i + cpp] for i in range(0, len(data), cpp)]
+    out = bytearray()
+    literal = []
+
+    def flush():
+        if literal:
+            out.extend(varint(len(literal) << 1))
+            out.extend(b''.join(literal))
+            literal.clear()
+
+    i = 0
+    while i < len(pixels):
+        j = i
+        while j < len(pixels) and pixels[j] == pixels[i]:
+            j += 1
+        # a run only pays off once it saves more than its own header:
+        if (j - i) * cpp > cpp + 1:
+            flush()
+            out.extend(varint(((j - i) << 1) | 1))
+            out.extend(pixels[i])
+            i = j
+        else:
+            literal.append(pixels[i])
+            i += 1
+    flush()
+
+    return bytes(out)
+
+
+def main():
+    if len(sys.argv) < 3:
+        sys.exit(__doc__)
+
+    with open(sys.argv[1], 'rb') as f:
+        raw = f.read()
+
+    print('#include "asset.h"')
+
+    offset = 0
+    for plane in sys.argv[2:]:
+        name, size, cpp = plane.split(':')
+        width, height = (int(v) for v in size.split('x'))
+        cpp = int(cpp)
+        length = width * height * cpp
+
+        if offset + length > len(raw):
+            sys.exit('%s: not enough data for %s' % (sys.argv[1], name))
+        data = encode(raw[offset:offset + length], cpp)
+        offset += length
+
+        print()
+        print('static const uint8_t %s_data[] = {' % name)
+        for i in range(0, len(data), 16):
+            print('\t\t' + ' '.join('0x%02x,' % b for b in data[i:i + 16]))
+        print('};')
+        print()
+        print('const struct asset %s = {' % name)
+        print('\t.data = %s_data,' % name)
+        print('\t.size = sizeof(%s_data),' % name)
+        print('\t.width = %d,' % width)
+        print('\t.height = %d,' % height)
+        print('\t.cpp = %d,' % cpp)
+        print('};')
+
+
+if __name__ == '__main__':
+    main()
@@ -0,0 +1,156 @@
+/*
+ * Copyright 2026 NXP
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sub license,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the
+ * next paragraph) shall be included in all copies or substantial portions
+ * of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT. IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+#include <stdio.h>
+#include <string.h>
+
+#include <gbm.h>
+
+#include "asset.h"
+
+static const uint8_t * get_varint(const uint8_t *p, const uint8_t *end, size_t *value)
+{
+	unsigned int shift = 0;
+
+	*value = 0;
+	while (p < end && shift < 8 * sizeof(*value)) {
+		*value |= (size_t)(*p & 0x7f) << shift;
+		if (!(*p++ & 0x80))
+			return p;
+		shift += 7;
+	}
+
+	return NULL;
+}
+
+/* n copies of a cpp byte pixel: */
+static void fill(uint8_t *dst, const uint8_t *pixel, uint32_t cpp, size_t n)
+{
+	if (cpp == 1) {
+		memset(dst, pixel[0], n);
+		return;
+	}
+
+	while (n--) {
+		memcpy(dst, pixel, cpp);
+		dst += cpp;
+	}
+}
+
+int asset_decode(const struct asset *asset, void *dst, size_t dst_stride)
+{
+	const uint8_t *p = asset->data, *end = p + asset->size;
+	const uint32_t cpp = asset->cpp;
+	uint8_t *row = dst;
+	size_t x = 0, y = 0;    /* in pixels */
+
+	while (y < asset->height) {
+		size_t value, count;
+		int repeat;
+
+		p = get_varint(p, end, &value);
+		if (!p)
+			goto corrupt;
+		count = value >> 1;
+		repeat = value & 1;
+
+		if (count > (size_t)asset->width * asset->height ||
+		    (size_t)(end - p) < (repeat ? 1 : count) * cpp)
+			goto corrupt;
+
+		/* a run may span several rows: */
+		while (count) {
+			size_t n = asset->width - x;
+
+			if (y == asset->height)
+				goto corrupt;
+			if (n > count)
+				n = count;
+
+			if (repeat) {
+				fill(row + x * cpp, p, cpp, n);
+			} else {
+				memcpy(row + x * cpp, p, n * cpp);
+				p += n * cpp;
+			}
+
+			count -= n;
+			x += n;
+			if (x == asset->width) {
+				x = 0;
+				y++;
+				row += dst_stride;
+			}
+		}
+
+		if (repeat)
+			p += cpp;
+	}
+
+	if (p != end)
+		goto corrupt;
+
+	return 0;
+
+corrupt:
+	printf("corrupt asset data\n");
+	return -1;
+}
+
+int asset_to_fd(struct gbm_device *dev, uint32_t format,
+		const struct asset *asset, uint32_t *pstride)
+{
+	void *map_data = NULL;
+	struct gbm_bo *bo;
+	uint32_t stride;
+	uint8_t *map;
+	int ret, fd;
+
+	/* NOTE: do not actually use GBM_BO_USE_WRITE since that gets us a dumb buffer: */
+	bo = gbm_bo_create(dev, asset->width, asset->height, format, GBM_BO_USE_LINEAR);
+	if (!bo) {
+		printf("failed to create asset bo\n");
+		return -1;
+	}
+
+	map = gbm_bo_map(bo, 0, 0, asset->width, asset->height,
+			GBM_BO_TRANSFER_WRITE, &stride, &map_data);
+	if (!map) {
+		printf("failed to map asset bo\n");
+		gbm_bo_destroy(bo);
+		return -1;
+	}
+
+	ret = asset_decode(asset, map, stride);
+
+	gbm_bo_unmap(bo, map_data);
+
+	fd = ret ? -1 : gbm_bo_get_fd(bo);
+
+	/* we have the fd now, no longer need the bo: */
+	gbm_bo_destroy(bo);
+
+	*pstride = stride;
+
+	return fd;
+}
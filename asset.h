@@ -0,0 +1,63 @@
+/*
+ * Copyright 2026 NXP
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sub license,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the
+ * next paragraph) shall be included in all copies or substantial portions
+ * of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT. IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+#ifndef _ASSET_H
+#define _ASSET_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+struct gbm_device;
+
+/*
+ * Images built into the binary, run length encoded a pixel (of 'cpp'
+ * bytes) at a time, which shrinks the videotestsrc frames about tenfold.
+ * They are decoded straight into the buffer they end up in, so only the
+ * (small) encoded data of the mode in use ever gets paged in.
+ *
+ * The encoding is a sequence of runs, each starting with a LEB128 varint
+ * of (count << 1) | repeat: with repeat set, one pixel follows which is
+ * repeated count times, otherwise count pixels follow as they are.
+ * asset-pack.py generates them from raw frames.
+ */
+struct asset {
+	const uint8_t *data;
+	size_t size;
+	uint32_t width, height, cpp;
+};
+
+extern const struct asset asset_rgba_512x512;
+extern const struct asset asset_nv12_y_512x512, asset_nv12_uv_512x512;
+
+/* Decode into dst, eg. a mapped bo, with rows dst_stride bytes apart.
+ * dst is only ever written.  Returns -1 if the data is corrupt.
+ */
+int asset_decode(const struct asset *asset, void *dst, size_t dst_stride);
+
+/* Decode into a new linear BO of the given (single plane) format and
+ * return its dmabuf fd, or -1.  The BO's stride is returned in 'pstride'.
+ */
+int asset_to_fd(struct gbm_device *dev, uint32_t format,
+		const struct asset *asset, uint32_t *pstride);
+
+#endif /* _ASSET_H */
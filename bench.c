@@ -0,0 +1,253 @@
+/*
+ * Copyright 2026 NXP
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sub license,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the
+ * next paragraph) shall be included in all copies or substantial portions
+ * of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT. IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/resource.h>
+
+#include "common.h"
+#include "cpu.h"
+#include "drm-common.h"
+#include "bench.h"
+#include "stats.h"
+
+/* set by configure: */
+#ifndef KMSCUBE_BUILD
+#define KMSCUBE_BUILD "unknown"
+#endif
+
+struct bench_pass {
+	unsigned int frames;
+
+	/* start of each draw, the pass' end time goes in the last slot: */
+	uint64_t *start;
+	unsigned int count;
+
+	uint64_t *gpu;
+	unsigned int gpu_count;
+
+	uint64_t cpu_start, cpu_end;
+	uint64_t missed;
+};
+
+static struct {
+	struct egl *egl;
+	void (*draw)(struct egl *egl, float frame);
+	struct bench_pass *pass;
+} bench;
+
+static uint64_t cpu_time_ns(void)
+{
+	struct rusage ru;
+
+	getrusage(RUSAGE_SELF, &ru);
+
+	return (ru.ru_utime.tv_sec + ru.ru_stime.tv_sec) * 1000000000ull +
+		(ru.ru_utime.tv_usec + ru.ru_stime.tv_usec) * 1000ull;
+}
+
+/* GPU times come from egl_draw()'s timer queries, a few frames late: */
+static void bench_gpu_time(struct egl *egl, uint64_t ns)
+{
+	struct bench_pass *pass = bench.pass;
+
+	(void)egl;
+
+	if (pass->gpu_count < pass->frames)
+		pass->gpu[pass->gpu_count++] = ns;
+}
+
+static void bench_draw(struct egl *egl, float frame)
+{
+	struct bench_pass *pass = bench.pass;
+
+	if (pass->count < pass->frames)
+		pass->start[pass->count++] = get_time_ns();
+
+	bench.draw(egl, frame);
+}
+
+static int begin_pass(struct bench_pass *pass, unsigned int frames)
+{
+	memset(pass, 0, sizeof(*pass));
+	pass->frames = frames;
+	pass->start = calloc(frames + 1, sizeof(*pass->start));
+	pass->gpu = calloc(frames, sizeof(*pass->gpu));
+	if (!pass->start || !pass->gpu) {
+		printf("out of memory\n");
+		return -1;
+	}
+
+	pass->missed = stats_missed_vblanks();
+	pass->cpu_start = cpu_time_ns();
+	bench.pass = pass;
+
+	return 0;
+}
+
+static void end_pass(struct bench_pass *pass)
+{
+	glFinish();
+
+	egl_flush_gpu_times(bench.egl);
+
+	pass->start[pass->count] = get_time_ns();
+	pass->cpu_end = cpu_time_ns();
+	pass->missed = stats_missed_vblanks() - pass->missed;
+}
+
+/* Draw and swap as fast as the GPU goes, handing the buffers straight
+ * back to the surface instead of flipping to them:
+ */
+static int run_uncapped(const struct gbm *gbm, struct egl *egl,
+		unsigned int first, unsigned int frames)
+{
+	unsigned int i;
+
+	for (i = 0; i < frames; i++) {
+		struct gbm_bo *bo;
+
+		egl_wait_render_ahead(egl);
+		egl_draw(egl, first + i);
+		egl_swap(egl);
+
+		bo = gbm_surface_lock_front_buffer(gbm->surface);
+		if (!bo) {
+			printf("Failed to lock frontbuffer\n");
+			return -1;
+		}
+		gbm_surface_release_buffer(gbm->surface, bo);
+	}
+
+	return 0;
+}
+
+static int compare_u64(const void *a, const void *b)
+{
+	uint64_t x = *(const uint64_t *)a, y = *(const uint64_t *)b;
+
+	return (x > y) - (x < y);
+}
+
+/* avg/percentiles/max of the samples in ms, which get sorted in place: */
+static void print_times(const char *name, uint64_t *v, unsigned int n)
+{
+	uint64_t sum = 0;
+	unsigned int i;
+
+	if (!n) {
+		printf("\t\t\"%s\": null,\n", name);
+		return;
+	}
+
+	for (i = 0; i < n; i++)
+		sum += v[i];
+
+	qsort(v, n, sizeof(*v), compare_u64);
+
+#define MS(ns) ((double)(ns) / 1000000.0)
+	printf("\t\t\"%s\": { \"avg\": %.3f, \"p50\": %.3f, \"p90\": %.3f, "
+			"\"p99\": %.3f, \"max\": %.3f },\n", name,
+			MS(sum / n), MS(v[n * 50 / 100]), MS(v[n * 90 / 100]),
+			MS(v[n * 99 / 100]), MS(v[n - 1]));
+#undef MS
+}
+
+static void print_pass(const char *name, struct bench_pass *pass, int vsync, int last)
+{
+	uint64_t wall = pass->start[pass->count] - pass->start[0];
+	unsigned int i;
+
+	/* frame times, from the start of one draw to the next: */
+	for (i = 0; i < pass->count; i++)
+		pass->start[i] = pass->start[i + 1] - pass->start[i];
+
+	printf("\t\"%s\": {\n", name);
+	printf("\t\t\"frames\": %u,\n", pass->count);
+	printf("\t\t\"fps\": %.2f,\n", wall ? pass->count * 1e9 / wall : 0.0);
+	print_times("frame_time_ms", pass->start, pass->count);
+	print_times("gpu_time_ms", pass->gpu, pass->gpu_count);
+	if (vsync)
+		printf("\t\t\"missed_vblanks\": %llu,\n", (unsigned long long)pass->missed);
+	printf("\t\t\"cpu_usage\": %.1f\n", wall ?
+			100.0 * (pass->cpu_end - pass->cpu_start) / wall : 0.0);
+	printf("\t}%s\n", last ? "" : ",");
+}
+
+int bench_run(struct drm *drm, const struct gbm *gbm, struct egl *egl,
+		unsigned int frames, const char *mode, const char *backend)
+{
+	struct bench_pass vsync, uncapped;
+	int ret;
+
+	if (!egl->glBeginQueryEXT)
+		printf("no GL_EXT_disjoint_timer_query, not measuring GPU time\n");
+
+	bench.egl = egl;
+	bench.draw = egl->draw;
+	egl->draw = bench_draw;
+	egl->gpu_time = bench_gpu_time;
+
+	if (begin_pass(&vsync, frames))
+		return -1;
+	drm->frames = frames;
+	ret = drm->run(drm, gbm, egl);
+	end_pass(&vsync);
+	if (ret)
+		return ret;
+
+	if (begin_pass(&uncapped, frames))
+		return -1;
+	ret = run_uncapped(gbm, egl, frames, frames);
+	end_pass(&uncapped);
+	if (ret)
+		return ret;
+
+	egl->draw = bench.draw;
+	egl->gpu_time = NULL;
+
+	printf("{\n");
+	printf("\t\"mode\": \"%s\",\n", mode);
+	printf("\t\"backend\": \"%s\",\n", backend);
+	printf("\t\"resolution\": \"%dx%d\",\n", gbm->width, gbm->height);
+	printf("\t\"build\": \"%s\",\n", KMSCUBE_BUILD);
+	printf("\t\"cpu_features\": \"%s\",\n", cpu_features_string());
+	printf("\t\"context_priority\": %lld,\n",
+			(long long)stats_gauge(STATS_CONTEXT_PRIORITY));
+	printf("\t\"render_ahead\": %lld,\n",
+			(long long)stats_gauge(STATS_RENDER_AHEAD));
+	print_pass("vsync", &vsync, 1, 0);
+	print_pass("uncapped", &uncapped, 0, 1);
+	printf("}\n");
+	fflush(stdout);
+
+	free(vsync.start);
+	free(vsync.gpu);
+	free(uncapped.start);
+	free(uncapped.gpu);
+
+	return 0;
+}
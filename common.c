@@ -21,79 +21,255 @@
  * DEALINGS IN THE SOFTWARE.
  */
 
+#define _GNU_SOURCE
+
 #include <errno.h>
 #include <fcntl.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <time.h>
 
 #include "common.h"
+#include "program-cache.h"
+#include "stats.h"
 
 #ifdef HAVE_GBM_MODIFIERS
 static int
-get_modifiers(uint64_t **mods)
+get_modifiers(const uint64_t **mods)
 {
 	/* Assumed LINEAR is supported everywhere */
-	static uint64_t modifiers[] = {DRM_FORMAT_MOD_LINEAR};
+	static const uint64_t modifiers[] = {DRM_FORMAT_MOD_LINEAR};
 	*mods = modifiers;
 	return sizeof(modifiers) / sizeof(uint64_t);
 }
 #endif
 
-struct gbm * init_gbm(int drm_fd, int w, int h, uint64_t modifier)
+/* One gbm device per DRM fd, so that outputs sharing the fd also share
+ * the EGLDisplay (which is per gbm device).  Outputs are set up one at a
+ * time, before any of them starts rendering:
+ */
+struct gbm_device * get_gbm_device(int drm_fd)
+{
+	static struct gbm_device *dev;
+	static int dev_fd = -1;
+
+	if (!dev || dev_fd != drm_fd) {
+		dev = gbm_create_device(drm_fd);
+		dev_fd = drm_fd;
+	}
+
+	return dev;
+}
+
+struct gbm * init_gbm(int drm_fd, int w, int h, uint32_t format,
+		const uint64_t *modifiers, unsigned count)
 {
 	struct gbm *gbm = calloc(1, sizeof(*gbm));
 
-	gbm->dev = gbm_create_device(drm_fd);
+	gbm->dev = get_gbm_device(drm_fd);
 
 #ifndef HAVE_GBM_MODIFIERS
-	if (modifier != DRM_FORMAT_MOD_INVALID) {
+	(void)modifiers;
+	if (count) {
 		fprintf(stderr, "Modifiers requested but support isn't available\n");
 		return NULL;
 	}
 	gbm->surface = gbm_surface_create(gbm->dev, w, h,
-			GBM_FORMAT_XRGB8888,
+			format,
 			GBM_BO_USE_SCANOUT | GBM_BO_USE_RENDERING);
 #else
 	fprintf(stdout, "Modifiers requested\n");
-	uint64_t *mods;
-	int count;
-	if (modifier != DRM_FORMAT_MOD_INVALID) {
-		count = 1;
-		mods = &modifier;
-	} else {
-		count = get_modifiers(&mods);
-	}
+	if (!count)
+		count = get_modifiers(&modifiers);
 
 	gbm->surface = gbm_surface_create_with_modifiers(gbm->dev, w, h,
-			GBM_FORMAT_XRGB8888, mods, count);
+			format, modifiers, count);
 #endif
 	if (!gbm->surface) {
 		printf("failed to create gbm surface\n");
 		return NULL;
 	}
 
+	gbm->format = format;
+	gbm->width = w;
+	gbm->height = h;
+
+	return gbm;
+}
+
+/* Render only surface for the offscreen backend.  Render nodes generally
+ * can't allocate scanout buffers, so no SCANOUT usage (or modifiers,
+ * which imply it):
+ */
+struct gbm * init_gbm_offscreen(int drm_fd, int w, int h, uint32_t format)
+{
+	struct gbm *gbm = calloc(1, sizeof(*gbm));
+
+	gbm->dev = gbm_create_device(drm_fd);
+	if (!gbm->dev) {
+		printf("failed to create gbm device\n");
+		return NULL;
+	}
+
+	gbm->surface = gbm_surface_create(gbm->dev, w, h, format,
+			GBM_BO_USE_RENDERING);
+	if (!gbm->surface) {
+		printf("failed to create gbm surface\n");
+		return NULL;
+	}
+
+	gbm->format = format;
 	gbm->width = w;
 	gbm->height = h;
 
 	return gbm;
 }
 
+/* Of the configs matching the attributes, pick the one whose native
+ * visual is the format of the gbm surface, since the first match can
+ * differ in alpha (which matters when scanning out with an alpha blended
+ * primary plane):
+ */
+static int
+choose_config(EGLDisplay display, const EGLint *attribs, uint32_t format,
+		EGLConfig *config)
+{
+	EGLConfig *configs;
+	EGLint count = 0, n, i, id;
+
+	if (!eglGetConfigs(display, NULL, 0, &count) || count < 1)
+		return -1;
+
+	configs = malloc(count * sizeof(*configs));
+	if (!eglChooseConfig(display, attribs, configs, count, &n) || n < 1) {
+		free(configs);
+		return -1;
+	}
+
+	*config = configs[0];
+	for (i = 0; i < n; i++) {
+		if (eglGetConfigAttrib(display, configs[i], EGL_NATIVE_VISUAL_ID, &id) &&
+				(uint32_t)id == format) {
+			*config = configs[i];
+			break;
+		}
+	}
+
+	free(configs);
+
+	return 0;
+}
+
+/* print the extension strings and such at init: */
+int verbose;
+
+/* first context created once shared contexts are enabled, which later
+ * ones share their objects with:
+ */
+static int share_contexts;
+static EGLContext share_context = EGL_NO_CONTEXT;
+
+void egl_share_contexts(void)
+{
+	share_contexts = 1;
+}
+
+static EGLint context_priority;
+static unsigned int render_ahead;
+
+void egl_context_priority(EGLint level)
+{
+	context_priority = level;
+}
+
+void egl_render_ahead(unsigned int frames)
+{
+	render_ahead = frames;
+}
+
+/* as recorded to the stats, 0 for the default: */
+static int priority_value(EGLint level)
+{
+	switch (level) {
+	case EGL_CONTEXT_PRIORITY_LOW_IMG:    return 1;
+	case EGL_CONTEXT_PRIORITY_MEDIUM_IMG: return 2;
+	case EGL_CONTEXT_PRIORITY_HIGH_IMG:   return 3;
+	default:                              return 0;
+	}
+}
+
+static const char *priority_name(EGLint level)
+{
+	static const char * const names[] = { "default", "low", "medium", "high" };
+
+	return names[priority_value(level)];
+}
+
+/* The display is the same one init_egl() gets later for the device, and
+ * initializing it again there is harmless:
+ */
+int egl_get_modifiers(struct gbm_device *dev, uint32_t format, uint64_t **mods)
+{
+	PFNEGLGETPLATFORMDISPLAYEXTPROC get_platform_display =
+		(void *)eglGetProcAddress("eglGetPlatformDisplayEXT");
+	PFNEGLQUERYDMABUFMODIFIERSEXTPROC query_modifiers =
+		(void *)eglGetProcAddress("eglQueryDmaBufModifiersEXT");
+	EGLDisplay display;
+	EGLBoolean *external;
+	EGLint count = 0, i, n = 0;
+	const char *exts;
+
+	*mods = NULL;
+
+	if (get_platform_display)
+		display = get_platform_display(EGL_PLATFORM_GBM_KHR, dev, NULL);
+	else
+		display = eglGetDisplay((void *)dev);
+
+	if (!eglInitialize(display, NULL, NULL))
+		return 0;
+
+	exts = eglQueryString(display, EGL_EXTENSIONS);
+	if (!query_modifiers || !exts ||
+	    !strstr(exts, "EGL_EXT_image_dma_buf_import_modifiers"))
+		return 0;
+
+	if (!query_modifiers(display, format, 0, NULL, NULL, &count) || !count)
+		return 0;
+
+	*mods = calloc(count, sizeof(**mods));
+	external = calloc(count, sizeof(*external));
+	if (!query_modifiers(display, format, count, (EGLuint64KHR *)*mods,
+			external, &count))
+		count = 0;
+
+	for (i = 0; i < count; i++)
+		if (!external[i])
+			(*mods)[n++] = (*mods)[i];
+
+	free(external);
+
+	return n;
+}
+
 int init_egl(struct egl *egl, const struct gbm *gbm)
 {
-	EGLint major, minor, n;
+	EGLint major, minor;
 
-	static const EGLint context_attribs[] = {
+	EGLint context_attribs[] = {
 		EGL_CONTEXT_CLIENT_VERSION, 2,
+		EGL_NONE, EGL_NONE,     /* room for the priority */
 		EGL_NONE
 	};
 
-	static const EGLint config_attribs[] = {
+	const EGLint config_attribs[] = {
 		EGL_SURFACE_TYPE, EGL_WINDOW_BIT,
 		EGL_RED_SIZE, 1,
 		EGL_GREEN_SIZE, 1,
 		EGL_BLUE_SIZE, 1,
-		EGL_ALPHA_SIZE, 0,
+		EGL_ALPHA_SIZE, (gbm->format == GBM_FORMAT_ARGB8888) ? 1 : 0,
+		EGL_DEPTH_SIZE, egl->depth_size,
 		EGL_RENDERABLE_TYPE, EGL_OPENGL_ES2_BIT,
 		EGL_NONE
 	};
@@ -124,6 +300,30 @@ int init_egl(struct egl *egl, const struct gbm *gbm)
 		return -1;
 	}
 
+	const char *egl_exts = eglQueryString(egl->display, EGL_EXTENSIONS);
+
+	if (egl_exts && strstr(egl_exts, "EGL_KHR_swap_buffers_with_damage"))
+		egl->eglSwapBuffersWithDamage =
+			(void *)eglGetProcAddress("eglSwapBuffersWithDamageKHR");
+	else if (egl_exts && strstr(egl_exts, "EGL_EXT_swap_buffers_with_damage"))
+		egl->eglSwapBuffersWithDamage =
+			(void *)eglGetProcAddress("eglSwapBuffersWithDamageEXT");
+	egl->buffer_age = egl_exts && strstr(egl_exts, "EGL_EXT_buffer_age");
+
+	if (context_priority && egl_exts && strstr(egl_exts, "EGL_IMG_context_priority")) {
+		context_attribs[2] = EGL_CONTEXT_PRIORITY_LEVEL_IMG;
+		context_attribs[3] = context_priority;
+	} else if (context_priority) {
+		printf("no EGL_IMG_context_priority, using the default priority\n");
+	}
+
+	if (render_ahead && egl->eglCreateSyncKHR && egl->eglClientWaitSyncKHR &&
+	    egl_exts && strstr(egl_exts, "EGL_KHR_fence_sync"))
+		egl->render_ahead = render_ahead;
+	else if (render_ahead)
+		printf("no EGL_KHR_fence_sync, not limiting the render ahead\n");
+	stats_set(STATS_RENDER_AHEAD, egl->render_ahead);
+
 	printf("Using display %p with EGL version %d.%d\n",
 			egl->display, major, minor);
 
@@ -131,7 +331,8 @@ int init_egl(struct egl *egl, const struct gbm *gbm)
 	printf("EGL information:\n");
 	printf("  version: \"%s\"\n", eglQueryString(egl->display, EGL_VERSION));
 	printf("  vendor: \"%s\"\n", eglQueryString(egl->display, EGL_VENDOR));
-	printf("  extensions: \"%s\"\n", eglQueryString(egl->display, EGL_EXTENSIONS));
+	if (verbose)
+		printf("  extensions: \"%s\"\n", eglQueryString(egl->display, EGL_EXTENSIONS));
 	printf("===================================\n");
 
 	if (!eglBindAPI(EGL_OPENGL_ES_API)) {
@@ -139,24 +340,41 @@ int init_egl(struct egl *egl, const struct gbm *gbm)
 		return -1;
 	}
 
-	if (!eglChooseConfig(egl->display, config_attribs, &egl->config, 1, &n) || n != 1) {
-		printf("failed to choose config: %d\n", n);
+	if (choose_config(egl->display, config_attribs, gbm->format, &egl->config)) {
+		printf("failed to choose config\n");
 		return -1;
 	}
 
+	egl->share_context = share_context;
 	egl->context = eglCreateContext(egl->display, egl->config,
-			EGL_NO_CONTEXT, context_attribs);
+			egl->share_context, context_attribs);
 	if (egl->context == NULL) {
 		printf("failed to create context\n");
 		return -1;
 	}
 
+	if (share_contexts && share_context == EGL_NO_CONTEXT)
+		share_context = egl->context;
+
+	/* the driver may well give us less than we asked for: */
+	if (context_attribs[2] == EGL_CONTEXT_PRIORITY_LEVEL_IMG) {
+		EGLint granted = EGL_CONTEXT_PRIORITY_MEDIUM_IMG;
+
+		eglQueryContext(egl->display, egl->context,
+				EGL_CONTEXT_PRIORITY_LEVEL_IMG, &granted);
+		printf("context priority: asked for %s, got %s\n",
+				priority_name(context_priority), priority_name(granted));
+		stats_set(STATS_CONTEXT_PRIORITY, priority_value(granted));
+	}
+
 	egl->surface = eglCreateWindowSurface(egl->display, egl->config,
 			(EGLNativeWindowType)gbm->surface, NULL);
 	if (egl->surface == EGL_NO_SURFACE) {
 		printf("failed to create egl surface\n");
 		return -1;
 	}
+	egl->width = gbm->width;
+	egl->height = gbm->height;
 
 	/* connect the context to the surface */
 	eglMakeCurrent(egl->display, egl->surface, egl->surface, egl->context);
@@ -166,67 +384,299 @@ int init_egl(struct egl *egl, const struct gbm *gbm)
 	printf("  shading language version: \"%s\"\n", glGetString(GL_SHADING_LANGUAGE_VERSION));
 	printf("  vendor: \"%s\"\n", glGetString(GL_VENDOR));
 	printf("  renderer: \"%s\"\n", glGetString(GL_RENDERER));
-	printf("  extensions: \"%s\"\n", glGetString(GL_EXTENSIONS));
+	if (verbose)
+		printf("  extensions: \"%s\"\n", glGetString(GL_EXTENSIONS));
 	printf("===================================\n");
 
+	const char *exts = (const char *)glGetString(GL_EXTENSIONS);
+
+	if (exts && strstr(exts, "GL_EXT_disjoint_timer_query")) {
+		get_proc(glGenQueriesEXT);
+		get_proc(glDeleteQueriesEXT);
+		get_proc(glBeginQueryEXT);
+		get_proc(glEndQueryEXT);
+		get_proc(glGetQueryObjectuivEXT);
+		get_proc(glGetQueryObjectui64vEXT);
+	}
+
+	if (egl->glGenQueriesEXT && egl->glBeginQueryEXT && egl->glEndQueryEXT &&
+			egl->glGetQueryObjectuivEXT && egl->glGetQueryObjectui64vEXT)
+		egl->glGenQueriesEXT(EGL_GPU_QUERIES, egl->queries);
+	else
+		egl->glBeginQueryEXT = NULL;
+
+	stats_startup("egl");
+
 	return 0;
 }
 
-int create_program(const char *vs_src, const char *fs_src)
+/* Read back the oldest GPU time, which is either known to be available
+ * or waited for:
+ */
+static void retire_gpu_time(struct egl *egl)
 {
-	GLuint vertex_shader, fragment_shader, program;
-	GLint ret;
+	GLuint query = egl->queries[egl->queries_retired++ % EGL_GPU_QUERIES];
+	GLint disjoint = 0;
+	GLuint64 ns;
+
+	egl->glGetQueryObjectui64vEXT(query, GL_QUERY_RESULT_EXT, &ns);
+
+	/* the GPU timer went off on its own (power management etc), so
+	 * the result can't be trusted:
+	 */
+	glGetIntegerv(GL_GPU_DISJOINT_EXT, &disjoint);
+	if (disjoint)
+		return;
+
+	stats_add(STATS_GPU, ns);
+	if (egl->gpu_time)
+		egl->gpu_time(egl, ns);
+}
 
-	vertex_shader = glCreateShader(GL_VERTEX_SHADER);
+static int gpu_time_available(struct egl *egl)
+{
+	GLuint available = 0;
 
-	glShaderSource(vertex_shader, 1, &vs_src, NULL);
-	glCompileShader(vertex_shader);
+	if (egl->queries_retired == egl->queries_issued)
+		return 0;
 
-	glGetShaderiv(vertex_shader, GL_COMPILE_STATUS, &ret);
-	if (!ret) {
-		char *log;
+	egl->glGetQueryObjectuivEXT(egl->queries[egl->queries_retired % EGL_GPU_QUERIES],
+			GL_QUERY_RESULT_AVAILABLE_EXT, &available);
 
-		printf("vertex shader compilation failed!:\n");
-		glGetShaderiv(vertex_shader, GL_INFO_LOG_LENGTH, &ret);
-		if (ret > 1) {
-			log = malloc(ret);
-			glGetShaderInfoLog(vertex_shader, ret, NULL, log);
-			printf("%s", log);
-		}
+	return available;
+}
 
-		return -1;
+/* Mark the end of the frame's GPU work for egl_wait_render_ahead(): */
+static void fence_frame(struct egl *egl)
+{
+	EGLSyncKHR fence;
+
+	if (!egl->render_ahead)
+		return;
+
+	fence = egl->eglCreateSyncKHR(egl->display, EGL_SYNC_FENCE_KHR, NULL);
+	if (fence != EGL_NO_SYNC_KHR)
+		egl->frame_fences[egl->fences_issued++ % MAX_SWAP_DEPTH] = fence;
+}
+
+void egl_wait_render_ahead(struct egl *egl)
+{
+	EGLSyncKHR fence;
+	uint64_t t;
+
+	if (!egl->render_ahead ||
+	    egl->fences_issued - egl->fences_retired < egl->render_ahead)
+		return;
+
+	fence = egl->frame_fences[egl->fences_retired++ % MAX_SWAP_DEPTH];
+
+	/* only frames which actually had to wait count: */
+	if (egl->eglClientWaitSyncKHR(egl->display, fence, 0, 0) ==
+			EGL_TIMEOUT_EXPIRED_KHR) {
+		t = stats_now();
+		egl->eglClientWaitSyncKHR(egl->display, fence,
+				EGL_SYNC_FLUSH_COMMANDS_BIT_KHR, EGL_FOREVER_KHR);
+		stats_record(STATS_AHEAD, t);
+	}
+
+	egl->eglDestroySyncKHR(egl->display, fence);
+}
+
+void egl_draw(struct egl *egl, float frame)
+{
+	int timed;
+
+	if (!frame)
+		stats_startup("first draw");
+
+	if (!egl->glBeginQueryEXT) {
+		egl->draw(egl, frame);
+		fence_frame(egl);
+		return;
+	}
+
+	while (gpu_time_available(egl))
+		retire_gpu_time(egl);
+
+	/* with the GPU that far behind, skip timing this frame rather than wait: */
+	timed = egl->queries_issued - egl->queries_retired < EGL_GPU_QUERIES;
+	if (timed)
+		egl->glBeginQueryEXT(GL_TIME_ELAPSED_EXT,
+				egl->queries[egl->queries_issued % EGL_GPU_QUERIES]);
+
+	egl->draw(egl, frame);
+
+	if (timed) {
+		egl->glEndQueryEXT(GL_TIME_ELAPSED_EXT);
+		egl->queries_issued++;
+	}
+
+	fence_frame(egl);
+}
+
+static void damage_union(struct damage_rect *r, const struct damage_rect *a)
+{
+	int x2 = r->x + r->width, y2 = r->y + r->height;
+
+	if (a->width <= 0 || a->height <= 0)
+		return;
+	if (r->width <= 0 || r->height <= 0) {
+		*r = *a;
+		return;
+	}
+
+	if (a->x + a->width > x2)
+		x2 = a->x + a->width;
+	if (a->y + a->height > y2)
+		y2 = a->y + a->height;
+	if (a->x < r->x)
+		r->x = a->x;
+	if (a->y < r->y)
+		r->y = a->y;
+	r->width = x2 - r->x;
+	r->height = y2 - r->y;
+}
+
+void egl_damage(struct egl *egl, const struct damage_rect *rect)
+{
+	struct damage_rect stale = *rect;
+	EGLint age = 0;
+	unsigned int i;
+
+	egl->frame_damage = *rect;
+	egl->frame_damaged = 1;
+
+	if (egl->buffer_age)
+		eglQuerySurface(egl->display, egl->surface, EGL_BUFFER_AGE_EXT, &age);
+
+	/* The buffer has the frame from 'age' frames ago, or is undefined.
+	 * Everything drawn since then is stale, that frame's own drawing
+	 * included:
+	 */
+	if (age <= 0 || (unsigned int)age > egl->damage_frames ||
+	    age > EGL_DAMAGE_HISTORY) {
+		stale = (struct damage_rect){ 0, 0, egl->width, egl->height };
+	} else {
+		for (i = 1; i <= (unsigned int)age; i++)
+			damage_union(&stale,
+				&egl->damage[(egl->damage_frames - i) % EGL_DAMAGE_HISTORY]);
 	}
 
-	fragment_shader = glCreateShader(GL_FRAGMENT_SHADER);
+	glEnable(GL_SCISSOR_TEST);
+	glScissor(stale.x, stale.y, stale.width, stale.height);
+}
 
-	glShaderSource(fragment_shader, 1, &fs_src, NULL);
-	glCompileShader(fragment_shader);
+void egl_swap(struct egl *egl)
+{
+	struct damage_rect full = { 0, 0, egl->width, egl->height };
+	struct damage_rect frame = egl->frame_damaged ? egl->frame_damage : full;
+	struct damage_rect swap = frame;
+
+	glDisable(GL_SCISSOR_TEST);
+
+	/* what the last frame drew is gone too: */
+	if (egl->damage_frames)
+		damage_union(&swap,
+			&egl->damage[(egl->damage_frames - 1) % EGL_DAMAGE_HISTORY]);
+	else
+		swap = full;
+
+	egl->damage[egl->damage_frames++ % EGL_DAMAGE_HISTORY] = frame;
+	egl->frame_damaged = 0;
+	egl->swap_damage = swap;
+
+	if (egl->eglSwapBuffersWithDamage)
+		egl->eglSwapBuffersWithDamage(egl->display, egl->surface,
+				(const EGLint *)&swap, 1);
+	else
+		eglSwapBuffers(egl->display, egl->surface);
+}
+
+void egl_flush_gpu_times(struct egl *egl)
+{
+	while (egl->glBeginQueryEXT && egl->queries_retired != egl->queries_issued)
+		retire_gpu_time(egl);
+}
 
-	glGetShaderiv(fragment_shader, GL_COMPILE_STATUS, &ret);
+uint64_t get_time_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return (uint64_t)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+static GLuint compile_shader(GLenum type, const char *src)
+{
+	GLuint shader;
+	GLint ret;
+
+	shader = glCreateShader(type);
+
+	glShaderSource(shader, 1, &src, NULL);
+	glCompileShader(shader);
+
+	glGetShaderiv(shader, GL_COMPILE_STATUS, &ret);
 	if (!ret) {
 		char *log;
 
-		printf("fragment shader compilation failed!:\n");
-		glGetShaderiv(fragment_shader, GL_INFO_LOG_LENGTH, &ret);
-
+		printf("%s shader compilation failed!:\n",
+				type == GL_VERTEX_SHADER ? "vertex" : "fragment");
+		glGetShaderiv(shader, GL_INFO_LOG_LENGTH, &ret);
 		if (ret > 1) {
 			log = malloc(ret);
-			glGetShaderInfoLog(fragment_shader, ret, NULL, log);
+			glGetShaderInfoLog(shader, ret, NULL, log);
 			printf("%s", log);
 		}
 
-		return -1;
+		return 0;
 	}
 
-	program = glCreateProgram();
+	return shader;
+}
+
+static int attach_shaders(GLuint program, const char *vs_src, const char *fs_src)
+{
+	GLuint vertex_shader, fragment_shader;
+
+	vertex_shader = compile_shader(GL_VERTEX_SHADER, vs_src);
+	if (!vertex_shader)
+		return -1;
+
+	fragment_shader = compile_shader(GL_FRAGMENT_SHADER, fs_src);
+	if (!fragment_shader)
+		return -1;
 
 	glAttachShader(program, vertex_shader);
 	glAttachShader(program, fragment_shader);
 
+	return 0;
+}
+
+int create_program(const char *vs_src, const char *fs_src)
+{
+	GLuint program = glCreateProgram();
+
+	/* with a program cache, compiling waits for link_program(), which
+	 * knows if there is a binary to skip it with:
+	 */
+	if (program_cache_defer(program, vs_src, fs_src))
+		return program;
+
+	if (attach_shaders(program, vs_src, fs_src))
+		return -1;
+
 	return program;
 }
 
-int link_program(unsigned program)
+void bind_attrib_location(unsigned program, unsigned index, const char *name)
+{
+	glBindAttribLocation(program, index, name);
+	program_cache_bind_attrib(program, index, name);
+}
+
+static int link(GLuint program)
 {
 	GLint ret;
 
@@ -250,3 +700,21 @@ int link_program(unsigned program)
 
 	return 0;
 }
+
+static int build_program(GLuint program, const char *vs_src, const char *fs_src)
+{
+	if (attach_shaders(program, vs_src, fs_src))
+		return -1;
+
+	return link(program);
+}
+
+int link_program(unsigned program)
+{
+	int ret = program_cache_link(program, build_program);
+
+	if (ret <= 0)
+		return ret;
+
+	return link(program);
+}
@@ -57,20 +57,71 @@ EGLAPI EGLSurface EGLAPIENTRY eglCreatePlatformPixmapSurfaceEXT (EGLDisplay dpy,
 #endif
 #endif /* EGL_EXT_platform_base */
 
+#ifndef EGL_IMG_context_priority
+#define EGL_IMG_context_priority 1
+#define EGL_CONTEXT_PRIORITY_LEVEL_IMG    0x3100
+#define EGL_CONTEXT_PRIORITY_HIGH_IMG     0x3101
+#define EGL_CONTEXT_PRIORITY_MEDIUM_IMG   0x3102
+#define EGL_CONTEXT_PRIORITY_LOW_IMG      0x3103
+#endif /* EGL_IMG_context_priority */
+
 struct gbm {
 	struct gbm_device *dev;
 	struct gbm_surface *surface;
+	uint32_t format;
 	int width, height;
 };
 
-struct gbm * init_gbm(int drm_fd, int w, int h, uint64_t modifier);
+/* The gbm device for a DRM fd, shared by every output using the fd: */
+struct gbm_device * get_gbm_device(int drm_fd);
+
+/* Create the scanout surface, with one of 'modifiers' (or linear if
+ * 'count' is 0):
+ */
+struct gbm * init_gbm(int drm_fd, int w, int h, uint32_t format,
+		const uint64_t *modifiers, unsigned count);
+struct gbm * init_gbm_offscreen(int drm_fd, int w, int h, uint32_t format);
+
+#define MAX_DMABUF_PLANES 4
+
+/* most buffers the KMS backends keep in flight, see struct swapchain: */
+#define MAX_SWAP_DEPTH 4
+
+/* A dmabuf backed frame which KMS can scan out directly: */
+struct dmabuf_frame {
+	uint32_t format;
+	uint32_t width, height;
+	uint64_t modifier;        /* DRM_FORMAT_MOD_INVALID if unknown */
+	unsigned nplanes;
+	int fd[MAX_DMABUF_PLANES];
+	uint32_t offset[MAX_DMABUF_PLANES];
+	uint32_t pitch[MAX_DMABUF_PLANES];
+};
+
 
+/* frames the GPU timer queries may lag behind before one is skipped: */
+#define EGL_GPU_QUERIES 8
+
+/* A part of the surface, in GL window coordinates (origin bottom left): */
+struct damage_rect {
+	int x, y, width, height;
+};
+
+/* frames of damage kept, for the buffer age to go back that far: */
+#define EGL_DAMAGE_HISTORY 8
 
 struct egl {
 	EGLDisplay display;
 	EGLConfig config;
 	EGLContext context;
 	EGLSurface surface;
+	int width, height;
+
+	/* the context this one shares objects with, see egl_share_contexts() */
+	EGLContext share_context;
+
+	/* set by the scene before init_egl() if it needs a depth buffer: */
+	EGLint depth_size;
 
 	PFNEGLGETPLATFORMDISPLAYEXTPROC eglGetPlatformDisplayEXT;
 	PFNEGLCREATEIMAGEKHRPROC eglCreateImageKHR;
@@ -82,7 +133,61 @@ struct egl {
 	PFNEGLCLIENTWAITSYNCKHRPROC eglClientWaitSyncKHR;
 	PFNEGLDUPNATIVEFENCEFDANDROIDPROC eglDupNativeFenceFDANDROID;
 
-	void (*draw)(struct egl *gl, unsigned i);
+	/* GL_EXT_disjoint_timer_query, if the driver has it, and the ring
+	 * of queries egl_draw() brackets each frame with:
+	 */
+	PFNGLGENQUERIESEXTPROC glGenQueriesEXT;
+	PFNGLDELETEQUERIESEXTPROC glDeleteQueriesEXT;
+	PFNGLBEGINQUERYEXTPROC glBeginQueryEXT;
+	PFNGLENDQUERYEXTPROC glEndQueryEXT;
+	PFNGLGETQUERYOBJECTUIVEXTPROC glGetQueryObjectuivEXT;
+	PFNGLGETQUERYOBJECTUI64VEXTPROC glGetQueryObjectui64vEXT;
+	GLuint queries[EGL_GPU_QUERIES];
+	unsigned int queries_issued, queries_retired;
+
+	/* Fences after each frame's draw, for egl_wait_render_ahead() to
+	 * keep the GPU at most 'render_ahead' frames behind (0 for no
+	 * limit), see egl_render_ahead():
+	 */
+	EGLSyncKHR frame_fences[MAX_SWAP_DEPTH];
+	unsigned int fences_issued, fences_retired;
+	unsigned int render_ahead;
+
+	/* EGL_KHR/EXT_swap_buffers_with_damage and EGL_EXT_buffer_age, if
+	 * the driver has them:
+	 */
+	PFNEGLSWAPBUFFERSWITHDAMAGEKHRPROC eglSwapBuffersWithDamage;
+	int buffer_age;
+
+	/* What each of the last frames changed, what the one being drawn
+	 * changes (the whole surface unless the scene said otherwise with
+	 * egl_damage()), and what the last swap changed on screen, ie. since
+	 * the frame before it:
+	 */
+	struct damage_rect damage[EGL_DAMAGE_HISTORY];
+	unsigned int damage_frames;
+	struct damage_rect frame_damage;
+	int frame_damaged;
+	struct damage_rect swap_damage;
+
+	/* Optional, called with each frame's GPU time as egl_draw() reads
+	 * it back (a few frames later), besides recording it to the stats:
+	 */
+	void (*gpu_time)(struct egl *egl, uint64_t ns);
+
+	/* Draw the frame for animation time 'frame', in 1/60 s steps: the
+	 * predicted presentation time with the KMS backends' frame pacing,
+	 * otherwise simply the frame count:
+	 */
+	void (*draw)(struct egl *gl, float frame);
+
+	/* Set by scenes which can have KMS scan out the video frame on an
+	 * overlay plane underneath the GL rendering, returning the frame
+	 * for the last draw (or NULL if there is none).  The KMS backend
+	 * clears it if the overlay can't be used, and the scene then falls
+	 * back to compositing the frame with GL:
+	 */
+	const struct dmabuf_frame *(*scanout)(struct egl *egl);
 };
 
 
@@ -95,10 +200,61 @@ static inline int __egl_check(void *ptr, const char *name)
 	return 0;
 }
 
+/* -v: print the full EGL/GL extension strings, GStreamer state changes etc: */
+extern int verbose;
+
 #define egl_check(egl, name) __egl_check((egl)->name, #name)
 
+/* Have every context init_egl() creates from now on share its objects
+ * (textures, buffers, programs) with the first one.  They all have to be
+ * on the same EGLDisplay, ie. the same gbm device:
+ */
+void egl_share_contexts(void);
+
+/* Ask for contexts of the given EGL_CONTEXT_PRIORITY_*_IMG level (or 0 for
+ * the driver's default), so the display gets the GPU ahead of other work.
+ * Drivers may grant a different level than asked, which init_egl() prints
+ * and records to the stats:
+ */
+void egl_context_priority(EGLint level);
+
+/* Have egl_wait_render_ahead() hold back the next frame while the GPU has
+ * not finished 'frames' (1 to MAX_SWAP_DEPTH) frames yet, so the queued
+ * frames stay within that much latency however busy the GPU is:
+ */
+void egl_render_ahead(unsigned int frames);
+
+/* The modifiers EGL can render 'format' with (ie. not external only, as
+ * from EGL_EXT_image_dma_buf_import_modifiers), in a calloc()ed array:
+ */
+int egl_get_modifiers(struct gbm_device *dev, uint32_t format, uint64_t **mods);
 int init_egl(struct egl *egl, const struct gbm *gbm);
+
+/* Draw with egl->draw(), timing it on the GPU where possible.  Results
+ * are only read back once available, so this never stalls:
+ */
+void egl_draw(struct egl *egl, float frame);
+/* For the backends to call before they start a frame, blocks as long as
+ * the render ahead limit is reached, recording the time to the stats:
+ */
+void egl_wait_render_ahead(struct egl *egl);
+/* For egl->draw() to call before it draws anything, with the part of the
+ * surface the frame changes (eg. the cube's bounds, cube_frame_bounds()).
+ * The drawing gets scissored to what's stale in the buffer: that, plus
+ * whatever changed since the buffer was last drawn into.  Scenes which
+ * don't call it redraw (and damage) the whole surface.
+ */
+void egl_damage(struct egl *egl, const struct damage_rect *rect);
+/* eglSwapBuffers(), telling EGL (and egl->swap_damage the KMS backend)
+ * what changed since the last frame:
+ */
+void egl_swap(struct egl *egl);
+/* Wait for the outstanding GPU times, eg. at the end of a benchmark: */
+void egl_flush_gpu_times(struct egl *egl);
+uint64_t get_time_ns(void);   /* CLOCK_MONOTONIC */
 int create_program(const char *vs_src, const char *fs_src);
+/* glBindAttribLocation(), which the program cache needs to know about: */
+void bind_attrib_location(unsigned program, unsigned index, const char *name);
 int link_program(unsigned program);
 
 enum mode {
@@ -107,25 +263,50 @@ enum mode {
 	NV12_2IMG,     /* NV12, handled as two textures and converted to RGB in shader */
 	NV12_1IMG,     /* NV12, imported as planar YUV eglimg */
 	VIDEO,         /* video textured cube */
+	CUBES,         /* many smooth-shaded cubes, instanced */
 };
 
 struct egl * init_cube_smooth(const struct gbm *gbm);
 struct egl * init_cube_tex(const struct gbm *gbm, enum mode mode);
+struct egl * init_cube_instanced(const struct gbm *gbm, unsigned count);
 
 #ifdef HAVE_GST
 
 struct decoder;
+/* What goes in front of the appsink instead of filesrc and decodebin,
+ * eg. "filesrc name=src ! qtdemux ! h264parse ! vpudec":
+ */
+int video_set_pipeline(const char *desc);
+/* Override the rank of decoders (or other elements) for decodebin to
+ * pick them, as a comma separated list of NAME:RANK, with RANK a number
+ * or one of none, marginal, secondary, primary, max:
+ */
+int video_set_ranks(const char *ranks);
+/* Starts prerolling the file in the background, video_play() it once
+ * video_prerolled():
+ */
 struct decoder * video_init(const struct egl *egl, const struct gbm *gbm, const char *filename);
-EGLImage video_frame(struct decoder *dec);
+int video_prerolled(struct decoder *dec);
+void video_play(struct decoder *dec);
+/* Time left until the end of the stream in ns, or -1 if not known: */
+int64_t video_remaining(struct decoder *dec);
+EGLImage video_frame(struct decoder *dec, int *latched);
+const struct dmabuf_frame * video_frame_dmabuf(struct decoder *dec);
+int video_eos(struct decoder *dec);
 void video_deinit(struct decoder *dec);
+/* video_deinit() on a thread of its own, for the render loop not to wait
+ * for the pipeline to shut down:
+ */
+void video_deinit_async(struct decoder *dec);
 
-struct egl * init_cube_video(const struct gbm *gbm, const char *video);
+struct egl * init_cube_video(const struct gbm *gbm, const char *video,
+		unsigned streams, int scanout);
 
 #else
- inline const struct egl *
-init_cube_video(const struct gbm *gbm, const char *video)
+static inline struct egl *
+init_cube_video(const struct gbm *gbm, const char *video, unsigned streams, int scanout)
 {
-	(void)gbm; (void)video;
+	(void)gbm; (void)video; (void)streams; (void)scanout;
 	printf("no GStreamer support!\n");
 	return NULL;
 }
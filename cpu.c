@@ -0,0 +1,109 @@
+/*
+ * Copyright 2026 NXP
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sub license,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the
+ * next paragraph) shall be included in all copies or substantial portions
+ * of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT. IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+#define _GNU_SOURCE
+
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#if defined(__arm__) && defined(__linux__)
+#include <sys/auxv.h>
+#include <asm/hwcap.h>
+#endif
+
+#include "cpu.h"
+
+static const struct {
+	const char *name;
+	unsigned int bit;
+} names[] = {
+	{ "sse2", CPU_SSE2 },
+	{ "avx2", CPU_AVX2 },
+	{ "neon", CPU_NEON },
+};
+
+#define NUM_NAMES (sizeof(names) / sizeof(names[0]))
+
+static unsigned int features;
+static char features_string[32];
+static pthread_once_t features_once = PTHREAD_ONCE_INIT;
+
+static unsigned int detect(void)
+{
+	unsigned int found = 0;
+
+#if (defined(__x86_64__) || defined(__i386__)) && defined(__GNUC__)
+	__builtin_cpu_init();
+	if (__builtin_cpu_supports("sse2"))
+		found |= CPU_SSE2;
+	if (__builtin_cpu_supports("avx2"))
+		found |= CPU_AVX2;
+#elif defined(__aarch64__)
+	/* Advanced SIMD is part of ARMv8-A: */
+	found |= CPU_NEON;
+#elif defined(__arm__) && defined(__linux__)
+	if (getauxval(AT_HWCAP) & HWCAP_NEON)
+		found |= CPU_NEON;
+#endif
+
+	return found;
+}
+
+static void init_features(void)
+{
+	const char *disable = getenv("KMSCUBE_CPU_DISABLE");
+	unsigned int i;
+	size_t len = 0;
+
+	features = detect();
+
+	for (i = 0; disable && i < NUM_NAMES; i++) {
+		const char *s = strstr(disable, names[i].name);
+		size_t n = strlen(names[i].name);
+
+		/* whole names only: */
+		if (s && (s == disable || s[-1] == ',') && (s[n] == '\0' || s[n] == ','))
+			features &= ~names[i].bit;
+	}
+
+	for (i = 0; i < NUM_NAMES; i++)
+		if (features & names[i].bit)
+			len += snprintf(features_string + len, sizeof(features_string) - len,
+					"%s%s", len ? " " : "", names[i].name);
+}
+
+unsigned int cpu_features(void)
+{
+	pthread_once(&features_once, init_features);
+
+	return features;
+}
+
+const char *cpu_features_string(void)
+{
+	pthread_once(&features_once, init_features);
+
+	return features_string;
+}
@@ -0,0 +1,46 @@
+/*
+ * Copyright 2026 NXP
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sub license,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the
+ * next paragraph) shall be included in all copies or substantial portions
+ * of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT. IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+#ifndef _CPU_H
+#define _CPU_H
+
+/*
+ * The one place the SIMD kernels (see upload.c) ask which instruction
+ * set extensions they can use, detected once at runtime rather than
+ * assumed from the build flags.  The KMSCUBE_CPU_DISABLE environment
+ * variable masks features off by name, as a comma separated list (eg.
+ * "avx2,sse2"), to compare the kernels against each other.
+ */
+enum cpu_feature {
+	CPU_SSE2 = 1 << 0,
+	CPU_AVX2 = 1 << 1,
+	CPU_NEON = 1 << 2,
+};
+
+/* The cpu_feature bits the CPU has: */
+unsigned int cpu_features(void);
+
+/* Them by name, space separated, eg. for the benchmark results: */
+const char *cpu_features_string(void);
+
+#endif /* _CPU_H */
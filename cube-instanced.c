@@ -0,0 +1,271 @@
+/*
+ * Copyright 2026 NXP
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sub license,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the
+ * next paragraph) shall be included in all copies or substantial portions
+ * of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT. IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "common.h"
+#include "esUtil.h"
+#include "geometry.h"
+#include "matrix.h"
+
+#define BATCH_CUBES (65536 / CUBE_VERTICES)
+
+#define ATTRIB_INSTANCE CUBE_ATTRIB_COUNT
+
+struct gl {
+	struct egl egl;
+
+	ESMatrix projection;
+	unsigned count;
+
+	GLuint program;
+	GLint modelviewmatrix, modelviewprojectionmatrix, normalmatrix;
+	GLint time, scale;
+	struct cube_geometry geo;
+	GLuint instance_vbo;
+
+	PFNGLDRAWELEMENTSINSTANCEDEXTPROC glDrawElementsInstanced;
+	PFNGLVERTEXATTRIBDIVISOREXTPROC glVertexAttribDivisor;
+};
+
+static const char *vertex_shader_source =
+		"uniform mat4 modelviewMatrix;      \n"
+		"uniform mat4 modelviewprojectionMatrix;\n"
+		"uniform mat3 normalMatrix;         \n"
+		"uniform float uTime;               \n"
+		"uniform float uScale;              \n"
+		"                                   \n"
+		"attribute vec3 in_position;        \n"
+		"attribute vec3 in_normal;          \n"
+		"attribute vec4 in_color;           \n"
+		"attribute vec4 in_instance;        \n"
+		"\n"
+		"vec4 lightSource = vec4(2.0, 2.0, 20.0, 0.0);\n"
+		"                                   \n"
+		"varying vec4 vVaryingColor;        \n"
+		"                                   \n"
+		"void main()                        \n"
+		"{                                  \n"
+		"    float a = uTime + in_instance.w;\n"
+		"    float c = cos(a), s = sin(a);  \n"
+		"    mat3 spin = mat3(c, 0.0, -s, 0.0, 1.0, 0.0, s, 0.0, c);\n"
+		"    vec4 position = vec4(spin * in_position * uScale + in_instance.xyz, 1.0);\n"
+		"    gl_Position = modelviewprojectionMatrix * position;\n"
+		"    vec3 vEyeNormal = normalMatrix * (spin * in_normal);\n"
+		"    vec4 vPosition4 = modelviewMatrix * position;\n"
+		"    vec3 vPosition3 = vPosition4.xyz / vPosition4.w;\n"
+		"    vec3 vLightDir = normalize(lightSource.xyz - vPosition3);\n"
+		"    float diff = max(0.0, dot(vEyeNormal, vLightDir));\n"
+		"    vVaryingColor = vec4(diff * in_color.rgb, 1.0);\n"
+		"}                                  \n";
+
+static const char *fragment_shader_source =
+		"precision mediump float;           \n"
+		"                                   \n"
+		"varying vec4 vVaryingColor;        \n"
+		"                                   \n"
+		"void main()                        \n"
+		"{                                  \n"
+		"    gl_FragColor = vVaryingColor;  \n"
+		"}                                  \n";
+
+
+static void draw_cube_instanced(struct egl *egl, float frame)
+{
+	struct gl *gl = (struct gl *) egl;
+	struct cube_frame cube;
+
+	/* clear the color buffer */
+	glClearColor(0.5, 0.5, 0.5, 1.0);
+	glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+
+	cube_frame_update(&cube, &gl->projection, 10.0f, frame);
+
+	glUniformMatrix4fv(gl->modelviewmatrix, 1, GL_FALSE, &cube.modelview.m[0][0]);
+	glUniformMatrix4fv(gl->modelviewprojectionmatrix, 1, GL_FALSE, &cube.modelviewprojection.m[0][0]);
+	glUniformMatrix3fv(gl->normalmatrix, 1, GL_FALSE, cube.normal);
+	glUniform1f(gl->time, 0.02f * frame);
+
+	if (gl->glDrawElementsInstanced) {
+		gl->glDrawElementsInstanced(GL_TRIANGLES, CUBE_INDICES,
+				GL_UNSIGNED_SHORT, 0, gl->count);
+		return;
+	}
+
+	/* the instance data is per vertex here, so step through it batch by batch: */
+	glBindBuffer(GL_ARRAY_BUFFER, gl->instance_vbo);
+	for (unsigned first = 0; first < gl->count; first += BATCH_CUBES) {
+		unsigned n = gl->count - first;
+
+		if (n > BATCH_CUBES)
+			n = BATCH_CUBES;
+
+		glVertexAttribPointer(ATTRIB_INSTANCE, 4, GL_FLOAT, GL_FALSE, 0,
+				(const GLvoid *)(intptr_t)(first * CUBE_VERTICES * 4 * sizeof(GLfloat)));
+		cube_geometry_draw(&gl->geo, n);
+	}
+}
+
+static void init_instancing(struct gl *gl)
+{
+	const char *exts = (const char *)glGetString(GL_EXTENSIONS);
+
+	if (!exts)
+		return;
+
+	if (strstr(exts, "GL_EXT_instanced_arrays")) {
+		gl->glDrawElementsInstanced = (void *)eglGetProcAddress("glDrawElementsInstancedEXT");
+		gl->glVertexAttribDivisor = (void *)eglGetProcAddress("glVertexAttribDivisorEXT");
+	} else if (strstr(exts, "GL_ANGLE_instanced_arrays")) {
+		gl->glDrawElementsInstanced = (void *)eglGetProcAddress("glDrawElementsInstancedANGLE");
+		gl->glVertexAttribDivisor = (void *)eglGetProcAddress("glVertexAttribDivisorANGLE");
+	}
+
+	if (!gl->glDrawElementsInstanced || !gl->glVertexAttribDivisor) {
+		gl->glDrawElementsInstanced = NULL;
+		gl->glVertexAttribDivisor = NULL;
+	}
+}
+
+/* Lay the cubes out on a grid filling a 4x4x4 box around the origin,
+ * each with its own phase for the spin, returns the per cube scale:
+ */
+static GLfloat init_instances(GLfloat *instances, unsigned count)
+{
+	unsigned side = 1;
+
+	while (side * side * side < count)
+		side++;
+
+	GLfloat spacing = 4.0f / side;
+
+	for (unsigned i = 0; i < count; i++) {
+		GLfloat *inst = &instances[i * 4];
+
+		inst[0] = ((i % side) - (side - 1) / 2.0f) * spacing;
+		inst[1] = ((i / side % side) - (side - 1) / 2.0f) * spacing;
+		inst[2] = ((i / side / side) - (side - 1) / 2.0f) * spacing;
+		inst[3] = 0.37f * i;
+	}
+
+	return 0.35f * spacing;
+}
+
+static int init_buffers(struct gl *gl)
+{
+	unsigned copies = gl->glDrawElementsInstanced ? 1 : gl->count;
+	unsigned verts = gl->glDrawElementsInstanced ? 1 : CUBE_VERTICES;
+	GLfloat *instances;
+	GLfloat scale;
+
+	if (copies > BATCH_CUBES)
+		copies = BATCH_CUBES;
+
+	/* geometry of as many cubes as one draw covers: */
+	if (cube_geometry_init(&gl->geo, CUBE_TEXCOORDS_IMAGE, copies))
+		return -1;
+
+	/* per instance transforms, repeated for every vertex without a divisor: */
+	instances = malloc(gl->count * verts * 4 * sizeof(GLfloat));
+	if (!instances) {
+		printf("out of memory\n");
+		return -1;
+	}
+	scale = init_instances(instances, gl->count);
+	for (unsigned i = gl->count; verts > 1 && i-- > 0; )
+		for (unsigned v = verts; v-- > 0; )
+			memmove(&instances[(i * verts + v) * 4], &instances[i * 4],
+					4 * sizeof(GLfloat));
+
+	glGenBuffers(1, &gl->instance_vbo);
+	glBindBuffer(GL_ARRAY_BUFFER, gl->instance_vbo);
+	glBufferData(GL_ARRAY_BUFFER, gl->count * verts * 4 * sizeof(GLfloat),
+			instances, GL_STATIC_DRAW);
+	free(instances);
+
+	glVertexAttribPointer(ATTRIB_INSTANCE, 4, GL_FLOAT, GL_FALSE, 0, 0);
+	glEnableVertexAttribArray(ATTRIB_INSTANCE);
+	if (gl->glVertexAttribDivisor)
+		gl->glVertexAttribDivisor(ATTRIB_INSTANCE, 1);
+
+	glUniform1f(gl->scale, scale);
+
+	return 0;
+}
+
+struct egl * init_cube_instanced(const struct gbm *gbm, unsigned count)
+{
+	int ret;
+	struct gl *gl = calloc(1, sizeof(*gl));
+
+	/* the cubes overlap each other: */
+	gl->egl.depth_size = 16;
+
+	ret = init_egl(&gl->egl, gbm);
+	if (ret)
+		return NULL;
+
+	GLfloat aspect = (GLfloat)(gbm->height) / (GLfloat)(gbm->width);
+	mat4_frustum(&gl->projection, -3.0f, +3.0f, -3.0f * aspect, +3.0f * aspect, 6.0f, 14.0f);
+	gl->count = count;
+
+	ret = create_program(vertex_shader_source, fragment_shader_source);
+	if (ret < 0)
+		return NULL;
+
+	gl->program = ret;
+
+	cube_geometry_bind_attribs(gl->program);
+	bind_attrib_location(gl->program, ATTRIB_INSTANCE, "in_instance");
+
+	ret = link_program(gl->program);
+	if (ret)
+		return NULL;
+
+	glUseProgram(gl->program);
+
+	gl->modelviewmatrix = glGetUniformLocation(gl->program, "modelviewMatrix");
+	gl->modelviewprojectionmatrix = glGetUniformLocation(gl->program, "modelviewprojectionMatrix");
+	gl->normalmatrix = glGetUniformLocation(gl->program, "normalMatrix");
+	gl->time = glGetUniformLocation(gl->program, "uTime");
+	gl->scale = glGetUniformLocation(gl->program, "uScale");
+
+	glViewport(0, 0, gbm->width, gbm->height);
+	glEnable(GL_CULL_FACE);
+	glEnable(GL_DEPTH_TEST);
+
+	init_instancing(gl);
+
+	if (init_buffers(gl))
+		return NULL;
+
+	printf("Drawing %u cubes, %s, %u draw call(s) per frame\n", count,
+			gl->glDrawElementsInstanced ? "instanced" : "batched",
+			gl->glDrawElementsInstanced ? 1 : (count + BATCH_CUBES - 1) / BATCH_CUBES);
+
+	gl->egl.draw = draw_cube_instanced;
+
+	return &gl->egl;
+}
@@ -26,14 +26,17 @@
 #include <stdlib.h>
 #include <string.h>
 
+#include "asset.h"
 #include "common.h"
 #include "esUtil.h"
+#include "geometry.h"
+#include "matrix.h"
 
 
 struct gl {
 	struct egl egl;
 
-	GLfloat aspect;
+	ESMatrix projection;
 	enum mode mode;
 	const struct gbm *gbm;
 
@@ -41,110 +44,10 @@ struct gl {
 	/* uniform handles: */
 	GLint modelviewmatrix, modelviewprojectionmatrix, normalmatrix;
 	GLint texture, textureuv;
-	GLuint vbo;
-	GLuint positionsoffset, texcoordsoffset, normalsoffset;
+	struct cube_geometry geo;
 	GLuint tex[2];
 };
 
-static const GLfloat vVertices[] = {
-		// front
-		-1.0f, -1.0f, +1.0f,
-		+1.0f, -1.0f, +1.0f,
-		-1.0f, +1.0f, +1.0f,
-		+1.0f, +1.0f, +1.0f,
-		// back
-		+1.0f, -1.0f, -1.0f,
-		-1.0f, -1.0f, -1.0f,
-		+1.0f, +1.0f, -1.0f,
-		-1.0f, +1.0f, -1.0f,
-		// right
-		+1.0f, -1.0f, +1.0f,
-		+1.0f, -1.0f, -1.0f,
-		+1.0f, +1.0f, +1.0f,
-		+1.0f, +1.0f, -1.0f,
-		// left
-		-1.0f, -1.0f, -1.0f,
-		-1.0f, -1.0f, +1.0f,
-		-1.0f, +1.0f, -1.0f,
-		-1.0f, +1.0f, +1.0f,
-		// top
-		-1.0f, +1.0f, +1.0f,
-		+1.0f, +1.0f, +1.0f,
-		-1.0f, +1.0f, -1.0f,
-		+1.0f, +1.0f, -1.0f,
-		// bottom
-		-1.0f, -1.0f, -1.0f,
-		+1.0f, -1.0f, -1.0f,
-		-1.0f, -1.0f, +1.0f,
-		+1.0f, -1.0f, +1.0f,
-};
-
-GLfloat vTexCoords[] = {
-		//front
-		1.0f, 1.0f,
-		0.0f, 1.0f,
-		1.0f, 0.0f,
-		0.0f, 0.0f,
-		//back
-		1.0f, 1.0f,
-		0.0f, 1.0f,
-		1.0f, 0.0f,
-		0.0f, 0.0f,
-		//right
-		1.0f, 1.0f,
-		0.0f, 1.0f,
-		1.0f, 0.0f,
-		0.0f, 0.0f,
-		//left
-		1.0f, 1.0f,
-		0.0f, 1.0f,
-		1.0f, 0.0f,
-		0.0f, 0.0f,
-		//top
-		1.0f, 1.0f,
-		0.0f, 1.0f,
-		1.0f, 0.0f,
-		0.0f, 0.0f,
-		//bottom
-		1.0f, 0.0f,
-		0.0f, 0.0f,
-		1.0f, 1.0f,
-		0.0f, 1.0f,
-};
-
-static const GLfloat vNormals[] = {
-		// front
-		+0.0f, +0.0f, +1.0f, // forward
-		+0.0f, +0.0f, +1.0f, // forward
-		+0.0f, +0.0f, +1.0f, // forward
-		+0.0f, +0.0f, +1.0f, // forward
-		// back
-		+0.0f, +0.0f, -1.0f, // backward
-		+0.0f, +0.0f, -1.0f, // backward
-		+0.0f, +0.0f, -1.0f, // backward
-		+0.0f, +0.0f, -1.0f, // backward
-		// right
-		+1.0f, +0.0f, +0.0f, // right
-		+1.0f, +0.0f, +0.0f, // right
-		+1.0f, +0.0f, +0.0f, // right
-		+1.0f, +0.0f, +0.0f, // right
-		// left
-		-1.0f, +0.0f, +0.0f, // left
-		-1.0f, +0.0f, +0.0f, // left
-		-1.0f, +0.0f, +0.0f, // left
-		-1.0f, +0.0f, +0.0f, // left
-		// top
-		+0.0f, +1.0f, +0.0f, // up
-		+0.0f, +1.0f, +0.0f, // up
-		+0.0f, +1.0f, +0.0f, // up
-		+0.0f, +1.0f, +0.0f, // up
-		// bottom
-		+0.0f, -1.0f, +0.0f, // down
-		+0.0f, -1.0f, +0.0f, // down
-		+0.0f, -1.0f, +0.0f, // down
-		+0.0f, -1.0f, +0.0f  // down
-};
-
 static const char *vertex_shader_source =
 		"uniform mat4 modelviewMatrix;      \n"
 		"uniform mat4 modelviewprojectionMatrix;\n"
@@ -213,92 +116,20 @@ static const uint32_t texw = 512, texh = 512;
 
 static int get_fd_rgba(struct gl *gl, uint32_t *pstride)
 {
-	struct gbm_bo *bo;
-	void *map_data = NULL;
-	uint32_t stride;
-	extern const uint32_t raw_512x512_rgba[];
-	uint8_t *map, *src = (uint8_t *)raw_512x512_rgba;
-	int fd;
-
-	/* NOTE: do not actually use GBM_BO_USE_WRITE since that gets us a dumb buffer: */
-	bo = gbm_bo_create(gl->gbm->dev, texw, texh, GBM_FORMAT_ABGR8888, GBM_BO_USE_LINEAR);
-
-	map = gbm_bo_map(bo, 0, 0, texw, texh, GBM_BO_TRANSFER_WRITE, &stride, &map_data);
-
-	for (uint32_t i = 0; i < texh; i++) {
-		memcpy(&map[stride * i], &src[texw * 4 * i], texw * 4);
-	}
-
-	gbm_bo_unmap(bo, map_data);
-
-	fd = gbm_bo_get_fd(bo);
-
-	/* we have the fd now, no longer need the bo: */
-	gbm_bo_destroy(bo);
-
-	*pstride = stride;
-
-	return fd;
+	return asset_to_fd(gl->gbm->dev, GBM_FORMAT_ABGR8888,
+			&asset_rgba_512x512, pstride);
 }
 
 static int get_fd_y(struct gl *gl, uint32_t *pstride)
 {
-	struct gbm_bo *bo;
-	void *map_data = NULL;
-	uint32_t stride;
-	extern const uint32_t raw_512x512_nv12[];
-	uint8_t *map, *src = (uint8_t *)raw_512x512_nv12;
-	int fd;
-
-	/* NOTE: do not actually use GBM_BO_USE_WRITE since that gets us a dumb buffer: */
-	bo = gbm_bo_create(gl->gbm->dev, texw, texh, GBM_FORMAT_R8, GBM_BO_USE_LINEAR);
-
-	map = gbm_bo_map(bo, 0, 0, texw, texh, GBM_BO_TRANSFER_WRITE, &stride, &map_data);
-
-	for (uint32_t i = 0; i < texh; i++) {
-		memcpy(&map[stride * i], &src[texw * i], texw);
-	}
-
-	gbm_bo_unmap(bo, map_data);
-
-	fd = gbm_bo_get_fd(bo);
-
-	/* we have the fd now, no longer need the bo: */
-	gbm_bo_destroy(bo);
-
-	*pstride = stride;
-
-	return fd;
+	return asset_to_fd(gl->gbm->dev, GBM_FORMAT_R8,
+			&asset_nv12_y_512x512, pstride);
 }
 
 static int get_fd_uv(struct gl *gl, uint32_t *pstride)
 {
-	struct gbm_bo *bo;
-	void *map_data = NULL;
-	uint32_t stride;
-	extern const uint32_t raw_512x512_nv12[];
-	uint8_t *map, *src = &((uint8_t *)raw_512x512_nv12)[texw * texh];
-	int fd;
-
-	/* NOTE: do not actually use GBM_BO_USE_WRITE since that gets us a dumb buffer: */
-	bo = gbm_bo_create(gl->gbm->dev, texw/2, texh/2, GBM_FORMAT_GR88, GBM_BO_USE_LINEAR);
-
-	map = gbm_bo_map(bo, 0, 0, texw/2, texh/2, GBM_BO_TRANSFER_WRITE, &stride, &map_data);
-
-	for (uint32_t i = 0; i < texh/2; i++) {
-		memcpy(&map[stride * i], &src[texw * i], texw);
-	}
-
-	gbm_bo_unmap(bo, map_data);
-
-	fd = gbm_bo_get_fd(bo);
-
-	/* we have the fd now, no longer need the bo: */
-	gbm_bo_destroy(bo);
-
-	*pstride = stride;
-
-	return fd;
+	return asset_to_fd(gl->gbm->dev, GBM_FORMAT_GR88,
+			&asset_nv12_uv_512x512, pstride);
 }
 
 static int init_tex_rgba(struct gl *gl)
@@ -433,7 +264,7 @@ static int init_tex_nv12_1img(struct gl *gl)
 	return 0;
 }
 
-static int init_tex(struct gl *gl, enum mode mode)
+static int init_tex_mode(struct gl *gl, enum mode mode)
 {
 	switch (mode) {
 	case RGBA:
@@ -444,60 +275,63 @@ static int init_tex(struct gl *gl, enum mode mode)
 		return init_tex_nv12_1img(gl);
 	case SMOOTH:
 	case VIDEO:
+	case CUBES:
 		assert(!"unreachable");
 		return -1;
 	}
 	return -1;
 }
 
-static void draw_cube_tex(struct egl *egl, unsigned i)
+/* With shared contexts (every output draws the same mode), the textures
+ * are only uploaded by the first output and the others just bind them:
+ */
+static GLuint shared_tex[2];
+
+static int init_tex(struct gl *gl, enum mode mode)
+{
+	int ret;
+
+	if (gl->egl.share_context != EGL_NO_CONTEXT && shared_tex[0]) {
+		memcpy(gl->tex, shared_tex, sizeof(gl->tex));
+
+		glActiveTexture(GL_TEXTURE0);
+		glBindTexture(GL_TEXTURE_EXTERNAL_OES, gl->tex[0]);
+		if (mode == NV12_2IMG) {
+			glActiveTexture(GL_TEXTURE1);
+			glBindTexture(GL_TEXTURE_EXTERNAL_OES, gl->tex[1]);
+		}
+
+		return 0;
+	}
+
+	ret = init_tex_mode(gl, mode);
+	if (!ret)
+		memcpy(shared_tex, gl->tex, sizeof(shared_tex));
+
+	return ret;
+}
+
+static void draw_cube_tex(struct egl *egl, float frame)
 {
 	struct gl *gl = (struct gl *) egl;
-	ESMatrix modelview;
+	struct cube_frame cube;
+	struct damage_rect bounds;
+
+	cube_frame_update(&cube, &gl->projection, 8.0f, frame);
+
+	/* only the cube moves, over a plain background: */
+	cube_frame_bounds(&cube, egl->width, egl->height, &bounds);
+	egl_damage(egl, &bounds);
 
 	/* clear the color buffer */
 	glClearColor(0.5, 0.5, 0.5, 1.0);
 	glClear(GL_COLOR_BUFFER_BIT);
 
-	esMatrixLoadIdentity(&modelview);
-	esTranslate(&modelview, 0.0f, 0.0f, -8.0f);
-	esRotate(&modelview, 45.0f + (0.25f * i), 1.0f, 0.0f, 0.0f);
-	esRotate(&modelview, 45.0f - (0.5f * i), 0.0f, 1.0f, 0.0f);
-	esRotate(&modelview, 10.0f + (0.15f * i), 0.0f, 0.0f, 1.0f);
+	glUniformMatrix4fv(gl->modelviewmatrix, 1, GL_FALSE, &cube.modelview.m[0][0]);
+	glUniformMatrix4fv(gl->modelviewprojectionmatrix, 1, GL_FALSE, &cube.modelviewprojection.m[0][0]);
+	glUniformMatrix3fv(gl->normalmatrix, 1, GL_FALSE, cube.normal);
 
-	ESMatrix projection;
-	esMatrixLoadIdentity(&projection);
-	esFrustum(&projection, -2.8f, +2.8f, -2.8f * gl->aspect, +2.8f * gl->aspect, 6.0f, 10.0f);
-
-	ESMatrix modelviewprojection;
-	esMatrixLoadIdentity(&modelviewprojection);
-	esMatrixMultiply(&modelviewprojection, &modelview, &projection);
-
-	float normal[9];
-	normal[0] = modelview.m[0][0];
-	normal[1] = modelview.m[0][1];
-	normal[2] = modelview.m[0][2];
-	normal[3] = modelview.m[1][0];
-	normal[4] = modelview.m[1][1];
-	normal[5] = modelview.m[1][2];
-	normal[6] = modelview.m[2][0];
-	normal[7] = modelview.m[2][1];
-	normal[8] = modelview.m[2][2];
-
-	glUniformMatrix4fv(gl->modelviewmatrix, 1, GL_FALSE, &modelview.m[0][0]);
-	glUniformMatrix4fv(gl->modelviewprojectionmatrix, 1, GL_FALSE, &modelviewprojection.m[0][0]);
-	glUniformMatrix3fv(gl->normalmatrix, 1, GL_FALSE, normal);
-	glUniform1i(gl->texture, 0); /* '0' refers to texture unit 0. */
-
-	if (gl->mode == NV12_2IMG)
-		glUniform1i(gl->textureuv, 1);
-
-	glDrawArrays(GL_TRIANGLE_STRIP, 0, 4);
-	glDrawArrays(GL_TRIANGLE_STRIP, 4, 4);
-	glDrawArrays(GL_TRIANGLE_STRIP, 8, 4);
-	glDrawArrays(GL_TRIANGLE_STRIP, 12, 4);
-	glDrawArrays(GL_TRIANGLE_STRIP, 16, 4);
-	glDrawArrays(GL_TRIANGLE_STRIP, 20, 4);
+	cube_geometry_draw(&gl->geo, 1);
 }
 
 struct egl * init_cube_tex(const struct gbm *gbm, enum mode mode)
@@ -517,7 +351,8 @@ struct egl * init_cube_tex(const struct gbm *gbm, enum mode mode)
 		return NULL;
 	}
 
-	gl->aspect = (GLfloat)(gbm->height) / (GLfloat)(gbm->width);
+	GLfloat aspect = (GLfloat)(gbm->height) / (GLfloat)(gbm->width);
+	mat4_frustum(&gl->projection, -2.8f, +2.8f, -2.8f * aspect, +2.8f * aspect, 6.0f, 10.0f);
 	gl->mode = mode;
 	gl->gbm = gbm;
 
@@ -527,9 +362,7 @@ struct egl * init_cube_tex(const struct gbm *gbm, enum mode mode)
 
 	gl->program = ret;
 
-	glBindAttribLocation(gl->program, 0, "in_position");
-	glBindAttribLocation(gl->program, 1, "in_normal");
-	glBindAttribLocation(gl->program, 2, "in_color");
+	cube_geometry_bind_attribs(gl->program);
 
 	ret = link_program(gl->program);
 	if (ret)
@@ -547,25 +380,16 @@ struct egl * init_cube_tex(const struct gbm *gbm, enum mode mode)
 		gl->texture   = glGetUniformLocation(gl->program, "uTex");
 	}
 
+	/* the textures stay on their units, so the samplers are set once: */
+	glUniform1i(gl->texture, 0); /* '0' refers to texture unit 0. */
+	if (mode == NV12_2IMG)
+		glUniform1i(gl->textureuv, 1);
+
 	glViewport(0, 0, gbm->width, gbm->height);
 	glEnable(GL_CULL_FACE);
 
-	gl->positionsoffset = 0;
-	gl->texcoordsoffset = sizeof(vVertices);
-	gl->normalsoffset = sizeof(vVertices) + sizeof(vTexCoords);
-
-	glGenBuffers(1, &gl->vbo);
-	glBindBuffer(GL_ARRAY_BUFFER, gl->vbo);
-	glBufferData(GL_ARRAY_BUFFER, sizeof(vVertices) + sizeof(vTexCoords) + sizeof(vNormals), 0, GL_STATIC_DRAW);
-	glBufferSubData(GL_ARRAY_BUFFER, gl->positionsoffset, sizeof(vVertices), &vVertices[0]);
-	glBufferSubData(GL_ARRAY_BUFFER, gl->texcoordsoffset, sizeof(vTexCoords), &vTexCoords[0]);
-	glBufferSubData(GL_ARRAY_BUFFER, gl->normalsoffset, sizeof(vNormals), &vNormals[0]);
-	glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 0, (const GLvoid *)(intptr_t)gl->positionsoffset);
-	glEnableVertexAttribArray(0);
-	glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, 0, (const GLvoid *)(intptr_t)gl->normalsoffset);
-	glEnableVertexAttribArray(1);
-	glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, 0, (const GLvoid *)(intptr_t)gl->texcoordsoffset);
-	glEnableVertexAttribArray(2);
+	if (cube_geometry_init(&gl->geo, CUBE_TEXCOORDS_IMAGE, 1))
+		return NULL;
 
 	ret = init_tex(gl, mode);
 	if (ret) {
@@ -24,130 +24,92 @@
 #define _GNU_SOURCE
 
 #include <assert.h>
+#include <pthread.h>
+#include <stdatomic.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <unistd.h>
 
 #include "common.h"
 #include "esUtil.h"
+#include "geometry.h"
+#include "matrix.h"
+
+/* Start prerolling the next file this long before the current one ends: */
+#define PREFETCH_NS  (2 * 1000000000LL)
+
+/* and check how far along the current one is every so many frames: */
+#define PREFETCH_CHECK_FRAMES 16
+
+/* After an entry failed, wait this long before trying the next one,
+ * doubling with every failure in a row up to PREFETCH_RETRY_MAX:
+ */
+#define PREFETCH_RETRY_NS  (250 * 1000000LL)
+#define PREFETCH_RETRY_MAX 5
+
+/* The swap chain keeps scanning out frames of a decoder switched away
+ * from (by their dmabuf fds) until all of its buffers were drawn anew.
+ * Every draw takes a buffer the display is done with, so the decoder is
+ * torn down this many draws later:
+ */
+#define RETIRE_DRAWS (MAX_SWAP_DEPTH + 1)
+
+/* Streams decoded at once, at most one per cube face: */
+#define MAX_STREAMS 6
+
+struct gl;
+
+/*
+ * A video playing on some of the cube's faces: its decoder, the next one
+ * prerolling in the background while the current one nears its end (if
+ * any), and the texture its frames go into.  Stream k of n plays the
+ * playlist entries k, k + n, k + 2n...
+ *
+ * Setting up a pipeline takes a while, so the next decoder is created on
+ * a thread of its own, which hands it over in 'next' before clearing
+ * 'loading'.  Until then only that thread touches 'next' and the retry
+ * state.
+ */
+struct stream {
+	struct gl *gl;
+	struct decoder *decoder, *next;
+	atomic_int loading;
+	const char *next_file;
+	GLuint tex;
+	unsigned int frames;
+	unsigned int idx;        /* the entry to prefetch next */
+
+	/* entries which failed in a row, and when to try another: */
+	unsigned int failures;
+	uint64_t retry_time;
+
+	/* the decoder played before, until RETIRE_DRAWS draws went by: */
+	struct decoder *retired;
+	unsigned int retire_draws;
+};
 
 struct gl {
 	struct egl egl;
 
-	GLfloat aspect;
+	ESMatrix projection;
 	const struct gbm *gbm;
 
 	GLuint program, blit_program;
 	/* uniform handles: */
 	GLint modelviewmatrix, modelviewprojectionmatrix, normalmatrix;
-	GLint texture, blit_texture;
-	GLuint vbo;
-	GLuint positionsoffset, texcoordsoffset, normalsoffset;
-	GLuint tex;
-
-	/* video decoder: */
-	struct decoder *decoder;
-	int filenames_count, idx;
-	const char *filenames[32];
-};
+	struct cube_geometry geo;
 
-static const GLfloat vVertices[] = {
-		// front
-		-1.0f, -1.0f, +1.0f,
-		+1.0f, -1.0f, +1.0f,
-		-1.0f, +1.0f, +1.0f,
-		+1.0f, +1.0f, +1.0f,
-		// back
-		+1.0f, -1.0f, -1.0f,
-		-1.0f, -1.0f, -1.0f,
-		+1.0f, +1.0f, -1.0f,
-		-1.0f, +1.0f, -1.0f,
-		// right
-		+1.0f, -1.0f, +1.0f,
-		+1.0f, -1.0f, -1.0f,
-		+1.0f, +1.0f, +1.0f,
-		+1.0f, +1.0f, -1.0f,
-		// left
-		-1.0f, -1.0f, -1.0f,
-		-1.0f, -1.0f, +1.0f,
-		-1.0f, +1.0f, -1.0f,
-		-1.0f, +1.0f, +1.0f,
-		// top
-		-1.0f, +1.0f, +1.0f,
-		+1.0f, +1.0f, +1.0f,
-		-1.0f, +1.0f, -1.0f,
-		+1.0f, +1.0f, -1.0f,
-		// bottom
-		-1.0f, -1.0f, -1.0f,
-		+1.0f, -1.0f, -1.0f,
-		-1.0f, -1.0f, +1.0f,
-		+1.0f, -1.0f, +1.0f,
-};
+	/* frame scanned out on an overlay plane underneath us, if any: */
+	const struct dmabuf_frame *scanout_frame;
 
-static const GLfloat vTexCoords[] = {
-		//front
-		0.0f, 1.0f,
-		1.0f, 1.0f,
-		0.0f, 0.0f,
-		1.0f, 0.0f,
-		//back
-		0.0f, 1.0f,
-		1.0f, 1.0f,
-		0.0f, 0.0f,
-		1.0f, 0.0f,
-		//right
-		0.0f, 1.0f,
-		1.0f, 1.0f,
-		0.0f, 0.0f,
-		1.0f, 0.0f,
-		//left
-		0.0f, 1.0f,
-		1.0f, 1.0f,
-		0.0f, 0.0f,
-		1.0f, 0.0f,
-		//top
-		0.0f, 1.0f,
-		1.0f, 1.0f,
-		0.0f, 0.0f,
-		1.0f, 0.0f,
-		//bottom
-		0.0f, 1.0f,
-		1.0f, 1.0f,
-		0.0f, 0.0f,
-		1.0f, 0.0f,
-};
+	/* the streams, the first also filling the background: */
+	struct stream streams[MAX_STREAMS];
+	unsigned int nstreams;
 
-static const GLfloat vNormals[] = {
-		// front
-		+0.0f, +0.0f, +1.0f, // forward
-		+0.0f, +0.0f, +1.0f, // forward
-		+0.0f, +0.0f, +1.0f, // forward
-		+0.0f, +0.0f, +1.0f, // forward
-		// back
-		+0.0f, +0.0f, -1.0f, // backward
-		+0.0f, +0.0f, -1.0f, // backward
-		+0.0f, +0.0f, -1.0f, // backward
-		+0.0f, +0.0f, -1.0f, // backward
-		// right
-		+1.0f, +0.0f, +0.0f, // right
-		+1.0f, +0.0f, +0.0f, // right
-		+1.0f, +0.0f, +0.0f, // right
-		+1.0f, +0.0f, +0.0f, // right
-		// left
-		-1.0f, +0.0f, +0.0f, // left
-		-1.0f, +0.0f, +0.0f, // left
-		-1.0f, +0.0f, +0.0f, // left
-		-1.0f, +0.0f, +0.0f, // left
-		// top
-		+0.0f, +1.0f, +0.0f, // up
-		+0.0f, +1.0f, +0.0f, // up
-		+0.0f, +1.0f, +0.0f, // up
-		+0.0f, +1.0f, +0.0f, // up
-		// bottom
-		+0.0f, -1.0f, +0.0f, // down
-		+0.0f, -1.0f, +0.0f, // down
-		+0.0f, -1.0f, +0.0f, // down
-		+0.0f, -1.0f, +0.0f  // down
+	/* the playlist, looped over: */
+	char **filenames;
+	unsigned int filenames_count;
 };
 
 static const char *blit_vs =
@@ -180,14 +142,17 @@ static const char *vertex_shader_source =
 		"uniform mat4 modelviewprojectionMatrix;\n"
 		"uniform mat3 normalMatrix;         \n"
 		"                                   \n"
+		"uniform float streams;             \n"
+		"                                   \n"
 		"attribute vec4 in_position;        \n"
-		"attribute vec2 in_TexCoord;        \n"
+		"attribute vec3 in_TexCoord;        \n"
 		"attribute vec3 in_normal;          \n"
 		"                                   \n"
 		"vec4 lightSource = vec4(2.0, 2.0, 20.0, 0.0);\n"
 		"                                   \n"
 		"varying vec4 vVaryingColor;        \n"
 		"varying vec2 vTexCoord;            \n"
+		"varying float vStream;             \n"
 		"                                   \n"
 		"void main()                        \n"
 		"{                                  \n"
@@ -198,103 +163,279 @@ static const char *vertex_shader_source =
 		"    vec3 vLightDir = normalize(lightSource.xyz - vPosition3);\n"
 		"    float diff = max(0.0, dot(vEyeNormal, vLightDir));\n"
 		"    vVaryingColor = vec4(diff * vec3(1.0, 1.0, 1.0), 1.0);\n"
-		"    vTexCoord = in_TexCoord; \n"
-		"}                            \n";
+		"    vTexCoord = in_TexCoord.xy;    \n"
+		"    /* face k shows stream k % n: */\n"
+		"    vStream = mod(in_TexCoord.z, streams);\n"
+		"}                                  \n";
 
+/* Every stream's texture stays bound to a unit of its own, so the whole
+ * cube is one draw, picking the face's sampler (which GLSL ES 1.00 can't
+ * index by a varying) here.  Prefixed with the STREAMS define:
+ */
 static const char *fragment_shader_source =
 		"#extension GL_OES_EGL_image_external : enable\n"
 		"precision mediump float;           \n"
 		"                                   \n"
-		"uniform samplerExternalOES uTex;   \n"
+		"uniform samplerExternalOES uTex0;  \n"
+		"#if STREAMS > 1                    \n"
+		"uniform samplerExternalOES uTex1;  \n"
+		"#endif                             \n"
+		"#if STREAMS > 2                    \n"
+		"uniform samplerExternalOES uTex2;  \n"
+		"#endif                             \n"
+		"#if STREAMS > 3                    \n"
+		"uniform samplerExternalOES uTex3;  \n"
+		"#endif                             \n"
+		"#if STREAMS > 4                    \n"
+		"uniform samplerExternalOES uTex4;  \n"
+		"#endif                             \n"
+		"#if STREAMS > 5                    \n"
+		"uniform samplerExternalOES uTex5;  \n"
+		"#endif                             \n"
 		"                                   \n"
 		"varying vec4 vVaryingColor;        \n"
 		"varying vec2 vTexCoord;            \n"
+		"varying float vStream;             \n"
+		"                                   \n"
+		"vec4 texel()                       \n"
+		"{                                  \n"
+		"#if STREAMS > 1                    \n"
+		"    if (vStream > 0.5) {           \n"
+		"#if STREAMS > 2                    \n"
+		"        if (vStream > 1.5) {       \n"
+		"#if STREAMS > 3                    \n"
+		"            if (vStream > 2.5) {   \n"
+		"#if STREAMS > 4                    \n"
+		"                if (vStream > 3.5) {\n"
+		"#if STREAMS > 5                    \n"
+		"                    if (vStream > 4.5)\n"
+		"                        return texture2D(uTex5, vTexCoord);\n"
+		"#endif                             \n"
+		"                    return texture2D(uTex4, vTexCoord);\n"
+		"                }                  \n"
+		"#endif                             \n"
+		"                return texture2D(uTex3, vTexCoord);\n"
+		"            }                      \n"
+		"#endif                             \n"
+		"            return texture2D(uTex2, vTexCoord);\n"
+		"        }                          \n"
+		"#endif                             \n"
+		"        return texture2D(uTex1, vTexCoord);\n"
+		"    }                              \n"
+		"#endif                             \n"
+		"    return texture2D(uTex0, vTexCoord);\n"
+		"}                                  \n"
 		"                                   \n"
 		"void main()                        \n"
 		"{                                  \n"
-		"    gl_FragColor = vVaryingColor * texture2D(uTex, vTexCoord);\n"
+		"    gl_FragColor = vVaryingColor * texel();\n"
 		"}                                  \n";
 
 
-static void draw_cube_video(struct egl *egl, unsigned i)
+
+/* The next decoder, if there is one and its thread is done with it: */
+static struct decoder *next_decoder(struct stream *st)
+{
+	if (atomic_load_explicit(&st->loading, memory_order_acquire))
+		return NULL;
+
+	return st->next;
+}
+
+static void prefetch_failed(struct stream *st)
+{
+	unsigned int shift = st->failures < PREFETCH_RETRY_MAX ?
+			st->failures : PREFETCH_RETRY_MAX;
+
+	st->failures++;
+	st->retry_time = get_time_ns() + (PREFETCH_RETRY_NS << shift);
+}
+
+static void *prefetch_thread(void *arg)
+{
+	struct stream *st = arg;
+
+	st->next = video_init(&st->gl->egl, st->gl->gbm, st->next_file);
+	if (!st->next)
+		prefetch_failed(st);
+	atomic_store_explicit(&st->loading, 0, memory_order_release);
+
+	return NULL;
+}
+
+/* Start the stream's next playlist entry prerolling, unless already there
+ * (or still backing off from a failed one):
+ */
+static void prefetch_video(struct gl *gl, struct stream *st)
+{
+	pthread_t thread;
+
+	if (atomic_load_explicit(&st->loading, memory_order_acquire) || st->next ||
+	    get_time_ns() < st->retry_time)
+		return;
+
+	st->next_file = gl->filenames[st->idx];
+	st->idx = (st->idx + gl->nstreams) % gl->filenames_count;
+
+	atomic_store_explicit(&st->loading, 1, memory_order_relaxed);
+	if (pthread_create(&thread, NULL, prefetch_thread, st)) {
+		atomic_store_explicit(&st->loading, 0, memory_order_relaxed);
+		prefetch_failed(st);
+		return;
+	}
+	pthread_detach(thread);
+}
+
+/* At the end of the stream, switch over to the next entry as soon as it
+ * prerolled.  Until then the last frame stays up, nothing here waits
+ * for GStreamer:
+ */
+static int next_video(struct gl *gl, struct stream *st)
+{
+	struct decoder *next;
+
+	prefetch_video(gl, st);
+	if (atomic_load_explicit(&st->loading, memory_order_acquire))
+		return 0;
+
+	/* no switching again while the last one's frames may be on screen: */
+	if (st->retired)
+		return 0;
+
+	/* (an entry which failed to load was skipped already) */
+	next = st->next;
+	if (!next)
+		return 0;
+
+	/* an entry which failed to play, skip it: */
+	if (video_eos(next)) {
+		video_deinit_async(next);
+		st->next = NULL;
+		prefetch_failed(st);
+		return 0;
+	}
+
+	if (!video_prerolled(next))
+		return 0;
+
+	video_play(next);
+	st->retired = st->decoder;
+	st->retire_draws = RETIRE_DRAWS;
+	st->decoder = next;
+	st->next = NULL;
+	st->frames = 0;
+	st->failures = 0;
+
+	return 1;
+}
+
+/* Latch the stream's newest frame into its texture.  Returns the frame
+ * shown, or NULL if there is none, with *latched set if it is a new one:
+ */
+static EGLImage update_stream(struct gl *gl, struct stream *st, int *latched)
 {
-	ESMatrix modelview;
 	EGLImage frame;
 
-	struct gl *gl = (struct gl *) egl;
+	/* by now the swap chain was drawn anew without the old frames: */
+	if (st->retired && --st->retire_draws == 0) {
+		video_deinit_async(st->retired);
+		st->retired = NULL;
+	}
+
+	frame = video_frame(st->decoder, latched);
+	if (!frame && video_eos(st->decoder) && next_video(gl, st))
+		frame = video_frame(st->decoder, latched);
 
-	frame = video_frame(gl->decoder);
-	if (!frame) {
-		/* end of stream */
-		glDeleteTextures(1, &gl->tex);
-		glGenTextures(1, &gl->tex);
-		video_deinit(gl->decoder);
-		gl->idx = (gl->idx + 1) % gl->filenames_count;
-		gl->decoder = video_init(&gl->egl, gl->gbm, gl->filenames[gl->idx]);
+	/* get the next entry going while this one is still playing: */
+	if (!next_decoder(st) && ++st->frames % PREFETCH_CHECK_FRAMES == 0) {
+		int64_t remaining = video_remaining(st->decoder);
+
+		if (remaining >= 0 && remaining < PREFETCH_NS)
+			prefetch_video(gl, st);
 	}
 
-	glUseProgram(gl->blit_program);
+	/* the texture is left bound to the stream's unit, and to the
+	 * frame until the next one:
+	 */
+	if (frame && *latched) {
+		glActiveTexture(GL_TEXTURE0 + (st - gl->streams));
+		gl->egl.glEGLImageTargetTexture2DOES(GL_TEXTURE_EXTERNAL_OES, frame);
+	}
 
-	glActiveTexture(GL_TEXTURE0);
-	glBindTexture(GL_TEXTURE_EXTERNAL_OES, gl->tex);
-	glTexParameteri(GL_TEXTURE_EXTERNAL_OES, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-	glTexParameteri(GL_TEXTURE_EXTERNAL_OES, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-	glTexParameteri(GL_TEXTURE_EXTERNAL_OES, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
-	glTexParameteri(GL_TEXTURE_EXTERNAL_OES, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
-	egl->glEGLImageTargetTexture2DOES(GL_TEXTURE_EXTERNAL_OES, frame);
+	return frame;
+}
+
+static void draw_cube_video(struct egl *egl, float t)
+{
+	struct cube_frame cube;
+	struct damage_rect bounds;
+	const struct dmabuf_frame *last_scanout;
+	EGLImage frame;
+	unsigned int i;
+	int latched, other;
 
-	/* clear the color buffer */
-	glClearColor(0.5, 0.5, 0.5, 1.0);
-	glClear(GL_COLOR_BUFFER_BIT);
+	struct gl *gl = (struct gl *) egl;
 
-	glUseProgram(gl->blit_program);
-	glUniform1i(gl->blit_texture, 0); /* '0' refers to texture unit 0. */
-	glDrawArrays(GL_TRIANGLE_STRIP, 0, 4);
+	/* the other streams only show on the cube, so only the first one's
+	 * new frames say anything about the damage:
+	 */
+	frame = update_stream(gl, &gl->streams[0], &latched);
+	for (i = 1; i < gl->nstreams; i++)
+		update_stream(gl, &gl->streams[i], &other);
+
+	last_scanout = gl->scanout_frame;
+
+	/* if the display scans out the video frame itself, just leave the
+	 * background transparent for it to show through:
+	 */
+	gl->scanout_frame = (egl->scanout && frame) ?
+			video_frame_dmabuf(gl->streams[0].decoder) : NULL;
+
+	cube_frame_update(&cube, &gl->projection, 8.0f, t);
+
+	/* the background only changes with a new frame blitted into it, or
+	 * when switching between that and the plane showing through:
+	 */
+	if (!last_scanout == !gl->scanout_frame && (gl->scanout_frame || !latched)) {
+		cube_frame_bounds(&cube, egl->width, egl->height, &bounds);
+		egl_damage(egl, &bounds);
+	}
+
+	if (gl->scanout_frame) {
+		glClearColor(0.0, 0.0, 0.0, 0.0);
+		glClear(GL_COLOR_BUFFER_BIT);
+	} else {
+		/* clear the color buffer */
+		glClearColor(0.5, 0.5, 0.5, 1.0);
+		glClear(GL_COLOR_BUFFER_BIT);
+
+		glUseProgram(gl->blit_program);
+		/* the cube's front face strip, as a full screen quad: */
+		glDrawArrays(GL_TRIANGLE_STRIP, 0, 4);
+	}
 
 	glUseProgram(gl->program);
 
-	esMatrixLoadIdentity(&modelview);
-	esTranslate(&modelview, 0.0f, 0.0f, -8.0f);
-	esRotate(&modelview, 45.0f + (0.25f * i), 1.0f, 0.0f, 0.0f);
-	esRotate(&modelview, 45.0f - (0.5f * i), 0.0f, 1.0f, 0.0f);
-	esRotate(&modelview, 10.0f + (0.15f * i), 0.0f, 0.0f, 1.0f);
+	glUniformMatrix4fv(gl->modelviewmatrix, 1, GL_FALSE, &cube.modelview.m[0][0]);
+	glUniformMatrix4fv(gl->modelviewprojectionmatrix, 1, GL_FALSE, &cube.modelviewprojection.m[0][0]);
+	glUniformMatrix3fv(gl->normalmatrix, 1, GL_FALSE, cube.normal);
 
-	ESMatrix projection;
-	esMatrixLoadIdentity(&projection);
-	esFrustum(&projection, -2.1f, +2.1f, -2.1f * gl->aspect, +2.1f * gl->aspect, 6.0f, 10.0f);
-
-	ESMatrix modelviewprojection;
-	esMatrixLoadIdentity(&modelviewprojection);
-	esMatrixMultiply(&modelviewprojection, &modelview, &projection);
-
-	float normal[9];
-	normal[0] = modelview.m[0][0];
-	normal[1] = modelview.m[0][1];
-	normal[2] = modelview.m[0][2];
-	normal[3] = modelview.m[1][0];
-	normal[4] = modelview.m[1][1];
-	normal[5] = modelview.m[1][2];
-	normal[6] = modelview.m[2][0];
-	normal[7] = modelview.m[2][1];
-	normal[8] = modelview.m[2][2];
-
-	glUniformMatrix4fv(gl->modelviewmatrix, 1, GL_FALSE, &modelview.m[0][0]);
-	glUniformMatrix4fv(gl->modelviewprojectionmatrix, 1, GL_FALSE, &modelviewprojection.m[0][0]);
-	glUniformMatrix3fv(gl->normalmatrix, 1, GL_FALSE, normal);
-	glUniform1i(gl->texture, 0); /* '0' refers to texture unit 0. */
-
-	glDrawArrays(GL_TRIANGLE_STRIP, 0, 4);
-	glDrawArrays(GL_TRIANGLE_STRIP, 4, 4);
-	glDrawArrays(GL_TRIANGLE_STRIP, 8, 4);
-	glDrawArrays(GL_TRIANGLE_STRIP, 12, 4);
-	glDrawArrays(GL_TRIANGLE_STRIP, 16, 4);
-	glDrawArrays(GL_TRIANGLE_STRIP, 20, 4);
+	cube_geometry_draw(&gl->geo, 1);
+}
+
+static const struct dmabuf_frame * scanout_cube_video(struct egl *egl)
+{
+	struct gl *gl = (struct gl *) egl;
+
+	return gl->scanout_frame;
 }
 
-struct egl * init_cube_video(const struct gbm *gbm, const char *filenames)
+struct egl * init_cube_video(const struct gbm *gbm, const char *filenames,
+		unsigned streams, int scanout)
 {
-	char *fnames, *s;
-	int ret, i = 0;
+	char *fnames, *s, *fs;
+	unsigned int i;
+	int ret;
 
 	struct gl *gl = calloc(1, sizeof(*gl));
 
@@ -307,82 +448,114 @@ struct egl * init_cube_video(const struct gbm *gbm, const char *filenames)
 		return NULL;
 	}
 
+	/* a comma separated list, empty entries skipped: */
 	fnames = strdup(filenames);
-	while ((s = strstr(fnames, ","))) {
-		gl->filenames[i] = fnames;
-		s[0] = '\0';
-		fnames = &s[1];
-		i++;
+	for (s = strtok(fnames, ","); s; s = strtok(NULL, ",")) {
+		char **list = realloc(gl->filenames,
+				(gl->filenames_count + 1) * sizeof(*list));
+
+		if (!list)
+			return NULL;
+		gl->filenames = list;
+		gl->filenames[gl->filenames_count++] = s;
 	}
-	gl->filenames[i] = fnames;
-	gl->filenames_count = ++i;
-
-	gl->decoder = video_init(&gl->egl, gbm, gl->filenames[gl->idx]);
-	if (!gl->decoder) {
-		printf("cannot create video decoder\n");
+	if (!gl->filenames_count) {
+		printf("no video files given\n");
 		return NULL;
 	}
 
-	gl->aspect = (GLfloat)(gbm->height) / (GLfloat)(gbm->width);
+	if (!streams || streams > MAX_STREAMS) {
+		printf("invalid video stream count: %u\n", streams);
+		return NULL;
+	}
+	gl->nstreams = streams;
 	gl->gbm = gbm;
 
+	/* start them all prerolling before waiting for any: */
+	for (i = 0; i < gl->nstreams; i++) {
+		struct stream *st = &gl->streams[i];
+
+		st->gl = gl;
+		st->decoder = video_init(&gl->egl, gbm,
+				gl->filenames[i % gl->filenames_count]);
+		if (!st->decoder) {
+			printf("cannot create video decoder\n");
+			return NULL;
+		}
+		st->idx = (i + gl->nstreams) % gl->filenames_count;
+	}
+	for (i = 0; i < gl->nstreams; i++)
+		video_play(gl->streams[i].decoder);
+
+	GLfloat aspect = (GLfloat)(gbm->height) / (GLfloat)(gbm->width);
+	mat4_frustum(&gl->projection, -2.1f, +2.1f, -2.1f * aspect, +2.1f * aspect, 6.0f, 10.0f);
+
 	ret = create_program(blit_vs, blit_fs);
 	if (ret < 0)
 		return NULL;
 
 	gl->blit_program = ret;
 
-	glBindAttribLocation(gl->blit_program, 0, "in_position");
-	glBindAttribLocation(gl->blit_program, 1, "in_TexCoord");
+	cube_geometry_bind_attribs(gl->blit_program);
 
 	ret = link_program(gl->blit_program);
 	if (ret)
 		return NULL;
 
-	gl->blit_texture = glGetUniformLocation(gl->blit_program, "uTex");
+	/* sampler uniforms never change, so they are set here once: */
+	glUseProgram(gl->blit_program);
+	glUniform1i(glGetUniformLocation(gl->blit_program, "uTex"), 0);
 
-	ret = create_program(vertex_shader_source, fragment_shader_source);
+	if (asprintf(&fs, "#define STREAMS %u\n%s", gl->nstreams,
+			fragment_shader_source) < 0)
+		return NULL;
+	/* the source has to stay around until linked, for the program cache: */
+	ret = create_program(vertex_shader_source, fs);
 	if (ret < 0)
 		return NULL;
 
 	gl->program = ret;
 
-	glBindAttribLocation(gl->program, 0, "in_position");
-	glBindAttribLocation(gl->program, 1, "in_TexCoord");
-	glBindAttribLocation(gl->program, 2, "in_normal");
+	cube_geometry_bind_attribs(gl->program);
 
 	ret = link_program(gl->program);
+	free(fs);
 	if (ret)
 		return NULL;
 
 	gl->modelviewmatrix = glGetUniformLocation(gl->program, "modelviewMatrix");
 	gl->modelviewprojectionmatrix = glGetUniformLocation(gl->program, "modelviewprojectionMatrix");
 	gl->normalmatrix = glGetUniformLocation(gl->program, "normalMatrix");
-	gl->texture   = glGetUniformLocation(gl->program, "uTex");
+
+	glUseProgram(gl->program);
+	glUniform1f(glGetUniformLocation(gl->program, "streams"), gl->nstreams);
+	for (i = 0; i < gl->nstreams; i++) {
+		char name[8];
+
+		snprintf(name, sizeof(name), "uTex%u", i);
+		glUniform1i(glGetUniformLocation(gl->program, name), i);
+	}
 
 	glViewport(0, 0, gbm->width, gbm->height);
 	glEnable(GL_CULL_FACE);
 
-	gl->positionsoffset = 0;
-	gl->texcoordsoffset = sizeof(vVertices);
-	gl->normalsoffset = sizeof(vVertices) + sizeof(vTexCoords);
-
-	glGenBuffers(1, &gl->vbo);
-	glBindBuffer(GL_ARRAY_BUFFER, gl->vbo);
-	glBufferData(GL_ARRAY_BUFFER, sizeof(vVertices) + sizeof(vTexCoords) + sizeof(vNormals), 0, GL_STATIC_DRAW);
-	glBufferSubData(GL_ARRAY_BUFFER, gl->positionsoffset, sizeof(vVertices), &vVertices[0]);
-	glBufferSubData(GL_ARRAY_BUFFER, gl->texcoordsoffset, sizeof(vTexCoords), &vTexCoords[0]);
-	glBufferSubData(GL_ARRAY_BUFFER, gl->normalsoffset, sizeof(vNormals), &vNormals[0]);
-	glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 0, (const GLvoid *)(intptr_t)gl->positionsoffset);
-	glEnableVertexAttribArray(0);
-	glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, 0, (const GLvoid *)(intptr_t)gl->texcoordsoffset);
-	glEnableVertexAttribArray(1);
-	glVertexAttribPointer(2, 3, GL_FLOAT, GL_FALSE, 0, (const GLvoid *)(intptr_t)gl->normalsoffset);
-	glEnableVertexAttribArray(2);
-
-	glGenTextures(1, &gl->tex);
+	if (cube_geometry_init(&gl->geo, CUBE_TEXCOORDS_VIDEO, 1))
+		return NULL;
+
+	/* each stream's texture on a unit of its own, for good: */
+	for (i = 0; i < gl->nstreams; i++) {
+		glGenTextures(1, &gl->streams[i].tex);
+		glActiveTexture(GL_TEXTURE0 + i);
+		glBindTexture(GL_TEXTURE_EXTERNAL_OES, gl->streams[i].tex);
+		glTexParameteri(GL_TEXTURE_EXTERNAL_OES, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+		glTexParameteri(GL_TEXTURE_EXTERNAL_OES, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+		glTexParameteri(GL_TEXTURE_EXTERNAL_OES, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+		glTexParameteri(GL_TEXTURE_EXTERNAL_OES, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+	}
 
 	gl->egl.draw = draw_cube_video;
+	if (scanout)
+		gl->egl.scanout = scanout_cube_video;
 
 	return &gl->egl;
 }
@@ -23,6 +23,7 @@
 
 #include <assert.h>
 #include <errno.h>
+#include <poll.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -30,122 +31,446 @@
 
 #include "common.h"
 #include "drm-common.h"
+#include "event-loop.h"
+#include "stats.h"
 
 #define VOID2U64(x) ((uint64_t)(unsigned long)(x))
 
-static int add_connector_property(const struct drm *drm, drmModeAtomicReq *req, uint32_t obj_id,
-					const char *name, uint64_t value)
+static const char * const plane_prop_names[PLANE_PROP_COUNT] = {
+	[PLANE_FB_ID] = "FB_ID",
+	[PLANE_CRTC_ID] = "CRTC_ID",
+	[PLANE_SRC_X] = "SRC_X",
+	[PLANE_SRC_Y] = "SRC_Y",
+	[PLANE_SRC_W] = "SRC_W",
+	[PLANE_SRC_H] = "SRC_H",
+	[PLANE_CRTC_X] = "CRTC_X",
+	[PLANE_CRTC_Y] = "CRTC_Y",
+	[PLANE_CRTC_W] = "CRTC_W",
+	[PLANE_CRTC_H] = "CRTC_H",
+	[PLANE_IN_FENCE_FD] = "IN_FENCE_FD",
+	[PLANE_ZPOS] = "zpos",
+	[PLANE_FB_DAMAGE_CLIPS] = "FB_DAMAGE_CLIPS",
+};
+
+static const char * const crtc_prop_names[CRTC_PROP_COUNT] = {
+	[CRTC_MODE_ID] = "MODE_ID",
+	[CRTC_ACTIVE] = "ACTIVE",
+	[CRTC_OUT_FENCE_PTR] = "OUT_FENCE_PTR",
+};
+
+static const char * const connector_prop_names[CONNECTOR_PROP_COUNT] = {
+	[CONNECTOR_CRTC_ID] = "CRTC_ID",
+};
+
+static int find_property(drmModeObjectProperties *props,
+		drmModePropertyRes **props_info, const char *name)
 {
-	struct connector *obj = drm->connector;
 	unsigned int i;
-	int prop_id = 0;
 
-	for (i = 0 ; i < obj->props->count_props ; i++) {
-		if (strcmp(obj->props_info[i]->name, name) == 0) {
-			prop_id = obj->props_info[i]->prop_id;
-			break;
-		}
+	for (i = 0 ; i < props->count_props ; i++)
+		if (strcmp(props_info[i]->name, name) == 0)
+			return i;
+
+	return -1;
+}
+
+/* Resolve the property ids once, so that the commits don't have to go
+ * looking for them by name every frame:
+ */
+static void get_prop_ids(drmModeObjectProperties *props,
+		drmModePropertyRes **props_info, const char * const *names,
+		unsigned int count, uint32_t *prop_id)
+{
+	unsigned int i;
+
+	for (i = 0; i < count; i++) {
+		int idx = find_property(props, props_info, names[i]);
+
+		prop_id[i] = idx < 0 ? 0 : props_info[idx]->prop_id;
 	}
+}
 
-	if (prop_id < 0) {
-		printf("no connector property: %s\n", name);
+static int add_property(drmModeAtomicReq *req, uint32_t obj_id, uint32_t prop_id,
+		const char *type, const char *name, uint64_t value)
+{
+	if (!prop_id) {
+		printf("no %s property: %s\n", type, name);
 		return -EINVAL;
 	}
 
 	return drmModeAtomicAddProperty(req, obj_id, prop_id, value);
 }
 
-static int add_crtc_property(const struct drm *drm, drmModeAtomicReq *req, uint32_t obj_id,
-				const char *name, uint64_t value)
+static int add_connector_property(const struct drm *drm, drmModeAtomicReq *req,
+				enum connector_prop prop, uint64_t value)
+{
+	return add_property(req, drm->connector_id, drm->connector->prop_id[prop],
+			"connector", connector_prop_names[prop], value);
+}
+
+static int add_crtc_property(const struct drm *drm, drmModeAtomicReq *req,
+				enum crtc_prop prop, uint64_t value)
+{
+	return add_property(req, drm->crtc_id, drm->crtc->prop_id[prop],
+			"crtc", crtc_prop_names[prop], value);
+}
+
+static int add_plane_property(const struct plane *obj, drmModeAtomicReq *req,
+				enum plane_prop prop, uint64_t value)
+{
+	return add_property(req, obj->plane->plane_id, obj->prop_id[prop],
+			"plane", plane_prop_names[prop], value);
+}
+
+static int find_plane_property(const struct plane *obj, const char *name)
+{
+	return find_property(obj->props, obj->props_info, name);
+}
+
+static const struct plane_format * find_plane_format(const struct plane *plane,
+		uint32_t format)
 {
-	struct crtc *obj = drm->crtc;
 	unsigned int i;
-	int prop_id = -1;
 
-	for (i = 0 ; i < obj->props->count_props ; i++) {
-		if (strcmp(obj->props_info[i]->name, name) == 0) {
-			prop_id = obj->props_info[i]->prop_id;
-			break;
-		}
+	for (i = 0; i < plane->count_formats; i++)
+		if (plane->formats[i].format == format)
+			return &plane->formats[i];
+
+	return NULL;
+}
+
+/* DRM_FORMAT_MOD_INVALID means the buffer has an implicit layout which
+ * any plane supporting the format is assumed to handle.  Without
+ * IN_FORMATS the driver does not do modifiers, so only linear works.
+ */
+static int plane_supports(const struct plane *plane, uint32_t format,
+		uint64_t modifier)
+{
+	const struct plane_format *f = find_plane_format(plane, format);
+	unsigned int i;
+
+	if (!f)
+		return 0;
+
+	if (modifier == DRM_FORMAT_MOD_INVALID)
+		return 1;
+
+	if (!f->count_modifiers)
+		return modifier == DRM_FORMAT_MOD_LINEAR;
+
+	for (i = 0; i < f->count_modifiers; i++)
+		if (f->modifiers[i] == modifier)
+			return 1;
+
+	return 0;
+}
+
+#ifdef FORMAT_BLOB_CURRENT
+/* Each modifier in the IN_FORMATS blob has a bitmask of the formats (by
+ * index into the blob's format list, starting at 'offset') it works with:
+ */
+static void get_plane_modifiers(int drm_fd, struct plane *plane)
+{
+	int idx = find_plane_property(plane, "IN_FORMATS");
+	drmModePropertyBlobRes *blob;
+	unsigned i;
+
+	if (idx < 0)
+		return;
+
+	blob = drmModeGetPropertyBlob(drm_fd, plane->props->prop_values[idx]);
+	if (!blob)
+		return;
+
+	for (i = 0; i < plane->count_formats; i++) {
+		struct plane_format *f = &plane->formats[i];
+
+		free(f->modifiers);
+		f->count_modifiers = drm_blob_modifiers(blob, f->format, &f->modifiers);
 	}
 
-	if (prop_id < 0) {
-		printf("no crtc property: %s\n", name);
-		return -EINVAL;
+	drmModeFreePropertyBlob(blob);
+}
+#endif
+
+/* Cache the formats the plane can scan out, along with the modifiers
+ * supported for each if the driver tells us:
+ */
+static void get_plane_formats(int drm_fd, struct plane *plane)
+{
+	drmModePlane *p = plane->plane;
+	uint32_t i;
+
+	plane->count_formats = p->count_formats;
+	plane->formats = calloc(p->count_formats, sizeof(*plane->formats));
+	for (i = 0; i < p->count_formats; i++)
+		plane->formats[i].format = p->formats[i];
+
+#ifdef FORMAT_BLOB_CURRENT
+	get_plane_modifiers(drm_fd, plane);
+#else
+	(void)drm_fd;
+#endif
+}
+
+static uint64_t get_plane_type(const struct plane *plane)
+{
+	int i = find_plane_property(plane, "type");
+
+	if (i < 0)
+		return DRM_PLANE_TYPE_OVERLAY;
+
+	return plane->props->prop_values[i];
+}
+
+static void get_plane_zpos_info(struct plane *plane)
+{
+	int i = find_plane_property(plane, "zpos");
+
+	if (i < 0)
+		return;
+
+	plane->zpos = plane->props_info[i];
+	plane->zpos_value = plane->props->prop_values[i];
+}
+
+/* Returns 0 if the plane's zpos can be changed, or -1 (with the fixed
+ * zpos in *zpos if the plane has one).
+ */
+static int get_plane_zpos(const struct plane *plane, uint64_t *zpos)
+{
+	if (!plane->zpos)
+		return -1;
+
+	*zpos = plane->zpos_value;
+
+	if ((plane->zpos->flags & DRM_MODE_PROP_IMMUTABLE) ||
+			!(plane->zpos->flags & DRM_MODE_PROP_RANGE))
+		return -1;
+
+	return 0;
+}
+
+/* The lowest and highest zpos the plane can be given: */
+static void plane_zpos_range(const struct plane *plane, uint64_t *min, uint64_t *max)
+{
+	if (get_plane_zpos(plane, min) == 0) {
+		*min = plane->zpos->values[0];
+		*max = plane->zpos->values[1];
+	} else {
+		*max = *min;
 	}
+}
 
-	return drmModeAtomicAddProperty(req, obj_id, prop_id, value);
+/* Layers go underneath the GL rendered primary plane, so a plane which
+ * cannot get a lower zpos than the primary's highest is no use:
+ */
+static int plane_can_underlay(const struct drm *drm, const struct plane *plane)
+{
+	uint64_t min, max, primary_min, primary_max;
+
+	/* no zpos on either plane is up to the driver to decide: */
+	if (!plane->zpos || !drm->plane->zpos)
+		return 1;
+
+	plane_zpos_range(plane, &min, &max);
+	plane_zpos_range(drm->plane, &primary_min, &primary_max);
+
+	return min < primary_max;
 }
 
-static int add_plane_property(const struct drm *drm, drmModeAtomicReq *req, uint32_t obj_id,
-				const char *name, uint64_t value)
+static int plane_assigned(const struct layer *layers, unsigned int count,
+		const struct plane *plane)
 {
-	struct plane *obj = drm->plane;
 	unsigned int i;
-	int prop_id = -1;
 
-	for (i = 0 ; i < obj->props->count_props ; i++) {
-		if (strcmp(obj->props_info[i]->name, name) == 0) {
-			prop_id = obj->props_info[i]->prop_id;
-			break;
-		}
+	for (i = 0; i < count; i++)
+		if (layers[i].plane == plane)
+			return 1;
+
+	return 0;
+}
+
+/* Find a free plane (not the primary, not a cursor) which can scan out
+ * the given buffer layout underneath the primary plane.
+ */
+static struct plane * find_free_plane(const struct drm *drm,
+		const struct layer *layers, unsigned int count,
+		uint32_t format, uint64_t modifier)
+{
+	unsigned int i;
+
+	for (i = 0; i < drm->count_planes; i++) {
+		struct plane *plane = &drm->planes[i];
+
+		if (plane == drm->plane || plane->type == DRM_PLANE_TYPE_CURSOR)
+			continue;
+		if (plane_assigned(layers, count, plane))
+			continue;
+		if (!plane_supports(plane, format, modifier))
+			continue;
+		if (!plane_can_underlay(drm, plane))
+			continue;
+
+		return plane;
 	}
 
+	return NULL;
+}
 
-	if (prop_id < 0) {
-		printf("no plane property: %s\n", name);
-		return -EINVAL;
+struct plane * drm_find_plane(const struct drm *drm, uint32_t format, uint64_t modifier)
+{
+	return find_free_plane(drm, NULL, 0, format, modifier);
+}
+
+static int same_placement(const struct layer *a, const struct layer *b)
+{
+	return a->src_w == b->src_w && a->src_h == b->src_h &&
+		a->crtc_x == b->crtc_x && a->crtc_y == b->crtc_y &&
+		a->crtc_w == b->crtc_w && a->crtc_h == b->crtc_h;
+}
+
+static void add_layer_properties(const struct drm *drm, drmModeAtomicReq *req,
+				const struct layer *layer)
+{
+	const struct plane *plane = layer->plane;
+
+	add_plane_property(plane, req, PLANE_FB_ID, layer->fb_id);
+
+	/* the rest is still there from the last commit: */
+	if (plane->active && same_placement(&plane->state, layer))
+		return;
+
+	add_plane_property(plane, req, PLANE_CRTC_ID, drm->crtc_id);
+	add_plane_property(plane, req, PLANE_SRC_X, 0);
+	add_plane_property(plane, req, PLANE_SRC_Y, 0);
+	add_plane_property(plane, req, PLANE_SRC_W, layer->src_w << 16);
+	add_plane_property(plane, req, PLANE_SRC_H, layer->src_h << 16);
+	add_plane_property(plane, req, PLANE_CRTC_X, layer->crtc_x);
+	add_plane_property(plane, req, PLANE_CRTC_Y, layer->crtc_y);
+	add_plane_property(plane, req, PLANE_CRTC_W, layer->crtc_w);
+	add_plane_property(plane, req, PLANE_CRTC_H, layer->crtc_h);
+}
+
+/* Stack the layers bottom first, with the primary plane on top, for the
+ * planes which let us set zpos.  The rest keep whatever the driver gave
+ * them (find_free_plane() already skipped any that would end up on top).
+ */
+static void add_zpos_properties(const struct drm *drm, drmModeAtomicReq *req,
+				const struct layer *layers, unsigned int count)
+{
+	uint64_t zpos = 0, z;
+	unsigned int i;
+
+	for (i = 0; i < count; i++) {
+		const struct plane *plane = layers[i].plane;
+
+		if (!plane)
+			continue;
+
+		z = zpos;
+		if (get_plane_zpos(plane, &z)) {
+			if (z > zpos)
+				zpos = z;
+		} else {
+			if (zpos < plane->zpos->values[0])
+				zpos = plane->zpos->values[0];
+			add_plane_property(plane, req, PLANE_ZPOS, zpos);
+		}
+		zpos++;
 	}
 
-	return drmModeAtomicAddProperty(req, obj_id, prop_id, value);
+	if (get_plane_zpos(drm->plane, &z) == 0 && zpos <= drm->plane->zpos->values[1]) {
+		if (zpos < drm->plane->zpos->values[0])
+			zpos = drm->plane->zpos->values[0];
+		add_plane_property(drm->plane, req, PLANE_ZPOS, zpos);
+	}
 }
 
-static int drm_atomic_commit(struct drm *drm, int drm_fd, uint32_t fb_id, uint32_t flags)
+/*
+ * Commit the GL rendered fb on the primary plane, plus every layer which
+ * has a plane assigned, in one atomic request.  Planes which were shown
+ * by the previous commit but have no layer this time get turned off.
+ * 'damage', if not NULL, is what changed in the GL rendering since the
+ * fb before, for the driver to only update that much.
+ */
+static int drm_atomic_commit(struct drm *drm, int drm_fd, uint32_t fb_id,
+		const struct drm_mode_rect *damage,
+		const struct layer *layers, unsigned int count, uint32_t flags)
 {
+	struct layer primary = {
+		.fb_id = fb_id,
+		.src_w = drm->mode->hdisplay,
+		.src_h = drm->mode->vdisplay,
+		.crtc_w = drm->mode->hdisplay,
+		.crtc_h = drm->mode->vdisplay,
+		.plane = drm->plane,
+	};
 	drmModeAtomicReq *req;
-	uint32_t plane_id = drm->plane->plane->plane_id;
-	uint32_t blob_id;
+	uint32_t damage_blob = 0;
+	unsigned int i;
 	int ret;
 
 	req = drmModeAtomicAlloc();
 
 	if (flags & DRM_MODE_ATOMIC_ALLOW_MODESET) {
-		if (add_connector_property(drm, req, drm->connector_id, "CRTC_ID",
-						drm->crtc_id) < 0)
+		if (add_connector_property(drm, req, CONNECTOR_CRTC_ID, drm->crtc_id) < 0)
 				return -1;
 
-		if (drmModeCreatePropertyBlob(drm_fd, drm->mode, sizeof(*drm->mode),
-					      &blob_id) != 0)
+		if (add_crtc_property(drm, req, CRTC_MODE_ID, drm->mode_blob_id) < 0)
 			return -1;
 
-		if (add_crtc_property(drm, req, drm->crtc_id, "MODE_ID", blob_id) < 0)
-			return -1;
-
-		if (add_crtc_property(drm, req, drm->crtc_id, "ACTIVE", 1) < 0)
+		if (add_crtc_property(drm, req, CRTC_ACTIVE, 1) < 0)
 			return -1;
 	}
 
-	add_plane_property(drm, req, plane_id, "FB_ID", fb_id);
-	add_plane_property(drm, req, plane_id, "CRTC_ID", drm->crtc_id);
-	add_plane_property(drm, req, plane_id, "SRC_X", 0);
-	add_plane_property(drm, req, plane_id, "SRC_Y", 0);
-	add_plane_property(drm, req, plane_id, "SRC_W", drm->mode->hdisplay << 16);
-	add_plane_property(drm, req, plane_id, "SRC_H", drm->mode->vdisplay << 16);
-	add_plane_property(drm, req, plane_id, "CRTC_X", 0);
-	add_plane_property(drm, req, plane_id, "CRTC_Y", 0);
-	add_plane_property(drm, req, plane_id, "CRTC_W", drm->mode->hdisplay);
-	add_plane_property(drm, req, plane_id, "CRTC_H", drm->mode->vdisplay);
+	add_layer_properties(drm, req, &primary);
 
-	if (drm->kms_in_fence_fd != -1) {
-		add_crtc_property(drm, req, drm->crtc_id, "OUT_FENCE_PTR",
+	if (damage && drm->plane->prop_id[PLANE_FB_DAMAGE_CLIPS] &&
+	    !drmModeCreatePropertyBlob(drm_fd, damage, sizeof(*damage), &damage_blob))
+		add_plane_property(drm->plane, req, PLANE_FB_DAMAGE_CLIPS, damage_blob);
+
+	for (i = 0; i < count; i++)
+		if (layers[i].plane)
+			add_layer_properties(drm, req, &layers[i]);
+
+	if (count)
+		add_zpos_properties(drm, req, layers, count);
+
+	for (i = 0; i < drm->count_planes; i++) {
+		struct plane *p = &drm->planes[i];
+
+		if (p == drm->plane || !p->active || plane_assigned(layers, count, p))
+			continue;
+
+		add_plane_property(p, req, PLANE_FB_ID, 0);
+		add_plane_property(p, req, PLANE_CRTC_ID, 0);
+	}
+
+	if (drm->kms_in_fence_fd != -1 && !(flags & DRM_MODE_ATOMIC_TEST_ONLY)) {
+		add_crtc_property(drm, req, CRTC_OUT_FENCE_PTR,
 				VOID2U64(&drm->kms_out_fence_fd));
-		add_plane_property(drm, req, plane_id, "IN_FENCE_FD", drm->kms_in_fence_fd);
+		add_plane_property(drm->plane, req, PLANE_IN_FENCE_FD, drm->kms_in_fence_fd);
 	}
 
-	ret = drmModeAtomicCommit(drm_fd, req, flags, NULL);
-	if (ret)
+	ret = drmModeAtomicCommit(drm_fd, req, flags, drm);
+	if (ret || (flags & DRM_MODE_ATOMIC_TEST_ONLY))
 		goto out;
 
+	for (i = 0; i < drm->count_planes; i++) {
+		struct plane *p = &drm->planes[i];
+
+		if (p != drm->plane)
+			p->active = plane_assigned(layers, count, p);
+	}
+
+	for (i = 0; i < count; i++)
+		if (layers[i].plane)
+			layers[i].plane->state = layers[i];
+
+	drm->plane->state = primary;
+	drm->plane->active = 1;
+
 	if (drm->kms_in_fence_fd != -1) {
 		close(drm->kms_in_fence_fd);
 		drm->kms_in_fence_fd = -1;
@@ -153,10 +478,50 @@ static int drm_atomic_commit(struct drm *drm, int drm_fd, uint32_t fb_id, uint32
 
 out:
 	drmModeAtomicFree(req);
+	if (damage_blob)
+		drmModeDestroyPropertyBlob(drm_fd, damage_blob);
 
 	return ret;
 }
 
+/*
+ * Give each layer a plane, and check with a TEST_ONLY commit that the
+ * display can actually show the whole set together with the primary
+ * plane.  Until it can, the topmost layer which still has a plane is
+ * dropped back to GPU composition.  Returns the number of layers which
+ * ended up on a plane.
+ */
+static unsigned int drm_atomic_assign_planes(struct drm *drm, uint32_t fb_id,
+		struct layer *layers, unsigned int count, uint32_t flags)
+{
+	unsigned int i, assigned = 0;
+
+	for (i = 0; i < count; i++)
+		layers[i].plane = NULL;
+
+	for (i = 0; i < count; i++) {
+		layers[i].plane = find_free_plane(drm, layers, count,
+				layers[i].format, layers[i].modifier);
+		if (layers[i].plane)
+			assigned++;
+	}
+
+	flags &= ~(DRM_MODE_ATOMIC_NONBLOCK | DRM_MODE_PAGE_FLIP_EVENT);
+	flags |= DRM_MODE_ATOMIC_TEST_ONLY;
+
+	while (assigned && drm_atomic_commit(drm, drm->fd, fb_id, NULL, layers, count, flags)) {
+		for (i = count; i-- > 0; ) {
+			if (layers[i].plane) {
+				layers[i].plane = NULL;
+				assigned--;
+				break;
+			}
+		}
+	}
+
+	return assigned;
+}
+
 static EGLSyncKHR create_fence(const struct egl *egl, int fd)
 {
 	EGLint attrib_list[] = {
@@ -169,124 +534,310 @@ static EGLSyncKHR create_fence(const struct egl *egl, int fd)
 	return fence;
 }
 
+static void page_flip_handler(int fd, unsigned int frame,
+		  unsigned int sec, unsigned int usec, void *data)
+{
+	/* suppress 'unused parameter' warnings */
+	(void)fd;
+
+	struct drm *drm = data;
+
+	stats_flip(frame, sec, usec);
+	pacing_flip(&drm->pacing, frame, sec, usec);
+}
+
+/* The commits ask for a flip event, for the vblank sequence and
+ * timestamp.  Pick it up without blocking once the flip is known to have
+ * completed, so they don't pile up:
+ */
+static void handle_flip_events(struct drm *drm)
+{
+	drmEventContext evctx = {
+			.version = 2,
+			.page_flip_handler = page_flip_handler,
+	};
+	struct pollfd pfd = { .fd = drm->fd, .events = POLLIN };
+
+	while (poll(&pfd, 1, 0) > 0)
+		drmHandleEvent(drm->fd, &evctx);
+}
+
+/* Render the next frame and queue it in the swap chain, along with a
+ * fence for KMS to wait on until the GPU is done with it:
+ */
+static struct swap_buffer * render_frame(struct egl *egl, struct swapchain *sc,
+		float frame)
+{
+	EGLSyncKHR gpu_fence;   /* out-fence from gpu, in-fence to kms */
+	struct swap_buffer *buf;
+	uint64_t t;
+	int fence_fd;
+
+	egl_wait_render_ahead(egl);
+
+	t = stats_now();
+	egl_draw(egl, frame);
+	t = stats_record(STATS_DRAW, t);
+
+	/* insert fence to be singled in cmdstream.. this fence will be
+	 * signaled when gpu rendering done
+	 */
+	gpu_fence = create_fence(egl, EGL_NO_NATIVE_FENCE_FD_ANDROID);
+	assert(gpu_fence);
+
+	egl_swap(egl);
+	t = stats_record(STATS_SWAP, t);
+
+	/* after swapbuffers, gpu_fence should be flushed, so safe
+	 * to get fd:
+	 */
+	fence_fd = egl->eglDupNativeFenceFDANDROID(egl->display, gpu_fence);
+	egl->eglDestroySyncKHR(egl->display, gpu_fence);
+	assert(fence_fd != -1);
+	t = stats_record(STATS_FENCE, t);
+
+	buf = swapchain_queue(sc, fence_fd);
+	if (!buf) {
+		close(fence_fd);
+		return NULL;
+	}
+
+	/* KMS counts rows from the top, GL from the bottom: */
+	buf->damage.x1 = egl->swap_damage.x;
+	buf->damage.x2 = egl->swap_damage.x + egl->swap_damage.width;
+	buf->damage.y1 = egl->height - (egl->swap_damage.y + egl->swap_damage.height);
+	buf->damage.y2 = egl->height - egl->swap_damage.y;
+	stats_record(STATS_LOCK, t);
+
+	return buf;
+}
+
+struct flip_wait {
+	struct drm *drm;
+	struct swapchain *sc;
+	struct event_loop *loop;
+};
+
+/* The commit's out-fence signals once the flip completed: */
+static int out_fence_event(void *data, uint32_t events)
+{
+	struct flip_wait *w = data;
+	struct drm *drm = w->drm;
+
+	(void)events;
+
+	event_loop_remove(w->loop, drm->kms_out_fence_fd);
+	close(drm->kms_out_fence_fd);
+	drm->kms_out_fence_fd = -1;
+	swapchain_flipped(w->sc);
+	handle_flip_events(drm);
+
+	return 0;
+}
+
+/* Dispatch events until the pending flip completed, or just those
+ * already there if 'block' isn't set.  Returns > 0 if we are to exit:
+ */
+static int wait_flip(struct flip_wait *w, int block)
+{
+	uint64_t t = stats_now();
+	int ret;
+
+	do {
+		ret = event_loop_dispatch(w->loop, block ? -1 : 0);
+	} while (!ret && block && w->sc->pending);
+
+	if (!ret && block)
+		stats_record(STATS_WAIT, t);
+
+	return ret;
+}
+
 static int atomic_run(struct drm *drm, const struct gbm *gbm, struct egl *egl)
 {
-	struct gbm_bo *bo = NULL;
-	struct drm_fb *fb;
+	struct swapchain sc;
+	struct swap_buffer *buf;
+	/* the video frame to scan out with each swap chain buffer: */
+	struct dmabuf_frame video[MAX_SWAP_DEPTH];
+	int has_video[MAX_SWAP_DEPTH] = {0};
+	struct layer video_layer = {0};
+	struct flip_wait w;
 	uint32_t i = 0;
 	uint32_t flags = DRM_MODE_ATOMIC_NONBLOCK;
 	int ret;
 
+	/* nothing else may touch KMS while the early modeset runs: */
+	drm_early_modeset_finish(drm);
+
 	if (egl_check(egl, eglDupNativeFenceFDANDROID) ||
 	    egl_check(egl, eglCreateSyncKHR) ||
-	    egl_check(egl, eglDestroySyncKHR) ||
-	    egl_check(egl, eglWaitSyncKHR) ||
-	    egl_check(egl, eglClientWaitSyncKHR))
+	    egl_check(egl, eglDestroySyncKHR))
 		return -1;
 
 	/* Allow a modeset change for the first commit only. */
 	flags |= DRM_MODE_ATOMIC_ALLOW_MODESET;
 
-	while (1) {
-		struct gbm_bo *next_bo;
-		EGLSyncKHR gpu_fence = NULL;   /* out-fence from gpu, in-fence to kms */
-		EGLSyncKHR kms_fence = NULL;   /* in-fence to gpu, out-fence from kms */
+	/* for the stats and pacing: */
+	flags |= DRM_MODE_PAGE_FLIP_EVENT;
 
-		if (drm->kms_out_fence_fd != -1) {
-			kms_fence = create_fence(egl, drm->kms_out_fence_fd);
-			assert(kms_fence);
+	swapchain_init(&sc, drm->fd, gbm->surface, drm->swap_depth);
+	pacing_init(&drm->pacing, drm_mode_period(drm->mode), drm->low_latency);
 
-			/* driver now has ownership of the fence fd: */
-			drm->kms_out_fence_fd = -1;
-
-			/* wait "on the gpu" (ie. this won't necessarily block, but
-			 * will block the rendering until fence is signaled), until
-			 * the previous pageflip completes so we don't render into
-			 * the buffer that is still on screen.
+	w.loop = drm_event_loop_create(drm);
+	if (!w.loop)
+		return -1;
+	w.drm = drm;
+	w.sc = &sc;
+
+	while (!drm->frames || i < drm->frames) {
+		const struct dmabuf_frame *scanout;
+		unsigned int nlayers = 0, n;
+		uint64_t t;
+
+		/* render ahead for as long as the swap chain has room: */
+		if (swapchain_can_render(&sc)) {
+			float frame;
+
+			ret = pacing_begin(&drm->pacing, w.loop, &frame);
+			if (ret < 0)
+				goto fail;
+			else if (ret)
+				break;
+
+			buf = render_frame(egl, &sc, frame);
+			if (!buf)
+				goto fail;
+			pacing_end(&drm->pacing);
+			i++;
+
+			/*
+			 * Scenes which scan out video underneath the GL
+			 * rendering hand us the frame that goes with the
+			 * draw, to put on a plane of its own:
 			 */
-			egl->eglWaitSyncKHR(egl->display, kms_fence, 0);
+			n = buf - sc.buffers;
+			scanout = egl->scanout ? egl->scanout(egl) : NULL;
+			has_video[n] = scanout != NULL;
+			if (scanout)
+				video[n] = *scanout;
 		}
 
-		egl->draw(egl, i++);
+		/* only block for the flip when there is nothing to render: */
+		ret = wait_flip(&w, sc.pending && !swapchain_can_render(&sc));
+		if (ret < 0)
+			goto fail;
+		else if (ret)
+			break;
 
-		/* insert fence to be singled in cmdstream.. this fence will be
-		 * signaled when gpu rendering done
-		 */
-		gpu_fence = create_fence(egl, EGL_NO_NATIVE_FENCE_FD_ANDROID);
-		assert(gpu_fence);
+		/* flip to the oldest frame once the last flip is done: */
+		if (sc.pending || !(buf = swapchain_next(&sc)))
+			continue;
 
-		eglSwapBuffers(egl->display, egl->surface);
+		n = buf - sc.buffers;
+		scanout = (egl->scanout && has_video[n]) ? &video[n] : NULL;
 
-		/* after swapbuffers, gpu_fence should be flushed, so safe
-		 * to get fd:
+		/*
+		 * Whenever the display cannot take the video frame, as no fb
+		 * can be made of it or (checked when the layout changes) no
+		 * plane scans it out, have the scene composite it with GL
+		 * instead:
 		 */
-		drm->kms_in_fence_fd = egl->eglDupNativeFenceFDANDROID(egl->display, gpu_fence);
-		egl->eglDestroySyncKHR(egl->display, gpu_fence);
-		assert(drm->kms_in_fence_fd != -1);
-
-		next_bo = gbm_surface_lock_front_buffer(gbm->surface);
-		if (!next_bo) {
-			printf("Failed to lock frontbuffer\n");
-			return -1;
+		if (scanout && fb_cache_get(&drm->fb_cache, scanout, &video_layer.fb_id)) {
+			printf("cannot create video fb, falling back to GL composition\n");
+			egl->scanout = NULL;
+			scanout = NULL;
 		}
-		fb = drm_fb_get_from_bo(next_bo);
-		if (!fb) {
-			printf("Failed to get a new framebuffer BO\n");
-			return -1;
+
+		if (scanout) {
+			int changed = !video_layer.plane ||
+					video_layer.format != scanout->format ||
+					video_layer.modifier != scanout->modifier ||
+					video_layer.src_w != scanout->width ||
+					video_layer.src_h != scanout->height;
+
+			video_layer.format = scanout->format;
+			video_layer.modifier = scanout->modifier;
+			video_layer.src_w = scanout->width;
+			video_layer.src_h = scanout->height;
+			video_layer.crtc_w = drm->mode->hdisplay;
+			video_layer.crtc_h = drm->mode->vdisplay;
+			nlayers = 1;
+
+			if (changed && !drm_atomic_assign_planes(drm, buf->fb->fb_id,
+						&video_layer, 1, flags)) {
+				printf("video plane rejected, falling back to GL composition\n");
+				egl->scanout = NULL;
+				scanout = NULL;
+				nlayers = 0;
+			} else if (changed) {
+				printf("scanning out video on plane %u\n",
+						video_layer.plane->plane->plane_id);
+			}
 		}
 
-		if (kms_fence) {
-			EGLint status;
+		/* the first flip has landed, so the early modeset's fb is off screen: */
+		if (!(flags & DRM_MODE_ATOMIC_ALLOW_MODESET))
+			drm_early_modeset_release(drm);
 
-			/* Wait on the CPU side for the _previous_ commit to
-			 * complete before we post the flip through KMS, as
-			 * atomic will reject the commit if we post a new one
-			 * whilst the previous one is still pending.
-			 */
-			do {
-				status = egl->eglClientWaitSyncKHR(egl->display,
-						kms_fence,
-						0,
-						EGL_FOREVER_KHR);
-			} while (status != EGL_CONDITION_SATISFIED_KHR);
-
-			egl->eglDestroySyncKHR(egl->display, kms_fence);
-		}
+		/* the commit takes over the fence fd: */
+		drm->kms_in_fence_fd = buf->fence_fd;
+		buf->fence_fd = -1;
 
-		/*
-		 * Here you could also update drm plane layers if you want
-		 * hw composition
-		 */
-		ret = drm_atomic_commit(drm, drm->fd, fb->fb_id, flags);
+		t = stats_now();
+		/* the modeset commit shows the whole fb, so no damage for it: */
+		ret = drm_atomic_commit(drm, drm->fd, buf->fb->fb_id,
+				(flags & DRM_MODE_ATOMIC_ALLOW_MODESET) ? NULL : &buf->damage,
+				&video_layer, nlayers, flags);
 		if (ret) {
 			printf("failed to commit: %s\n", strerror(errno));
-			return -1;
+			goto fail;
 		}
+		stats_record(STATS_COMMIT, t);
+		swapchain_commit(&sc, buf);
 
-		/* release last buffer to render on again: */
-		if (bo)
-			gbm_surface_release_buffer(gbm->surface, bo);
-		bo = next_bo;
+		if (event_loop_add(w.loop, drm->kms_out_fence_fd, EPOLLIN,
+				out_fence_event, &w))
+			goto fail;
 
 		/* Allow a modeset change for the first commit only. */
 		flags &= ~(DRM_MODE_ATOMIC_ALLOW_MODESET);
 	}
 
-	return ret;
+	/* let the last flip land before handing the buffers back: */
+	if (sc.pending) {
+		struct pollfd pfd = { .fd = drm->kms_out_fence_fd, .events = POLLIN };
+
+		while (poll(&pfd, 1, -1) < 0 && errno == EINTR)
+			;
+		out_fence_event(&w, pfd.revents);
+	}
+	swapchain_release_queued(&sc);
+	drm_early_modeset_release(drm);
+	event_loop_destroy(w.loop);
+
+	return 0;
+
+fail:
+	drm_early_modeset_release(drm);
+	event_loop_destroy(w.loop);
+	return -1;
 }
 
-/* Pick a plane.. something that at a minimum can be connected to
- * the chosen crtc, but prefer primary plane.
- *
- * Seems like there is some room for a drmModeObjectGetNamedProperty()
- * type helper in libdrm->.
+/* Would the primary plane take the fb, along with the modeset: */
+static int atomic_test_fb(struct drm *drm, uint32_t fb_id)
+{
+	return drm_atomic_commit(drm, drm->fd, fb_id, NULL, NULL, 0,
+			DRM_MODE_ATOMIC_TEST_ONLY | DRM_MODE_ATOMIC_ALLOW_MODESET);
+}
+
+/* Collect every plane which can be connected to the chosen crtc.  The
+ * primary plane is used for the GL rendering, the others are handed out
+ * to layers by drm_atomic_assign_planes().
  */
-static int get_plane_id(struct drm *drm, int drm_fd)
+static int get_planes(struct drm *drm, int drm_fd)
 {
 	drmModePlaneResPtr plane_resources;
-	uint32_t i, j;
-	int ret = -EINVAL;
-	int found_primary = 0;
+	uint32_t i;
 
 	plane_resources = drmModeGetPlaneResources(drm_fd);
 	if (!plane_resources) {
@@ -294,7 +845,9 @@ static int get_plane_id(struct drm *drm, int drm_fd)
 		return -1;
 	}
 
-	for (i = 0; (i < plane_resources->count_planes) && !found_primary; i++) {
+	drm->planes = calloc(plane_resources->count_planes, sizeof(*drm->planes));
+
+	for (i = 0; i < plane_resources->count_planes; i++) {
 		uint32_t id = plane_resources->planes[i];
 		drmModePlanePtr plane = drmModeGetPlane(drm_fd, id);
 		if (!plane) {
@@ -302,45 +855,27 @@ static int get_plane_id(struct drm *drm, int drm_fd)
 			continue;
 		}
 
-		if (plane->possible_crtcs & (1 << drm->crtc_index)) {
-			drmModeObjectPropertiesPtr props =
-				drmModeObjectGetProperties(drm_fd, id, DRM_MODE_OBJECT_PLANE);
-
-			/* primary or not, this plane is good enough to use: */
-			ret = id;
-
-			for (j = 0; j < props->count_props; j++) {
-				drmModePropertyPtr p =
-					drmModeGetProperty(drm_fd, props->props[j]);
-
-				if ((strcmp(p->name, "type") == 0) &&
-						(props->prop_values[j] == DRM_PLANE_TYPE_PRIMARY)) {
-					/* found our primary plane, lets use that: */
-					found_primary = 1;
-				}
-
-				drmModeFreeProperty(p);
-			}
-
-			drmModeFreeObjectProperties(props);
+		if (!(plane->possible_crtcs & (1 << drm->crtc_index))) {
+			drmModeFreePlane(plane);
+			continue;
 		}
 
-		drmModeFreePlane(plane);
+		drm->planes[drm->count_planes++].plane = plane;
 	}
 
 	drmModeFreePlaneResources(plane_resources);
 
-	return ret;
+	return drm->count_planes ? 0 : -1;
 }
 
-struct drm * init_drm_atomic(int drm_fd, int leased_fd)
+struct drm * init_drm_atomic(int drm_fd)
 {
-	uint32_t plane_id;
+	unsigned int i;
 	int ret;
 
 	struct drm *drm = calloc(1, sizeof(*drm));
 
-	ret = init_drm(drm, drm_fd, leased_fd);
+	ret = init_drm(drm, drm_fd);
 	if (ret)
 		return NULL;
 
@@ -350,58 +885,83 @@ struct drm * init_drm_atomic(int drm_fd, int leased_fd)
 		return NULL;
 	}
 
-	ret = get_plane_id(drm, drm_fd);
-	if (!ret) {
+	ret = get_planes(drm, drm_fd);
+	if (ret) {
 		printf("could not find a suitable plane\n");
 		return NULL;
-	} else {
-		plane_id = ret;
 	}
 
-	/* We only do single plane to single crtc to single connector, no
-	 * fancy multi-monitor or multi-plane stuff.  So just grab the
-	 * plane/crtc/connector property info for one of each:
+	/* Single crtc to single connector, but every plane of the crtc
+	 * is available for the scene to put layers on.  Grab the
+	 * plane/crtc/connector property info for all of them:
 	 */
-	drm->plane = calloc(1, sizeof(*drm->plane));
 	drm->crtc = calloc(1, sizeof(*drm->crtc));
 	drm->connector = calloc(1, sizeof(*drm->connector));
 
-#define get_resource(type, Type, id) do { 					\
-		drm->type->type = drmModeGet##Type(drm_fd, id);		\
-		if (!drm->type->type) {								\
+#define get_resource(obj, type, Type, id) do { 				\
+		(obj)->type = drmModeGet##Type(drm_fd, id);			\
+		if (!(obj)->type) {									\
 			printf("could not get %s %i: %s\n",				\
 					#type, id, strerror(errno));			\
 			return NULL;									\
 		}													\
 	} while (0)
 
-	get_resource(plane, Plane, plane_id);
-	get_resource(crtc, Crtc, drm->crtc_id);
-	get_resource(connector, Connector, drm->connector_id);
+	get_resource(drm->crtc, crtc, Crtc, drm->crtc_id);
+	get_resource(drm->connector, connector, Connector, drm->connector_id);
 
-#define get_properties(type, TYPE, id) do {						\
+#define get_properties(obj, type, TYPE, id) do {					\
 		uint32_t i;												\
-		drm->type->props = drmModeObjectGetProperties(drm_fd,	\
+		(obj)->props = drmModeObjectGetProperties(drm_fd,		\
 				id, DRM_MODE_OBJECT_##TYPE);					\
-		if (!drm->type->props) {									\
+		if (!(obj)->props) {										\
 			printf("could not get %s %u properties: %s\n",		\
 					#type, id, strerror(errno));				\
 			return NULL;										\
 		}														\
-		drm->type->props_info = calloc(drm->type->props->count_props, \
-				sizeof(drm->type->props_info));					\
-		for (i = 0; i < drm->type->props->count_props; i++) {	\
-			drm->type->props_info[i] = drmModeGetProperty(drm_fd,\
-					drm->type->props->props[i]);					\
+		(obj)->props_info = calloc((obj)->props->count_props,	\
+				sizeof((obj)->props_info));						\
+		for (i = 0; i < (obj)->props->count_props; i++) {		\
+			(obj)->props_info[i] = drmModeGetProperty(drm_fd,	\
+					(obj)->props->props[i]);						\
 		}														\
 	} while (0)
 
+	for (i = 0; i < drm->count_planes; i++) {
+		struct plane *plane = &drm->planes[i];
+
+		get_properties(plane, plane, PLANE, plane->plane->plane_id);
+		get_prop_ids(plane->props, plane->props_info, plane_prop_names,
+				PLANE_PROP_COUNT, plane->prop_id);
+		plane->type = get_plane_type(plane);
+		get_plane_zpos_info(plane);
+		get_plane_formats(drm_fd, plane);
 
-	get_properties(plane, PLANE, plane_id);
-	get_properties(crtc, CRTC, drm->crtc_id);
-	get_properties(connector, CONNECTOR, drm->connector_id);
+		/* primary or not, any plane is good enough to render on,
+		 * but prefer the primary plane:
+		 */
+		if (!drm->plane || (plane->type == DRM_PLANE_TYPE_PRIMARY &&
+				drm->plane->type != DRM_PLANE_TYPE_PRIMARY))
+			drm->plane = plane;
+	}
+
+	get_properties(drm->crtc, crtc, CRTC, drm->crtc_id);
+	get_properties(drm->connector, connector, CONNECTOR, drm->connector_id);
+	get_prop_ids(drm->crtc->props, drm->crtc->props_info, crtc_prop_names,
+			CRTC_PROP_COUNT, drm->crtc->prop_id);
+	get_prop_ids(drm->connector->props, drm->connector->props_info,
+			connector_prop_names, CONNECTOR_PROP_COUNT, drm->connector->prop_id);
 	drm->kms_out_fence_fd = -1;
 
+	if (drmModeCreatePropertyBlob(drm_fd, drm->mode, sizeof(*drm->mode),
+				&drm->mode_blob_id) != 0) {
+		printf("could not create mode blob: %s\n", strerror(errno));
+		return NULL;
+	}
+
+	fb_cache_init(&drm->fb_cache, drm_fd);
+
+	drm->test_fb = atomic_test_fb;
 	drm->run = atomic_run;
 
 	return drm;
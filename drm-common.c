@@ -26,48 +26,36 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <unistd.h>
 
 #include "common.h"
 #include "drm-common.h"
-
-static int leased(int fd, int nfd, int id)
-{
-	if (fd != nfd && nfd != -1) {
-		drmModeObjectListPtr lease = drmModeGetLease(nfd);
-		int ret = 0;
-
-		if (lease) {
-			uint32_t u;
-			for (u = 0; u < lease->count; u++)
-				if (lease->objects[u] == (uint32_t) id) {
-					ret = 1;
-					break;
-				}
-			free(lease);
-			return ret;
-		}
-	}
-
-	return 0;
-}
+#include "event-loop.h"
+#include "stats.h"
 
 static void
 drm_fb_destroy_callback(struct gbm_bo *bo, void *data)
 {
-	int drm_fd = gbm_device_get_fd(gbm_bo_get_device(bo));
 	struct drm_fb *fb = data;
 
+	(void)bo;
+
 	if (fb->fb_id)
-		drmModeRmFB(drm_fd, fb->fb_id);
+		drmModeRmFB(fb->fd, fb->fb_id);
 
 	free(fb);
 }
 
-struct drm_fb * drm_fb_get_from_bo(struct gbm_bo *bo)
+/* The fb for a bo, added to drm_fd.  That can be another device fd
+ * than the bo was allocated from (such as a lease, with the buffers
+ * coming from a gbm device shared between outputs), then the bo is
+ * imported through its dmabuf.
+ */
+struct drm_fb * drm_fb_get_from_bo(struct gbm_bo *bo, int drm_fd)
 {
-	int drm_fd = gbm_device_get_fd(gbm_bo_get_device(bo));
+	int bo_fd = gbm_device_get_fd(gbm_bo_get_device(bo));
 	struct drm_fb *fb = gbm_bo_get_user_data(bo);
-	uint32_t width, height,
+	uint32_t width, height, format, handle,
 		 strides[4] = {0}, handles[4] = {0},
 		 offsets[4] = {0}, flags = 0;
 	int ret = -1;
@@ -75,11 +63,26 @@ struct drm_fb * drm_fb_get_from_bo(struct gbm_bo *bo)
 	if (fb)
 		return fb;
 
+	handle = gbm_bo_get_handle(bo).u32;
+	if (bo_fd != drm_fd) {
+		int prime_fd = gbm_bo_get_fd(bo);
+
+		ret = drmPrimeFDToHandle(drm_fd, prime_fd, &handle);
+		close(prime_fd);
+		if (ret) {
+			printf("failed to import bo: %s\n", strerror(errno));
+			return NULL;
+		}
+		ret = -1;
+	}
+
 	fb = calloc(1, sizeof *fb);
 	fb->bo = bo;
+	fb->fd = drm_fd;
 
 	width = gbm_bo_get_width(bo);
 	height = gbm_bo_get_height(bo);
+	format = gbm_bo_get_format(bo);
 
 #ifdef HAVE_GBM_MODIFIERS
 	uint64_t modifiers[4] = {0};
@@ -87,37 +90,37 @@ struct drm_fb * drm_fb_get_from_bo(struct gbm_bo *bo)
 	const int num_planes = gbm_bo_get_plane_count(bo);
 	for (int i = 0; i < num_planes; i++) {
 		strides[i] = gbm_bo_get_stride_for_plane(bo, i);
-		handles[i] = gbm_bo_get_handle(bo).u32;
+		handles[i] = handle;
 		offsets[i] = gbm_bo_get_offset(bo, i);
 		modifiers[i] = modifiers[0];
 	}
 
-	if (modifiers[0]) {
+	/* the allocator pads the buffer out to whatever the tiling needs,
+	 * the fb only covers the visible part:
+	 */
+	if (modifiers[0] != DRM_FORMAT_MOD_INVALID && modifiers[0] != DRM_FORMAT_MOD_LINEAR)
 		flags = DRM_MODE_FB_MODIFIERS;
-		printf("Using modifier %lx\n", modifiers[0]);
-	}
-
-	if(modifiers[0] == DRM_FORMAT_MOD_VIVANTE_SUPER_TILED) {
-		if(width%64 || height%64) {
-			fprintf(stderr, "For DRM_FORMAT_MOD_VIVANTE_SUPER_TILED width and height of the surface should be aligned to 64 pixels\n");
-		}
-	}
 
 	ret = drmModeAddFB2WithModifiers(drm_fd, width, height,
-			DRM_FORMAT_XRGB8888, handles, strides, offsets,
+			format, handles, strides, offsets,
 			modifiers, &fb->fb_id, flags);
 #endif
-	if (ret) {
-		if (flags)
-			fprintf(stderr, "Modifiers failed!\n");
-
-		memcpy(handles, (uint32_t [4]){gbm_bo_get_handle(bo).u32,0,0,0}, 16);
+	/* a tiled layout can't be described without the modifier: */
+	if (ret && !flags) {
+		memcpy(handles, (uint32_t [4]){handle,0,0,0}, 16);
 		memcpy(strides, (uint32_t [4]){gbm_bo_get_stride(bo),0,0,0}, 16);
 		memset(offsets, 0, 16);
-		ret = drmModeAddFB2(drm_fd, width, height, DRM_FORMAT_XRGB8888,
+		ret = drmModeAddFB2(drm_fd, width, height, format,
 				handles, strides, offsets, &fb->fb_id, 0);
 	}
 
+	/* the fb holds on to the imported buffer: */
+	if (bo_fd != drm_fd) {
+		struct drm_gem_close req = { .handle = handle };
+
+		drmIoctl(drm_fd, DRM_IOCTL_GEM_CLOSE, &req);
+	}
+
 	if (ret) {
 		printf("failed to create fb: %s\n", strerror(errno));
 		free(fb);
@@ -129,6 +132,196 @@ struct drm_fb * drm_fb_get_from_bo(struct gbm_bo *bo)
 	return fb;
 }
 
+void swapchain_init(struct swapchain *sc, int drm_fd, struct gbm_surface *surface,
+		unsigned depth)
+{
+	unsigned i;
+
+	memset(sc, 0, sizeof(*sc));
+	sc->drm_fd = drm_fd;
+	sc->surface = surface;
+	sc->depth = depth < 2 ? 2 : depth > MAX_SWAP_DEPTH ? MAX_SWAP_DEPTH : depth;
+
+	for (i = 0; i < MAX_SWAP_DEPTH; i++)
+		sc->buffers[i].fence_fd = -1;
+}
+
+/* Is there room to render another frame ahead? */
+int swapchain_can_render(const struct swapchain *sc)
+{
+	return sc->locked < sc->depth && gbm_surface_has_free_buffers(sc->surface);
+}
+
+/* Lock the buffer just swapped to and queue it to be flipped to: */
+struct swap_buffer * swapchain_queue(struct swapchain *sc, int fence_fd)
+{
+	struct swap_buffer *buf = NULL;
+	unsigned i;
+
+	for (i = 0; i < sc->depth && !buf; i++)
+		if (sc->buffers[i].state == BUFFER_FREE)
+			buf = &sc->buffers[i];
+
+	if (!buf) {
+		printf("no free swap chain buffer\n");
+		return NULL;
+	}
+
+	buf->bo = gbm_surface_lock_front_buffer(sc->surface);
+	if (!buf->bo) {
+		printf("Failed to lock frontbuffer\n");
+		return NULL;
+	}
+
+	buf->fb = drm_fb_get_from_bo(buf->bo, sc->drm_fd);
+	if (!buf->fb) {
+		printf("Failed to get a new framebuffer BO\n");
+		gbm_surface_release_buffer(sc->surface, buf->bo);
+		return NULL;
+	}
+
+	buf->state = BUFFER_QUEUED;
+	buf->fence_fd = fence_fd;
+	buf->seq = sc->seq++;
+	sc->locked++;
+
+	return buf;
+}
+
+/* The oldest queued buffer, next in line to be flipped to: */
+struct swap_buffer * swapchain_next(struct swapchain *sc)
+{
+	struct swap_buffer *next = NULL;
+	unsigned i;
+
+	for (i = 0; i < sc->depth; i++) {
+		struct swap_buffer *buf = &sc->buffers[i];
+
+		if (buf->state == BUFFER_QUEUED &&
+				(!next || (int)(buf->seq - next->seq) < 0))
+			next = buf;
+	}
+
+	return next;
+}
+
+void swapchain_commit(struct swapchain *sc, struct swap_buffer *buf)
+{
+	buf->state = BUFFER_PENDING;
+	sc->pending = buf;
+}
+
+/* The pending flip completed, so the buffer which was on screen before
+ * can go back to be rendered into:
+ */
+void swapchain_flipped(struct swapchain *sc)
+{
+	unsigned i;
+
+	for (i = 0; i < sc->depth; i++) {
+		struct swap_buffer *buf = &sc->buffers[i];
+
+		if (buf->state != BUFFER_SCANOUT)
+			continue;
+
+		gbm_surface_release_buffer(sc->surface, buf->bo);
+		buf->state = BUFFER_FREE;
+		buf->bo = NULL;
+		buf->fb = NULL;
+		sc->locked--;
+	}
+
+	if (sc->pending) {
+		sc->pending->state = BUFFER_SCANOUT;
+		sc->pending = NULL;
+	}
+
+	stats_startup_done("first flip");
+}
+
+/* Hand the frames which never got flipped to back to the gbm surface,
+ * when the run loop is done (and no flip is pending anymore):
+ */
+void swapchain_release_queued(struct swapchain *sc)
+{
+	unsigned i;
+
+	for (i = 0; i < sc->depth; i++) {
+		struct swap_buffer *buf = &sc->buffers[i];
+
+		if (buf->state != BUFFER_QUEUED)
+			continue;
+
+		if (buf->fence_fd != -1)
+			close(buf->fence_fd);
+		gbm_surface_release_buffer(sc->surface, buf->bo);
+		buf->state = BUFFER_FREE;
+		buf->fence_fd = -1;
+		buf->bo = NULL;
+		buf->fb = NULL;
+		sc->locked--;
+	}
+}
+
+static int stdin_event(void *data, uint32_t events)
+{
+	(void)data, (void)events;
+
+	printf("user interrupted!\n");
+	return 1;
+}
+
+static int hotplug_event(void *data, uint32_t events)
+{
+	struct drm *drm = data;
+	drmModeConnector *connector;
+	int connected;
+
+	(void)events;
+
+	connector = drmModeGetConnectorCurrent(drm->fd, drm->connector_id);
+	connected = connector && connector->connection == DRM_MODE_CONNECTED;
+	drmModeFreeConnector(connector);
+
+	if (!connected) {
+		printf("connector %u disconnected, exiting\n", drm->connector_id);
+		return 1;
+	}
+
+	return 0;
+}
+
+/* The events every run loop waits on besides its own flips: SIGINT and
+ * SIGTERM, input on stdin (when it is a terminal) and the connector going
+ * away.  New video frames need no wakeup of their own, they are picked up
+ * by the next draw, which the flips pace anyway.
+ */
+struct event_loop * drm_event_loop_create(struct drm *drm)
+{
+	struct event_loop *loop;
+
+	loop = event_loop_create();
+	if (!loop)
+		return NULL;
+
+	if (event_loop_add_signals(loop))
+		goto fail;
+
+	if (isatty(STDIN_FILENO) &&
+			event_loop_add(loop, STDIN_FILENO, EPOLLIN, stdin_event, NULL))
+		goto fail;
+
+	/* not fatal, we just won't notice the display going away: */
+	if (drm->connector_id && event_loop_add_hotplug(loop, hotplug_event, drm))
+		printf("no hotplug events\n");
+
+	return loop;
+
+fail:
+	event_loop_destroy(loop);
+	return NULL;
+}
+
 static uint32_t find_crtc_for_encoder(const drmModeRes *resources,
 		const drmModeEncoder *encoder) {
 	int i;
@@ -148,7 +341,7 @@ static uint32_t find_crtc_for_encoder(const drmModeRes *resources,
 	return -1;
 }
 
-static uint32_t find_crtc_for_connector(int drm_fd, int leased_fd, const drmModeRes *resources,
+static uint32_t find_crtc_for_connector(int drm_fd, const drmModeRes *resources,
 		const drmModeConnector *connector) {
 	int i;
 
@@ -156,7 +349,7 @@ static uint32_t find_crtc_for_connector(int drm_fd, int leased_fd, const drmMode
 		const uint32_t encoder_id = connector->encoders[i];
 		drmModeEncoder *encoder = drmModeGetEncoder(drm_fd, encoder_id);
 
-		if (encoder && !leased(drm_fd, leased_fd, encoder->encoder_id)) {
+		if (encoder) {
 			const uint32_t crtc_id = find_crtc_for_encoder(resources, encoder);
 
 			drmModeFreeEncoder(encoder);
@@ -171,7 +364,103 @@ static uint32_t find_crtc_for_connector(int drm_fd, int leased_fd, const drmMode
 }
 
 
-int init_drm(struct drm *drm, int drm_fd, int leased_fd)
+static void *early_modeset_thread(void *arg)
+{
+	struct drm *drm = arg;
+
+	if (drmModeSetCrtc(drm->fd, drm->crtc_id, drm->modeset_fb, 0, 0,
+			&drm->connector_id, 1, drm->mode))
+		printf("early modeset failed: %s\n", strerror(errno));
+
+	stats_startup("modeset");
+
+	return NULL;
+}
+
+int drm_early_modeset(struct drm *drm)
+{
+	struct drm_mode_create_dumb create = {
+		.width = drm->mode->hdisplay,
+		.height = drm->mode->vdisplay,
+		.bpp = 32,
+	};
+	uint32_t handles[4] = {0}, pitches[4] = {0}, offsets[4] = {0};
+	int ret;
+
+	/* the legacy modeset only covers the primary plane: */
+	if (drm->plane && drm->plane->type != DRM_PLANE_TYPE_PRIMARY)
+		return 0;
+
+	if (drmIoctl(drm->fd, DRM_IOCTL_MODE_CREATE_DUMB, &create)) {
+		printf("failed to create dumb buffer: %s\n", strerror(errno));
+		return -1;
+	}
+	drm->modeset_handle = create.handle;
+
+	handles[0] = create.handle;
+	pitches[0] = create.pitch;
+	if (drmModeAddFB2(drm->fd, create.width, create.height, DRM_FORMAT_XRGB8888,
+			handles, pitches, offsets, &drm->modeset_fb, 0)) {
+		printf("failed to create dumb fb: %s\n", strerror(errno));
+		drm_early_modeset_release(drm);
+		return -1;
+	}
+
+	ret = pthread_create(&drm->modeset_thread, NULL, early_modeset_thread, drm);
+	if (ret) {
+		printf("failed to start modeset thread: %s\n", strerror(ret));
+		drm_early_modeset_release(drm);
+		return -1;
+	}
+	drm->modeset_started = 1;
+
+	return 0;
+}
+
+void drm_early_modeset_finish(struct drm *drm)
+{
+	if (!drm->modeset_started)
+		return;
+
+	pthread_join(drm->modeset_thread, NULL);
+	drm->modeset_started = 0;
+}
+
+void drm_early_modeset_release(struct drm *drm)
+{
+	struct drm_mode_destroy_dumb destroy = { .handle = drm->modeset_handle };
+
+	drm_early_modeset_finish(drm);
+
+	if (drm->modeset_fb)
+		drmModeRmFB(drm->fd, drm->modeset_fb);
+	if (drm->modeset_handle)
+		drmIoctl(drm->fd, DRM_IOCTL_MODE_DESTROY_DUMB, &destroy);
+
+	drm->modeset_fb = 0;
+	drm->modeset_handle = 0;
+}
+
+uint64_t drm_mode_period(const drmModeModeInfo *mode)
+{
+	uint64_t period;
+
+	if (!mode->clock || !mode->htotal || !mode->vtotal)
+		return 1000000000ull / 60;
+
+	/* clock is in kHz: */
+	period = (uint64_t)mode->htotal * mode->vtotal * 1000000ull / mode->clock;
+	if (mode->flags & DRM_MODE_FLAG_INTERLACE)
+		period /= 2;
+	if (mode->flags & DRM_MODE_FLAG_DBLSCAN)
+		period *= 2;
+	if (mode->vscan > 1)
+		period *= mode->vscan;
+
+	return period;
+}
+
+int init_drm(struct drm *drm, int drm_fd)
 {
 	drmModeRes *resources;
 	drmModeConnector *connector = NULL;
@@ -183,6 +472,11 @@ int init_drm(struct drm *drm, int drm_fd, int leased_fd)
 		return -1;
 	}
 
+	/* for the primary plane to be listed, and its IN_FORMATS with it,
+	 * even when the legacy backend doesn't use the planes otherwise:
+	 */
+	drmSetClientCap(drm_fd, DRM_CLIENT_CAP_UNIVERSAL_PLANES, 1);
+
 	resources = drmModeGetResources(drm_fd);
 	if (!resources) {
 		printf("drmModeGetResources failed: %s\n", strerror(errno));
@@ -193,8 +487,7 @@ int init_drm(struct drm *drm, int drm_fd, int leased_fd)
 	for (i = 0; i < resources->count_connectors; i++) {
 		connector = drmModeGetConnector(drm_fd, resources->connectors[i]);
 
-		if (connector->connection == DRM_MODE_CONNECTED && 
-		    !leased(drm_fd, leased_fd, connector->connector_id)) {
+		if (connector->connection == DRM_MODE_CONNECTED) {
 			/* it's connected, let's use this! */
 			break;
 		}
@@ -239,10 +532,11 @@ int init_drm(struct drm *drm, int drm_fd, int leased_fd)
 		encoder = NULL;
 	}
 
-	if (encoder) {
+	/* (on a lease, the encoder's crtc shows up as 0 unless it is ours) */
+	if (encoder && encoder->crtc_id) {
 		drm->crtc_id = encoder->crtc_id;
 	} else {
-		uint32_t crtc_id = find_crtc_for_connector(drm_fd, leased_fd, resources, connector);
+		uint32_t crtc_id = find_crtc_for_connector(drm_fd, resources, connector);
 		if (crtc_id == 0) {
 			printf("no crtc found!\n");
 			return -1;
@@ -265,75 +559,337 @@ int init_drm(struct drm *drm, int drm_fd, int leased_fd)
 	return 0;
 }
 
-int find_drm_resources(struct drm_resources *drm_resources, int fd, int nfd)
+static uint64_t get_plane_property(int drm_fd, uint32_t plane_id,
+		const char *name, uint64_t value)
 {
-	drmModeRes *resources;
-	drmModeConnector *connector = NULL;
-	drmModeEncoder *encoder = NULL;
-	int i;
+	drmModeObjectProperties *props;
+	uint32_t i;
 
-	resources = drmModeGetResources(fd);
-	if (!resources) {
-		printf("drmModeGetResources failed: %s\n", strerror(errno));
-		return -1;
+	props = drmModeObjectGetProperties(drm_fd, plane_id, DRM_MODE_OBJECT_PLANE);
+	if (!props)
+		return value;
+
+	for (i = 0; i < props->count_props; i++) {
+		drmModePropertyRes *prop = drmModeGetProperty(drm_fd, props->props[i]);
+
+		if (prop && !strcmp(prop->name, name))
+			value = props->prop_values[i];
+		drmModeFreeProperty(prop);
 	}
 
-	/* find a connected connector: */
-	for (i = 0; i < resources->count_connectors; i++) {
-		connector = drmModeGetConnector(fd, resources->connectors[i]);
-		if (connector->connection == DRM_MODE_CONNECTED && !leased(fd, nfd, connector->connector_id)) {
-			/* it's connected, let's use this! */
-			drm_resources->connector_id = connector->connector_id;
+	drmModeFreeObjectProperties(props);
+
+	return value;
+}
+
+static uint64_t get_plane_type(int drm_fd, uint32_t plane_id)
+{
+	return get_plane_property(drm_fd, plane_id, "type", DRM_PLANE_TYPE_OVERLAY);
+}
+
+#ifdef FORMAT_BLOB_CURRENT
+unsigned drm_blob_modifiers(const drmModePropertyBlobRes *blob, uint32_t format,
+		uint64_t **mods)
+{
+	const struct drm_format_modifier_blob *header = blob->data;
+	const uint32_t *formats = (const uint32_t *)((const char *)header + header->formats_offset);
+	const struct drm_format_modifier *m = (const struct drm_format_modifier *)
+			((const char *)header + header->modifiers_offset);
+	unsigned count = 0;
+	uint32_t i, j;
+
+	*mods = NULL;
+
+	for (i = 0; i < header->count_formats; i++)
+		if (formats[i] == format)
 			break;
+	if (i == header->count_formats)
+		return 0;
+
+	*mods = calloc(header->count_modifiers, sizeof(**mods));
+	for (j = 0; j < header->count_modifiers; j++) {
+		if (i < m[j].offset || i >= m[j].offset + 64)
+			continue;
+		if (m[j].formats & (1ULL << (i - m[j].offset)))
+			(*mods)[count++] = m[j].modifier;
+	}
+
+	return count;
+}
+#endif
+
+#ifdef HAVE_GBM_MODIFIERS
+/* What the primary plane of the crtc takes, from the atomic backend's
+ * plane info if there is some, otherwise looked up for the legacy one:
+ */
+static int scanout_modifiers(const struct drm *drm, uint32_t format, uint64_t **mods)
+{
+	drmModePlaneRes *plane_resources;
+	int count = 0;
+	uint32_t i;
+
+	*mods = NULL;
+
+	if (drm->plane) {
+		for (i = 0; i < drm->plane->count_formats; i++) {
+			const struct plane_format *f = &drm->plane->formats[i];
+
+			if (f->format != format || !f->count_modifiers)
+				continue;
+
+			*mods = calloc(f->count_modifiers, sizeof(**mods));
+			memcpy(*mods, f->modifiers, f->count_modifiers * sizeof(**mods));
+			return f->count_modifiers;
 		}
-		drmModeFreeConnector(connector);
-		connector = NULL;
+		return 0;
 	}
 
-	if (!connector) {
-		/* we could be fancy and listen for hotplug events and wait for
-		 * a connector..
-		 */
-		printf("no connected connector!\n");
-		return -1;
+#ifdef FORMAT_BLOB_CURRENT
+	plane_resources = drmModeGetPlaneResources(drm->fd);
+	if (!plane_resources)
+		return 0;
+
+	for (i = 0; i < plane_resources->count_planes && !count; i++) {
+		uint32_t id = plane_resources->planes[i];
+		drmModePlane *plane = drmModeGetPlane(drm->fd, id);
+		drmModePropertyBlobRes *blob;
+		uint64_t blob_id;
+		int ours = plane && (plane->possible_crtcs & (1u << drm->crtc_index));
+
+		drmModeFreePlane(plane);
+		if (!ours || get_plane_type(drm->fd, id) != DRM_PLANE_TYPE_PRIMARY)
+			continue;
+
+		blob_id = get_plane_property(drm->fd, id, "IN_FORMATS", 0);
+		blob = blob_id ? drmModeGetPropertyBlob(drm->fd, blob_id) : NULL;
+		if (!blob)
+			break;
+
+		count = drm_blob_modifiers(blob, format, mods);
+		drmModeFreePropertyBlob(blob);
 	}
 
-	/* find encoder: */
-	for (i = 0; i < resources->count_encoders; i++) {
-		encoder = drmModeGetEncoder(fd, resources->encoders[i]);
-		if (encoder->encoder_id == connector->encoder_id && !leased(fd, nfd, encoder->encoder_id))
+	drmModeFreePlaneResources(plane_resources);
+#else
+	(void)plane_resources;
+#endif
+
+	return count;
+}
+
+int drm_negotiate_modifiers(struct drm *drm, struct gbm_device *dev,
+		uint32_t format, uint64_t **mods)
+{
+	uint64_t *scanout, *render;
+	int count_scanout, count_render, count = 0, i, j;
+
+	count_scanout = scanout_modifiers(drm, format, &scanout);
+	count_render = egl_get_modifiers(dev, format, &render);
+
+	*mods = calloc(count_scanout ? count_scanout : 1, sizeof(**mods));
+	for (i = 0; i < count_scanout; i++)
+		for (j = 0; j < count_render; j++)
+			if (scanout[i] == render[j]) {
+				(*mods)[count++] = scanout[i];
+				break;
+			}
+
+	free(scanout);
+	free(render);
+
+	/* the allocator picks its favourite of the list, so check the display
+	 * actually takes that one, and if not drop it and try again:
+	 */
+	while (count) {
+		struct gbm_bo *bo = gbm_bo_create_with_modifiers(dev,
+				drm->mode->hdisplay, drm->mode->vdisplay, format, *mods, count);
+		struct drm_fb *fb;
+		uint64_t modifier;
+		int ok;
+
+		if (!bo) {
+			printf("failed to allocate a buffer with any of %d modifiers\n", count);
 			break;
-		drmModeFreeEncoder(encoder);
-		encoder = NULL;
+		}
+
+		modifier = gbm_bo_get_modifier(bo);
+		fb = drm_fb_get_from_bo(bo, drm->fd);
+		ok = fb && (!drm->test_fb || !drm->test_fb(drm, fb->fb_id));
+		gbm_bo_destroy(bo);
+
+		if (ok) {
+			printf("scanning out with modifier 0x%016llx, of %d usable\n",
+					(unsigned long long)modifier, count);
+			return count;
+		}
+
+		printf("modifier 0x%016llx rejected, trying the next one\n",
+				(unsigned long long)modifier);
+
+		for (i = 0; i < count && (*mods)[i] != modifier; i++)
+			;
+		if (i == count)
+			break;
+		memmove(&(*mods)[i], &(*mods)[i + 1], (count - i - 1) * sizeof(**mods));
+		count--;
 	}
 
+	free(*mods);
+	*mods = NULL;
+
+	return 0;
+}
+#else
+int drm_negotiate_modifiers(struct drm *drm, struct gbm_device *dev,
+		uint32_t format, uint64_t **mods)
+{
+	(void)drm, (void)dev, (void)format;
+
+	*mods = NULL;
+
+	return 0;
+}
+#endif
+
+/* A crtc for the connector which no other output has, preferring the one
+ * it is already driven by to spare a modeset.  Returns its index, or -1:
+ */
+static int find_free_crtc(int drm_fd, const drmModeRes *resources,
+		const drmModeConnector *connector, uint32_t used, uint32_t *encoder_id)
+{
+	drmModeEncoder *encoder;
+	int i, j;
+
+	encoder = drmModeGetEncoder(drm_fd, connector->encoder_id);
 	if (encoder) {
-		drm_resources->encoder_id = encoder->encoder_id;
-		drm_resources->crtc_id = encoder->crtc_id;
-	} else {
-		uint32_t crtc_id;
-		for (i = 0; i < connector->count_encoders; i++) {
-			const uint32_t encoder_id = connector->encoders[i];
-			drmModeEncoder *encoder = drmModeGetEncoder(fd, encoder_id);
+		for (i = 0; i < resources->count_crtcs; i++) {
+			if (resources->crtcs[i] == encoder->crtc_id && !(used & (1u << i))) {
+				*encoder_id = encoder->encoder_id;
+				drmModeFreeEncoder(encoder);
+				return i;
+			}
+		}
+		drmModeFreeEncoder(encoder);
+	}
 
-			if (encoder && !leased(fd, nfd, encoder->encoder_id)) {
-				crtc_id = find_crtc_for_encoder(resources, encoder);
+	for (j = 0; j < connector->count_encoders; j++) {
+		encoder = drmModeGetEncoder(drm_fd, connector->encoders[j]);
+		if (!encoder)
+			continue;
 
-				if (crtc_id != 0)
-					break;
+		for (i = 0; i < resources->count_crtcs; i++) {
+			if ((encoder->possible_crtcs & (1u << i)) && !(used & (1u << i))) {
+				*encoder_id = encoder->encoder_id;
 				drmModeFreeEncoder(encoder);
+				return i;
 			}
 		}
+		drmModeFreeEncoder(encoder);
+	}
 
-		if (crtc_id == 0) {
-			printf("no crtc found!\n");
-			return -1;
+	return -1;
+}
+
+/*
+ * Hand out the KMS objects for every connected connector (up to 'max')
+ * in one go, so that each output gets a crtc and planes of its own, to
+ * lease them out before any output starts.  The primary plane of each
+ * crtc goes with it, the overlays are dealt out round robin among the
+ * outputs they can be used with.  Returns the number of outputs found.
+ */
+int find_drm_outputs(int drm_fd, struct drm_resources *outputs, unsigned max)
+{
+	drmModeRes *resources;
+	drmModePlaneRes *plane_resources;
+	uint32_t used_crtcs = 0;
+	unsigned count = 0, next = 0, i, j;
+	int crtc_index[32];       /* possible_crtcs is a 32 bit mask */
+
+	drmSetClientCap(drm_fd, DRM_CLIENT_CAP_UNIVERSAL_PLANES, 1);
+
+	resources = drmModeGetResources(drm_fd);
+	if (!resources) {
+		printf("drmModeGetResources failed: %s\n", strerror(errno));
+		return -1;
+	}
+
+	plane_resources = drmModeGetPlaneResources(drm_fd);
+	if (!plane_resources) {
+		printf("drmModeGetPlaneResources failed: %s\n", strerror(errno));
+		drmModeFreeResources(resources);
+		return -1;
+	}
+
+	for (i = 0; i < (unsigned)resources->count_connectors && count < max &&
+			count < 32; i++) {
+		struct drm_resources *out = &outputs[count];
+		drmModeConnector *connector;
+		int crtc;
+
+		connector = drmModeGetConnector(drm_fd, resources->connectors[i]);
+		if (!connector)
+			continue;
+
+		if (connector->connection != DRM_MODE_CONNECTED) {
+			drmModeFreeConnector(connector);
+			continue;
 		}
 
-		drm_resources->crtc_id = crtc_id;
+		memset(out, 0, sizeof(*out));
+		crtc = find_free_crtc(drm_fd, resources, connector, used_crtcs,
+				&out->encoder_id);
+		if (crtc < 0) {
+			printf("no crtc left for connector %u\n", connector->connector_id);
+			drmModeFreeConnector(connector);
+			continue;
+		}
+
+		used_crtcs |= 1u << crtc;
+		crtc_index[count] = crtc;
+		out->connector_id = connector->connector_id;
+		out->crtc_id = resources->crtcs[crtc];
+		drmModeFreeConnector(connector);
+		count++;
 	}
 
+	for (i = 0; i < plane_resources->count_planes; i++) {
+		uint32_t plane_id = plane_resources->planes[i];
+		drmModePlane *plane = drmModeGetPlane(drm_fd, plane_id);
+		uint64_t type;
+
+		if (!plane)
+			continue;
+
+		type = get_plane_type(drm_fd, plane_id);
+
+		for (j = 0; j < count; j++) {
+			/* primaries to their crtc, overlays round robin: */
+			struct drm_resources *out = &outputs[(next + j) % count];
+			int index = crtc_index[(next + j) % count];
+
+			if (!(plane->possible_crtcs & (1u << index)))
+				continue;
+
+			if (type == DRM_PLANE_TYPE_PRIMARY && !out->plane_id) {
+				out->plane_id = plane_id;
+				break;
+			} else if (type == DRM_PLANE_TYPE_OVERLAY &&
+					out->count_overlays < MAX_OUTPUT_OVERLAYS) {
+				out->overlay_ids[out->count_overlays++] = plane_id;
+				next = (next + j + 1) % count;
+				break;
+			}
+		}
+
+		drmModeFreePlane(plane);
+	}
+
+	drmModeFreePlaneResources(plane_resources);
 	drmModeFreeResources(resources);
 
-	return 0;
+	for (i = 0; i < count; i++)
+		if (!outputs[i].plane_id)
+			printf("no primary plane for crtc %u\n", outputs[i].crtc_id);
+
+	return count;
 }
@@ -24,67 +24,263 @@
 #ifndef _DRM_COMMON_H
 #define _DRM_COMMON_H
 
+#include <pthread.h>
 #include <xf86drm.h>
 #include <xf86drmMode.h>
 
+#include "fb-cache.h"
+#include "pacing.h"
+
 struct gbm;
 struct egl;
+struct dmabuf_frame;
+
+/* the properties used by the atomic commits, looked up once at init: */
+enum plane_prop {
+	PLANE_FB_ID,
+	PLANE_CRTC_ID,
+	PLANE_SRC_X,
+	PLANE_SRC_Y,
+	PLANE_SRC_W,
+	PLANE_SRC_H,
+	PLANE_CRTC_X,
+	PLANE_CRTC_Y,
+	PLANE_CRTC_W,
+	PLANE_CRTC_H,
+	PLANE_IN_FENCE_FD,
+	PLANE_ZPOS,
+	PLANE_FB_DAMAGE_CLIPS,
+	PLANE_PROP_COUNT
+};
+
+enum crtc_prop {
+	CRTC_MODE_ID,
+	CRTC_ACTIVE,
+	CRTC_OUT_FENCE_PTR,
+	CRTC_PROP_COUNT
+};
+
+enum connector_prop {
+	CONNECTOR_CRTC_ID,
+	CONNECTOR_PROP_COUNT
+};
+
+/* a format a plane can scan out, with the modifiers it supports for it
+ * (none if the driver does not expose IN_FORMATS):
+ */
+struct plane_format {
+	uint32_t format;
+	unsigned count_modifiers;
+	uint64_t *modifiers;
+};
+
+struct plane;
+
+/*
+ * A buffer for the atomic compositor to scan out on a plane of its own
+ * rather than have the GPU composite it.  Layers are stacked bottom
+ * first, underneath the GL rendered primary plane.
+ */
+struct layer {
+	uint32_t fb_id;
+	uint32_t format;
+	uint64_t modifier;        /* DRM_FORMAT_MOD_INVALID if unknown */
+	uint32_t src_w, src_h;
+	int32_t crtc_x, crtc_y;
+	uint32_t crtc_w, crtc_h;
+
+	/* plane the layer got assigned, NULL if the GPU has to composite it: */
+	struct plane *plane;
+};
 
 struct plane {
 	drmModePlane *plane;
 	drmModeObjectProperties *props;
 	drmModePropertyRes **props_info;
+	uint32_t prop_id[PLANE_PROP_COUNT];   /* 0 if the driver lacks it */
+
+	uint64_t type;            /* DRM_PLANE_TYPE_x */
+	unsigned count_formats;
+	struct plane_format *formats;
+
+	/* zpos property (NULL if the plane has none) and its initial value: */
+	drmModePropertyRes *zpos;
+	uint64_t zpos_value;
+
+	/* what the last commit put on the plane, if anything.  The kernel
+	 * keeps the plane state between commits, so only FB_ID needs to be
+	 * sent again while the rest stays the same:
+	 */
+	int active;
+	struct layer state;
 };
 
 struct crtc {
 	drmModeCrtc *crtc;
 	drmModeObjectProperties *props;
 	drmModePropertyRes **props_info;
+	uint32_t prop_id[CRTC_PROP_COUNT];
 };
 
 struct connector {
 	drmModeConnector *connector;
 	drmModeObjectProperties *props;
 	drmModePropertyRes **props_info;
+	uint32_t prop_id[CONNECTOR_PROP_COUNT];
+};
+
+/* Who has a buffer of the swap chain.  The one EGL renders into is still
+ * owned by the gbm surface, until it gets locked and queued:
+ */
+enum buffer_state {
+	BUFFER_FREE,      /* back with the gbm surface */
+	BUFFER_QUEUED,    /* rendered (maybe still on the GPU), waiting to flip */
+	BUFFER_PENDING,   /* flip committed, not on screen yet */
+	BUFFER_SCANOUT,   /* on screen */
+};
+
+struct swap_buffer {
+	enum buffer_state state;
+	struct gbm_bo *bo;
+	struct drm_fb *fb;
+	int fence_fd;             /* signaled when rendering is done, or -1 */
+	struct drm_mode_rect damage; /* changed since the buffer before, in fb coordinates */
+	unsigned seq;             /* queueing order */
+};
+
+/*
+ * The buffers locked from the gbm surface, at most 'depth' of them
+ * including the one on screen.  A depth of 2 is plain double buffering:
+ * rendering waits for each flip.  With 3 or 4 the GPU renders ahead
+ * while KMS flips, trading latency for throughput.
+ */
+struct swapchain {
+	int drm_fd;               /* the KMS device the buffers go to */
+	struct gbm_surface *surface;
+	unsigned depth;
+	unsigned locked;
+	unsigned seq;
+	struct swap_buffer *pending;
+	struct swap_buffer buffers[MAX_SWAP_DEPTH];
 };
 
 struct drm {
 	int fd;
-	int leased_fd;
 
-	/* only used for atomic: */
+	/* only used for atomic, every plane usable with the crtc and the
+	 * (preferably primary) one of them the GL rendering goes on:
+	 */
+	struct plane *planes;
+	unsigned count_planes;
 	struct plane *plane;
 	struct crtc *crtc;
 	struct connector *connector;
 	int crtc_index;
 	int kms_in_fence_fd;
 	int kms_out_fence_fd;
+	uint32_t mode_blob_id;
+
+	/* the fbs of the video frames scanned out on a plane: */
+	struct fb_cache fb_cache;
 
 	drmModeModeInfo *mode;
 	uint32_t crtc_id;
 	uint32_t connector_id;
 
+	/* the black dumb fb drm_early_modeset() lights the output up with
+	 * while the rest of the init runs, until the first frame replaces it:
+	 */
+	pthread_t modeset_thread;
+	int modeset_started;
+	uint32_t modeset_fb;
+	uint32_t modeset_handle;
+
+	/* number of frames for run() to render, 0 for no limit: */
+	unsigned frames;
+
+	/* swap chain depth for the KMS backends, 2 to MAX_SWAP_DEPTH: */
+	unsigned swap_depth;
+
+	/* hold rendering back until just in time for its vblank: */
+	int low_latency;
+	struct pacing pacing;
+
+	/* Optional, check (without changing anything) that the display
+	 * takes the fb, such as an atomic TEST_ONLY commit.  Returns 0 if so:
+	 */
+	int (*test_fb)(struct drm *drm, uint32_t fb_id);
+
 	int (*run)(struct drm *drm, const struct gbm *gbm, struct egl *egl);
 };
 
+#define MAX_OUTPUT_OVERLAYS 4
+
+/* The KMS objects of an output, handed out by find_drm_outputs(): */
 struct drm_resources {
-	uint32_t plane_id;
+	uint32_t plane_id;        /* primary */
 	uint32_t crtc_id;
 	uint32_t connector_id;
 	uint32_t encoder_id;
+	unsigned count_overlays;
+	uint32_t overlay_ids[MAX_OUTPUT_OVERLAYS];
 };
 
 struct drm_fb {
 	struct gbm_bo *bo;
+	int fd;                   /* the device the fb was added to */
 	uint32_t fb_id;
 };
 
-struct drm_fb * drm_fb_get_from_bo(struct gbm_bo *bo);
+struct drm_fb * drm_fb_get_from_bo(struct gbm_bo *bo, int drm_fd);
+
+
+void swapchain_init(struct swapchain *sc, int drm_fd, struct gbm_surface *surface,
+		unsigned depth);
+int swapchain_can_render(const struct swapchain *sc);
+struct swap_buffer * swapchain_queue(struct swapchain *sc, int fence_fd);
+struct swap_buffer * swapchain_next(struct swapchain *sc);
+void swapchain_commit(struct swapchain *sc, struct swap_buffer *buf);
+void swapchain_flipped(struct swapchain *sc);
+void swapchain_release_queued(struct swapchain *sc);
+
+struct event_loop;
+struct event_loop * drm_event_loop_create(struct drm *drm);
+
+int find_drm_outputs(int drm_fd, struct drm_resources *outputs, unsigned max);
+int init_drm(struct drm *drm, int drm_fd);
+uint64_t drm_mode_period(const drmModeModeInfo *mode);   /* refresh period, ns */
+struct drm * init_drm_legacy(int drm_fd);
+struct drm * init_drm_atomic(int drm_fd);
+struct drm * init_drm_offscreen(int w, int h);
+/*
+ * Do the (slow, on most hardware) full modeset to drm->mode on a thread
+ * of its own, with a black dumb buffer, so that it overlaps the GBM/EGL
+ * and scene init.  The run loops join it with drm_early_modeset_finish()
+ * before their first commit, which then only has to flip, and once that
+ * is on screen drm_early_modeset_release() frees the black buffer.  Both
+ * are no-ops if no early modeset was started.
+ */
+int drm_early_modeset(struct drm *drm);
+void drm_early_modeset_finish(struct drm *drm);
+void drm_early_modeset_release(struct drm *drm);
+
+#ifdef FORMAT_BLOB_CURRENT
+/* The modifiers an IN_FORMATS blob lists for 'format', in a calloc()ed
+ * array:
+ */
+unsigned drm_blob_modifiers(const drmModePropertyBlobRes *blob, uint32_t format,
+		uint64_t **mods);
+#endif
 
+/*
+ * The modifiers for the scanout buffers: those the primary plane can scan
+ * out (IN_FORMATS) which EGL can also render to, minus any the display
+ * turns down once the allocator picked it.  Returns the count, and the
+ * calloc()ed list in 'mods', or 0 to go with plain linear buffers.
+ */
+int drm_negotiate_modifiers(struct drm *drm, struct gbm_device *dev,
+		uint32_t format, uint64_t **mods);
 
-int find_drm_resources(struct drm_resources *drm, int drm_fd, int lease_fd);
-int init_drm(struct drm *drm, int drm_fd, int leased_fd);
-struct drm * init_drm_legacy(int drm_fd, int leased_fd);
-struct drm * init_drm_atomic(int drm_fd, int leased_fd);
+struct plane * drm_find_plane(const struct drm *drm, uint32_t format, uint64_t modifier);
 
 #endif /* _DRM_COMMON_H */
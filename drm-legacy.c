@@ -24,7 +24,6 @@
 #include <errno.h>
 #include <stdio.h>
 #include <string.h>
-#include <sys/select.h>
 #include <assert.h>
 #include <sys/types.h>
 #include <unistd.h>
@@ -33,109 +32,177 @@
 
 #include "common.h"
 #include "drm-common.h"
+#include "event-loop.h"
+#include "stats.h"
+
+/* what the page flips carry: */
+struct flip_data {
+	struct swapchain *sc;
+	struct pacing *pacing;
+};
 
 static void page_flip_handler(int fd, unsigned int frame,
 		  unsigned int sec, unsigned int usec, void *data)
 {
 	/* suppress 'unused parameter' warnings */
-	(void)fd, (void)frame, (void)sec, (void)usec;
+	(void)fd;
+
+	struct flip_data *flip = data;
 
-	int *waiting_for_flip = data;
-	*waiting_for_flip = 0;
+	stats_flip(frame, sec, usec);
+	pacing_flip(flip->pacing, frame, sec, usec);
+	swapchain_flipped(flip->sc);
 }
 
-int legacy_run(struct drm *drm, const struct gbm *gbm, struct egl *egl)
+static int drm_event(void *data, uint32_t events)
 {
-	fd_set fds;
 	drmEventContext evctx = {
 			.version = 2,
 			.page_flip_handler = page_flip_handler,
 	};
-	struct gbm_bo *bo;
-	struct drm_fb *fb;
+	struct drm *drm = data;
+
+	(void)events;
+
+	drmHandleEvent(drm->fd, &evctx);
+
+	return 0;
+}
+
+/* Dispatch events until the pending flip completed, or just those
+ * already there if 'block' isn't set.  Returns > 0 if we are to exit:
+ */
+static int wait_flip(struct event_loop *loop, struct swapchain *sc, int block)
+{
+	uint64_t t = stats_now();
+	int ret;
+
+	do {
+		ret = event_loop_dispatch(loop, block ? -1 : 0);
+	} while (!ret && block && sc->pending);
+
+	if (!ret && block)
+		stats_record(STATS_WAIT, t);
+
+	return ret;
+}
+
+int legacy_run(struct drm *drm, const struct gbm *gbm, struct egl *egl)
+{
+	struct swapchain sc;
+	struct swap_buffer *buf;
+	struct event_loop *loop;
+	struct flip_data flip = { &sc, &drm->pacing };
 	uint32_t i = 0;
 	int ret;
 
-	FD_ZERO(&fds);
-	FD_SET(0, &fds);
-	FD_SET(drm->fd, &fds);
+	swapchain_init(&sc, drm->fd, gbm->surface, drm->swap_depth);
+	pacing_init(&drm->pacing, drm_mode_period(drm->mode), drm->low_latency);
 
-	eglSwapBuffers(egl->display, egl->surface);
-	bo = gbm_surface_lock_front_buffer(gbm->surface);
-	if (!bo) {
-		fprintf(stderr, "Failed to lock front buffer %ld\n", syscall(SYS_gettid));
+	loop = drm_event_loop_create(drm);
+	if (!loop)
 		return -1;
-	}
 
-	fb = drm_fb_get_from_bo(bo);
-	if (!fb) {
-		fprintf(stderr, "Failed to get a new framebuffer BO\n");
-		return -1;
+	/* the flip events carry the swap chain and pacing: */
+	if (event_loop_add(loop, drm->fd, EPOLLIN, drm_event, drm))
+		goto fail;
+
+	egl_swap(egl);
+	buf = swapchain_queue(&sc, -1);
+	if (!buf) {
+		fprintf(stderr, "Failed to lock front buffer %ld\n", syscall(SYS_gettid));
+		goto fail;
 	}
 
-	/* set mode: */
-	ret = drmModeSetCrtc(drm->fd, drm->crtc_id, fb->fb_id, 0, 0,
+	/* set mode, which after an early modeset to the same mode is only a flip: */
+	drm_early_modeset_finish(drm);
+	ret = drmModeSetCrtc(drm->fd, drm->crtc_id, buf->fb->fb_id, 0, 0,
 			&drm->connector_id, 1, drm->mode);
 	if (ret) {
 		printf("failed to set mode: %s\n", strerror(errno));
-		return ret;
+		goto fail;
 	}
+	drm_early_modeset_release(drm);
+	swapchain_commit(&sc, buf);
+	swapchain_flipped(&sc);
+
+	while (!drm->frames || i < drm->frames) {
+		uint64_t t;
+
+		/* render ahead for as long as the swap chain has room: */
+		if (swapchain_can_render(&sc)) {
+			float frame;
+
+			ret = pacing_begin(&drm->pacing, loop, &frame);
+			if (ret < 0)
+				goto fail;
+			else if (ret)
+				break;
+
+			egl_wait_render_ahead(egl);
 
-	while (1) {
-		struct gbm_bo *next_bo;
-		int waiting_for_flip = 1;
+			t = stats_now();
 
-		egl->draw(egl, i++);
+			egl_draw(egl, frame);
+			t = stats_record(STATS_DRAW, t);
 
-		eglSwapBuffers(egl->display, egl->surface);
-		next_bo = gbm_surface_lock_front_buffer(gbm->surface);
-		fb = drm_fb_get_from_bo(next_bo);
-		if (!fb) {
-			fprintf(stderr, "Failed to get a new framebuffer BO\n");
-			return -1;
+			egl_swap(egl);
+			t = stats_record(STATS_SWAP, t);
+
+			if (!swapchain_queue(&sc, -1))
+				goto fail;
+			stats_record(STATS_LOCK, t);
+			pacing_end(&drm->pacing);
+			i++;
 		}
 
+		/* only block for the flip when there is nothing to render: */
+		ret = wait_flip(loop, &sc, sc.pending && !swapchain_can_render(&sc));
+		if (ret < 0)
+			goto fail;
+		else if (ret)
+			break;
+
+		/* flip to the oldest frame once the last flip is done: */
+		if (sc.pending || !(buf = swapchain_next(&sc)))
+			continue;
+
 		/*
 		 * Here you could also update drm plane layers if you want
 		 * hw composition
 		 */
 
-		ret = drmModePageFlip(drm->fd, drm->crtc_id, fb->fb_id,
-				DRM_MODE_PAGE_FLIP_EVENT, &waiting_for_flip);
+		t = stats_now();
+		ret = drmModePageFlip(drm->fd, drm->crtc_id, buf->fb->fb_id,
+				DRM_MODE_PAGE_FLIP_EVENT, &flip);
 		if (ret) {
 			printf("failed to queue page flip: %s\n", strerror(errno));
-			return -1;
+			goto fail;
 		}
-
-		while (waiting_for_flip) {
-			ret = select(drm->fd + 1, &fds, NULL, NULL, NULL);
-			if (ret < 0) {
-				printf("select err: %s\n", strerror(errno));
-				return ret;
-			} else if (ret == 0) {
-				printf("select timeout!\n");
-				return -1;
-			} else if (FD_ISSET(0, &fds)) {
-				printf("user interrupted!\n");
-				break;
-			}
-			drmHandleEvent(drm->fd, &evctx);
-		}
-
-		/* release last buffer to render on again: */
-		gbm_surface_release_buffer(gbm->surface, bo);
-		bo = next_bo;
+		stats_record(STATS_COMMIT, t);
+		swapchain_commit(&sc, buf);
 	}
 
+	/* let the last flip land before handing the buffers back: */
+	while (sc.pending)
+		drm_event(drm, 0);
+	swapchain_release_queued(&sc);
+	event_loop_destroy(loop);
+
 	return 0;
+
+fail:
+	drm_early_modeset_release(drm);
+	event_loop_destroy(loop);
+	return -1;
 }
 
-struct drm * init_drm_legacy(int fd, int leased_fd)
+struct drm * init_drm_legacy(int fd)
 {
 	int ret;
 	struct drm *drm = calloc(1, sizeof(*drm));
 
-	ret = init_drm(drm, fd, leased_fd);
+	ret = init_drm(drm, fd);
 	if (ret)
 		return NULL;
 
@@ -0,0 +1,114 @@
+/*
+ * Copyright 2026 NXP
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sub license,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the
+ * next paragraph) shall be included in all copies or substantial portions
+ * of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT. IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "common.h"
+#include "drm-common.h"
+#include "event-loop.h"
+#include "stats.h"
+
+/* how often to report the frame rate when running without a limit: */
+#define REPORT_INTERVAL_NS (5 * 1000000000ull)
+
+/* No display, no vsync: render as fast as the GPU goes, handing each
+ * buffer straight back to the surface.
+ */
+static int offscreen_run(struct drm *drm, const struct gbm *gbm, struct egl *egl)
+{
+	uint64_t report = get_time_ns();
+	uint32_t i = 0, reported = 0;
+	struct event_loop *loop;
+	int ret = 0;
+
+	/* nothing to wait for, but still exit cleanly on a signal: */
+	loop = drm_event_loop_create(drm);
+	if (!loop)
+		return -1;
+
+	while (!ret && (!drm->frames || i < drm->frames)) {
+		struct gbm_bo *bo;
+		uint64_t t;
+
+		egl_wait_render_ahead(egl);
+
+		t = stats_now();
+		egl_draw(egl, i++);
+		t = stats_record(STATS_DRAW, t);
+
+		egl_swap(egl);
+		t = stats_record(STATS_SWAP, t);
+
+		bo = gbm_surface_lock_front_buffer(gbm->surface);
+		if (!bo) {
+			printf("Failed to lock frontbuffer\n");
+			ret = -1;
+			break;
+		}
+		stats_record(STATS_LOCK, t);
+		stats_startup_done("first frame");
+
+		gbm_surface_release_buffer(gbm->surface, bo);
+
+		if (!drm->frames && !(i % 64)) {
+			uint64_t now = get_time_ns();
+
+			if (now - report >= REPORT_INTERVAL_NS) {
+				printf("%u frames in %.1f s: %.1f fps\n", i - reported,
+						(now - report) / 1e9,
+						(i - reported) * 1e9 / (now - report));
+				report = now;
+				reported = i;
+			}
+		}
+
+		ret = event_loop_dispatch(loop, 0);
+	}
+
+	event_loop_destroy(loop);
+
+	return ret < 0 ? -1 : 0;
+}
+
+/* A headless "display" of the given size, to render on a render node
+ * without modesetting anything:
+ */
+struct drm * init_drm_offscreen(int w, int h)
+{
+	struct drm *drm = calloc(1, sizeof(*drm));
+
+	drm->mode = calloc(1, sizeof(*drm->mode));
+	drm->mode->hdisplay = w;
+	drm->mode->vdisplay = h;
+	snprintf(drm->mode->name, sizeof(drm->mode->name), "%dx%d", w, h);
+
+	drm->kms_in_fence_fd = -1;
+	drm->kms_out_fence_fd = -1;
+
+	printf("rendering offscreen at %dx%d\n", w, h);
+
+	drm->run = offscreen_run;
+
+	return drm;
+}
@@ -0,0 +1,348 @@
+/*
+ * Copyright 2026 NXP
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sub license,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the
+ * next paragraph) shall be included in all copies or substantial portions
+ * of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT. IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+#define _GNU_SOURCE
+
+#include <errno.h>
+#include <signal.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <linux/netlink.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+
+#include "event-loop.h"
+
+#define MAX_SOURCES 8
+
+struct event_source {
+	int fd;                   /* -1 if the slot is free */
+	int owned;                /* fd gets closed with the loop */
+	event_handler handler;
+	void *data;
+};
+
+struct event_loop {
+	int epoll_fd;
+	struct event_source sources[MAX_SOURCES];
+	int signals;              /* counted in exit_owners */
+
+	int hotplug_fd;
+	event_handler hotplug;
+	void *hotplug_data;
+};
+
+/* Readable from the first SIGINT/SIGTERM on, which is never read off it,
+ * so that the run loop of every output sees it and exits.  Until a run
+ * loop waits on it, the signals just terminate the process as usual:
+ */
+static int exit_fd = -1;
+static volatile sig_atomic_t exit_signal;
+static atomic_int exit_owners;
+
+static void exit_signal_handler(int sig)
+{
+	uint64_t one = 1;
+
+	if (!atomic_load(&exit_owners)) {
+		signal(sig, SIG_DFL);
+		raise(sig);
+		return;
+	}
+
+	/* (the counter can't overflow from this, so the write can't fail) */
+	exit_signal = sig;
+	if (write(exit_fd, &one, sizeof(one)) != sizeof(one))
+		return;
+}
+
+int handle_exit_signals(void)
+{
+	struct sigaction sa = {
+		.sa_handler = exit_signal_handler,
+		.sa_flags = SA_RESTART,
+	};
+
+	exit_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+	if (exit_fd < 0) {
+		printf("eventfd failed: %s\n", strerror(errno));
+		return -1;
+	}
+
+	sigemptyset(&sa.sa_mask);
+	sigaction(SIGINT, &sa, NULL);
+	sigaction(SIGTERM, &sa, NULL);
+
+	return 0;
+}
+
+struct event_loop * event_loop_create(void)
+{
+	struct event_loop *loop = calloc(1, sizeof(*loop));
+	unsigned i;
+
+	loop->epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+	if (loop->epoll_fd < 0) {
+		printf("epoll_create1 failed: %s\n", strerror(errno));
+		free(loop);
+		return NULL;
+	}
+
+	for (i = 0; i < MAX_SOURCES; i++)
+		loop->sources[i].fd = -1;
+
+	return loop;
+}
+
+void event_loop_destroy(struct event_loop *loop)
+{
+	unsigned i;
+
+	for (i = 0; i < MAX_SOURCES; i++)
+		if (loop->sources[i].fd >= 0 && loop->sources[i].owned)
+			close(loop->sources[i].fd);
+
+	if (loop->signals)
+		atomic_fetch_sub(&exit_owners, 1);
+
+	close(loop->epoll_fd);
+	free(loop);
+}
+
+static struct event_source * add_source(struct event_loop *loop, int fd,
+		uint32_t events, event_handler handler, void *data)
+{
+	struct epoll_event ev = { .events = events };
+	struct event_source *src = NULL;
+	unsigned i;
+
+	for (i = 0; i < MAX_SOURCES && !src; i++)
+		if (loop->sources[i].fd < 0)
+			src = &loop->sources[i];
+
+	if (!src) {
+		printf("too many event sources\n");
+		return NULL;
+	}
+
+	ev.data.ptr = src;
+	if (epoll_ctl(loop->epoll_fd, EPOLL_CTL_ADD, fd, &ev)) {
+		printf("epoll_ctl failed: %s\n", strerror(errno));
+		return NULL;
+	}
+
+	src->fd = fd;
+	src->owned = 0;
+	src->handler = handler;
+	src->data = data;
+
+	return src;
+}
+
+int event_loop_add(struct event_loop *loop, int fd, uint32_t events,
+		event_handler handler, void *data)
+{
+	return add_source(loop, fd, events, handler, data) ? 0 : -1;
+}
+
+void event_loop_remove(struct event_loop *loop, int fd)
+{
+	unsigned i;
+
+	for (i = 0; i < MAX_SOURCES; i++) {
+		struct event_source *src = &loop->sources[i];
+
+		if (src->fd != fd)
+			continue;
+
+		epoll_ctl(loop->epoll_fd, EPOLL_CTL_DEL, fd, NULL);
+		if (src->owned)
+			close(fd);
+		src->fd = -1;
+	}
+}
+
+static int signal_event(void *data, uint32_t events)
+{
+	(void)data, (void)events;
+
+	printf("%s, exiting\n", strsignal(exit_signal ? exit_signal : SIGTERM));
+
+	return 1;
+}
+
+int event_loop_add_signals(struct event_loop *loop)
+{
+	if (exit_fd < 0) {
+		printf("exit signals are not handled\n");
+		return -1;
+	}
+
+	if (!add_source(loop, exit_fd, EPOLLIN, signal_event, NULL))
+		return -1;
+
+	loop->signals = 1;
+	atomic_fetch_add(&exit_owners, 1);
+
+	return 0;
+}
+
+/* uevents are a "ACTION@DEVPATH" header followed by NUL separated
+ * KEY=value pairs:
+ */
+static int uevent_has(const char *buf, size_t len, const char *key)
+{
+	size_t i = strlen(buf) + 1;
+
+	while (i < len) {
+		if (strcmp(buf + i, key) == 0)
+			return 1;
+		i += strlen(buf + i) + 1;
+	}
+
+	return 0;
+}
+
+static int hotplug_event(void *data, uint32_t events)
+{
+	struct event_loop *loop = data;
+	char buf[4096];
+	int ret = 0;
+
+	while (!ret) {
+		struct sockaddr_nl addr;
+		socklen_t addrlen = sizeof(addr);
+		ssize_t len;
+
+		len = recvfrom(loop->hotplug_fd, buf, sizeof(buf) - 1, 0,
+				(struct sockaddr *)&addr, &addrlen);
+		if (len <= 0)
+			break;
+		buf[len] = '\0';
+
+		/* only trust what comes from the kernel: */
+		if (addr.nl_pid != 0)
+			continue;
+
+		if (uevent_has(buf, len, "SUBSYSTEM=drm") &&
+				uevent_has(buf, len, "HOTPLUG=1"))
+			ret = loop->hotplug(loop->hotplug_data, events);
+	}
+
+	return ret;
+}
+
+int event_loop_add_hotplug(struct event_loop *loop, event_handler handler, void *data)
+{
+	struct sockaddr_nl addr = {
+		.nl_family = AF_NETLINK,
+		.nl_groups = 1,           /* kernel uevents */
+	};
+	struct event_source *src;
+	int fd;
+
+	fd = socket(AF_NETLINK, SOCK_DGRAM | SOCK_NONBLOCK | SOCK_CLOEXEC,
+			NETLINK_KOBJECT_UEVENT);
+	if (fd < 0) {
+		printf("could not open uevent socket: %s\n", strerror(errno));
+		return -1;
+	}
+
+	if (bind(fd, (struct sockaddr *)&addr, sizeof(addr))) {
+		printf("could not bind uevent socket: %s\n", strerror(errno));
+		close(fd);
+		return -1;
+	}
+
+	loop->hotplug_fd = fd;
+	loop->hotplug = handler;
+	loop->hotplug_data = data;
+
+	src = add_source(loop, fd, EPOLLIN, hotplug_event, loop);
+	if (!src) {
+		close(fd);
+		return -1;
+	}
+	src->owned = 1;
+
+	return 0;
+}
+
+int event_loop_dispatch(struct event_loop *loop, int timeout)
+{
+	struct epoll_event events[MAX_SOURCES];
+	int i, n, ret;
+
+	n = epoll_wait(loop->epoll_fd, events, MAX_SOURCES, timeout);
+	if (n < 0) {
+		if (errno == EINTR)
+			return 0;
+		printf("epoll_wait failed: %s\n", strerror(errno));
+		return -1;
+	}
+
+	for (i = 0; i < n; i++) {
+		struct event_source *src = events[i].data.ptr;
+
+		/* removed by an earlier handler: */
+		if (src->fd < 0)
+			continue;
+
+		ret = src->handler(src->data, events[i].events);
+		if (ret)
+			return ret;
+	}
+
+	return 0;
+}
+
+int event_loop_dispatch_until(struct event_loop *loop, uint64_t until)
+{
+	struct timespec ts;
+	uint64_t now;
+	int ret;
+
+	for (;;) {
+		clock_gettime(CLOCK_MONOTONIC, &ts);
+		now = (uint64_t)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+		if (now >= until)
+			return 0;
+
+		/* epoll only does ms, so sleep off the rest: */
+		if (until - now < 1000000) {
+			ts.tv_sec = until / 1000000000ull;
+			ts.tv_nsec = until % 1000000000ull;
+			while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL) == EINTR)
+				;
+			return 0;
+		}
+
+		ret = event_loop_dispatch(loop, (until - now) / 1000000);
+		if (ret)
+			return ret;
+	}
+}
@@ -0,0 +1,76 @@
+/*
+ * Copyright 2026 NXP
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sub license,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the
+ * next paragraph) shall be included in all copies or substantial portions
+ * of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT. IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+#ifndef _EVENT_LOOP_H
+#define _EVENT_LOOP_H
+
+#include <stdint.h>
+#include <sys/epoll.h>
+
+/*
+ * epoll based event loop for the run loops, so that they sleep until
+ * there is something to do: a flip completing (DRM event, or the commit's
+ * out-fence, since sync_files are pollable), display hotplug, input on
+ * stdin or SIGINT/SIGTERM.
+ *
+ * Handlers return 0 to carry on, > 0 to have event_loop_dispatch() stop
+ * the run loop (returning that value), or < 0 on error.
+ */
+typedef int (*event_handler)(void *data, uint32_t events);
+
+struct event_loop;
+
+struct event_loop * event_loop_create(void);
+void event_loop_destroy(struct event_loop *loop);
+
+int event_loop_add(struct event_loop *loop, int fd, uint32_t events,
+		event_handler handler, void *data);
+void event_loop_remove(struct event_loop *loop, int fd);
+
+/* SIGINT/SIGTERM (once handle_exit_signals() was called) stop the loop,
+ * and every other one waiting on them:
+ */
+int event_loop_add_signals(struct event_loop *loop);
+
+/* Calls the handler on DRM hotplug uevents, from the kernel's netlink
+ * socket (no udevd needed):
+ */
+int event_loop_add_hotplug(struct event_loop *loop, event_handler handler, void *data);
+
+/* Wait up to 'timeout' ms (-1 for no limit) for events and dispatch
+ * them.  Returns the first non-zero handler result, or 0.
+ */
+int event_loop_dispatch(struct event_loop *loop, int timeout);
+
+/* Dispatch events until the CLOCK_MONOTONIC time 'until' (in ns), with
+ * the same return value:
+ */
+int event_loop_dispatch_until(struct event_loop *loop, uint64_t until);
+
+/* Catch SIGINT/SIGTERM for the run loops to exit cleanly on.  Whenever
+ * no run loop is waiting on them (init, benchmarks...) they still
+ * terminate the process right away:
+ */
+int handle_exit_signals(void);
+
+#endif /* _EVENT_LOOP_H */
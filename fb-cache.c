@@ -0,0 +1,254 @@
+/*
+ * Copyright 2026 NXP
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sub license,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the
+ * next paragraph) shall be included in all copies or substantial portions
+ * of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT. IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+#include <errno.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <xf86drm.h>
+#include <xf86drmMode.h>
+
+#include "common.h"
+#include "fb-cache.h"
+
+void fb_cache_init(struct fb_cache *cache, int drm_fd)
+{
+	memset(cache, 0, sizeof(*cache));
+	cache->drm_fd = drm_fd;
+}
+
+static int same_layout(const struct fb_cache_entry *e, const struct dmabuf_frame *frame)
+{
+	unsigned i;
+
+	if (e->format != frame->format || e->width != frame->width ||
+	    e->height != frame->height || e->modifier != frame->modifier ||
+	    e->nplanes != frame->nplanes)
+		return 0;
+
+	for (i = 0; i < frame->nplanes; i++)
+		if (e->offset[i] != frame->offset[i] || e->pitch[i] != frame->pitch[i])
+			return 0;
+
+	return 1;
+}
+
+/* Same buffers, by GEM handle or (if 'handles' is NULL) dmabuf inode: */
+static int same_frame(const struct fb_cache_entry *e, const struct dmabuf_frame *frame,
+		const uint32_t *handles, const uint64_t *ino)
+{
+	unsigned i;
+
+	if (!same_layout(e, frame))
+		return 0;
+
+	for (i = 0; i < frame->nplanes; i++)
+		if (handles ? e->handles[i] != handles[i] : e->ino[i] != ino[i])
+			return 0;
+
+	return 1;
+}
+
+static struct fb_cache_entry *find_entry(struct fb_cache *cache,
+		const struct dmabuf_frame *frame, const uint32_t *handles,
+		const uint64_t *ino)
+{
+	unsigned i;
+
+	for (i = 0; i < FB_CACHE_SIZE; i++) {
+		struct fb_cache_entry *e = &cache->entries[i];
+
+		if (e->fb_id && same_frame(e, frame, handles, ino))
+			return e;
+	}
+
+	return NULL;
+}
+
+/* Different buffers with different inodes show every dmabuf has its own: */
+static void check_inodes(struct fb_cache *cache, const struct fb_cache_entry *slot)
+{
+	unsigned i;
+
+	for (i = 0; i < FB_CACHE_SIZE && !cache->inodes_unique; i++) {
+		const struct fb_cache_entry *e = &cache->entries[i];
+
+		if (e != slot && e->fb_id && e->ino[0] != slot->ino[0] &&
+		    e->handles[0] != slot->handles[0])
+			cache->inodes_unique = 1;
+	}
+}
+
+/* Is the handle still needed, by an entry other than 'skip' or the
+ * lookup going on:
+ */
+static int handle_in_use(const struct fb_cache *cache, const struct fb_cache_entry *skip,
+		const uint32_t *handles, unsigned nhandles, uint32_t handle)
+{
+	unsigned i, j;
+
+	for (i = 0; i < nhandles; i++)
+		if (handles[i] == handle)
+			return 1;
+
+	for (i = 0; i < FB_CACHE_SIZE; i++) {
+		const struct fb_cache_entry *e = &cache->entries[i];
+
+		if (e == skip || !e->fb_id)
+			continue;
+		for (j = 0; j < e->nplanes; j++)
+			if (e->handles[j] == handle)
+				return 1;
+	}
+
+	return 0;
+}
+
+static void close_handles(struct fb_cache *cache, const struct fb_cache_entry *skip,
+		const uint32_t *handles, unsigned nhandles, const uint32_t *close,
+		unsigned nclose)
+{
+	unsigned i, j;
+
+	for (i = 0; i < nclose; i++) {
+		struct drm_gem_close req = { .handle = close[i] };
+
+		/* planes of one buffer share the handle: */
+		for (j = 0; j < i && close[j] != close[i]; j++)
+			;
+		if (j < i || !close[i] ||
+		    handle_in_use(cache, skip, handles, nhandles, close[i]))
+			continue;
+
+		drmIoctl(cache->drm_fd, DRM_IOCTL_GEM_CLOSE, &req);
+	}
+}
+
+static void drop_entry(struct fb_cache *cache, struct fb_cache_entry *e,
+		const uint32_t *handles, unsigned nhandles)
+{
+	drmModeRmFB(cache->drm_fd, e->fb_id);
+	close_handles(cache, e, handles, nhandles, e->handles, e->nplanes);
+	memset(e, 0, sizeof(*e));
+}
+
+int fb_cache_get(struct fb_cache *cache, const struct dmabuf_frame *frame,
+		uint32_t *fb_id)
+{
+	uint32_t handles[MAX_DMABUF_PLANES] = {0}, flags = 0;
+	uint64_t modifiers[MAX_DMABUF_PLANES] = {0};
+	uint64_t ino[MAX_DMABUF_PLANES] = {0};
+	struct fb_cache_entry *slot = NULL, *e;
+	struct stat st;
+	unsigned i;
+	int ret;
+
+	cache->lookups++;
+
+	for (i = 0; i < frame->nplanes; i++) {
+		if (fstat(frame->fd[i], &st)) {
+			printf("failed to stat dmabuf: %s\n", strerror(errno));
+			return -1;
+		}
+		ino[i] = st.st_ino;
+	}
+
+	e = cache->inodes_unique ? find_entry(cache, frame, NULL, ino) : NULL;
+	if (e) {
+		e->used = cache->lookups;
+		*fb_id = e->fb_id;
+		return 0;
+	}
+
+	/* a dmabuf imported before gives back the handle it already has: */
+	for (i = 0; i < frame->nplanes; i++) {
+		ret = drmPrimeFDToHandle(cache->drm_fd, frame->fd[i], &handles[i]);
+		if (ret) {
+			printf("failed to import dmabuf: %s\n", strerror(errno));
+			close_handles(cache, NULL, NULL, 0, handles, i);
+			return ret;
+		}
+	}
+
+	/* before the inodes can be trusted, or for a buffer exported again
+	 * as a new dmabuf:
+	 */
+	e = find_entry(cache, frame, handles, NULL);
+	if (e) {
+		memcpy(e->ino, ino, sizeof(ino));
+		e->used = cache->lookups;
+		*fb_id = e->fb_id;
+		return 0;
+	}
+
+	/* a new buffer, so make room, and drop whatever went out of use: */
+	for (i = 0; i < FB_CACHE_SIZE; i++) {
+		e = &cache->entries[i];
+
+		if (e->fb_id && cache->lookups - e->used > FB_CACHE_EXPIRE)
+			drop_entry(cache, e, handles, frame->nplanes);
+
+		if (!e->fb_id) {
+			if (!slot || slot->fb_id)
+				slot = e;
+		} else if (!slot || (slot->fb_id && e->used < slot->used)) {
+			slot = e;
+		}
+	}
+
+	if (slot->fb_id)
+		drop_entry(cache, slot, handles, frame->nplanes);
+
+	for (i = 0; i < frame->nplanes; i++) {
+		if (frame->modifier != DRM_FORMAT_MOD_INVALID) {
+			modifiers[i] = frame->modifier;
+			flags = DRM_MODE_FB_MODIFIERS;
+		}
+	}
+
+	ret = drmModeAddFB2WithModifiers(cache->drm_fd, frame->width, frame->height,
+			frame->format, handles, frame->pitch, frame->offset,
+			flags ? modifiers : NULL, &slot->fb_id, flags);
+	if (ret) {
+		printf("failed to create dmabuf fb: %s\n", strerror(errno));
+		slot->fb_id = 0;
+		close_handles(cache, NULL, NULL, 0, handles, frame->nplanes);
+		return ret;
+	}
+
+	memcpy(slot->handles, handles, sizeof(handles));
+	memcpy(slot->ino, ino, sizeof(ino));
+	slot->format = frame->format;
+	slot->width = frame->width;
+	slot->height = frame->height;
+	slot->modifier = frame->modifier;
+	slot->nplanes = frame->nplanes;
+	memcpy(slot->offset, frame->offset, sizeof(slot->offset));
+	memcpy(slot->pitch, frame->pitch, sizeof(slot->pitch));
+	slot->used = cache->lookups;
+	check_inodes(cache, slot);
+
+	*fb_id = slot->fb_id;
+
+	return 0;
+}
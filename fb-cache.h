@@ -0,0 +1,79 @@
+/*
+ * Copyright 2026 NXP
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sub license,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the
+ * next paragraph) shall be included in all copies or substantial portions
+ * of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT. IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+#ifndef _FB_CACHE_H
+#define _FB_CACHE_H
+
+#include <stdint.h>
+
+/*
+ * Framebuffers for imported dmabufs, such as decoded video frames scanned
+ * out on a plane.  Decoders cycle through a small pool of buffers, so
+ * each distinct buffer gets its fb created once, and after that every
+ * frame finds it here: the flip path stops adding (and removing) an fb
+ * per frame.
+ *
+ * Buffers are told apart by their GEM handles on the device, which the
+ * entry holds on to so a handle can't come back for another buffer, and
+ * by their layout.  Importing the dmabuf to get its handle is an ioctl,
+ * so once the dmabufs are known to have an inode each (kernels before
+ * 5.3 give them all the same one) a lookup first goes by the inodes of
+ * the planes' fds, and a hit takes just an fstat() per plane (dmabuf
+ * inode numbers are handed out from a counter, not reused).  An entry
+ * expires once it hasn't been looked up for FB_CACHE_EXPIRE frames, as
+ * happens to the buffers of a pool which was released, or when the cache
+ * is full the least recently used one goes.
+ * The last couple of fbs looked up (the ones on screen) are always kept.
+ *
+ * Needs common.h for struct dmabuf_frame.
+ */
+
+#define FB_CACHE_SIZE   16
+#define FB_CACHE_EXPIRE 120
+
+struct fb_cache_entry {
+	uint32_t fb_id;           /* 0 if the entry is free */
+	uint32_t handles[MAX_DMABUF_PLANES];
+	uint64_t ino[MAX_DMABUF_PLANES];   /* of the dmabufs */
+	uint32_t format, width, height;
+	uint64_t modifier;
+	unsigned nplanes;
+	uint32_t offset[MAX_DMABUF_PLANES];
+	uint32_t pitch[MAX_DMABUF_PLANES];
+	uint64_t used;            /* the lookup it was last returned for */
+};
+
+struct fb_cache {
+	int drm_fd;
+	uint64_t lookups;
+	int inodes_unique;        /* seen two buffers with different inodes */
+	struct fb_cache_entry entries[FB_CACHE_SIZE];
+};
+
+void fb_cache_init(struct fb_cache *cache, int drm_fd);
+
+/* The fb for the frame, created on its first use.  Returns 0 on success: */
+int fb_cache_get(struct fb_cache *cache, const struct dmabuf_frame *frame,
+		uint32_t *fb_id);
+
+#endif /* _FB_CACHE_H */
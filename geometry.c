@@ -0,0 +1,183 @@
+/*
+ * Copyright 2026 NXP
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sub license,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the
+ * next paragraph) shall be included in all copies or substantial portions
+ * of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT. IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "common.h"
+#include "geometry.h"
+
+struct cube_vertex {
+	GLbyte position[4];
+	GLbyte normal[4];
+	GLubyte color[4];
+	GLubyte texcoord[4];
+};
+
+/* each face as a triangle strip: */
+static const GLbyte positions[CUBE_VERTICES][3] = {
+		// front
+		{ -1, -1, +1 }, { +1, -1, +1 }, { -1, +1, +1 }, { +1, +1, +1 },
+		// back
+		{ +1, -1, -1 }, { -1, -1, -1 }, { +1, +1, -1 }, { -1, +1, -1 },
+		// right
+		{ +1, -1, +1 }, { +1, -1, -1 }, { +1, +1, +1 }, { +1, +1, -1 },
+		// left
+		{ -1, -1, -1 }, { -1, -1, +1 }, { -1, +1, -1 }, { -1, +1, +1 },
+		// top
+		{ -1, +1, +1 }, { +1, +1, +1 }, { -1, +1, -1 }, { +1, +1, -1 },
+		// bottom
+		{ -1, -1, -1 }, { +1, -1, -1 }, { -1, -1, +1 }, { +1, -1, +1 },
+};
+
+static const GLbyte normals[6][3] = {
+		{ +0, +0, +1 },  // forward
+		{ +0, +0, -1 },  // backward
+		{ +1, +0, +0 },  // right
+		{ -1, +0, +0 },  // left
+		{ +0, +1, +0 },  // up
+		{ +0, -1, +0 },  // down
+};
+
+/* video frames are upright on every face, the images are mirrored
+ * (and upside down on the bottom face):
+ */
+static const GLubyte video_texcoords[4][2] = {
+		{ 0, 1 }, { 1, 1 }, { 0, 0 }, { 1, 0 },
+};
+
+/* each face's strip as two triangles, with the same winding: */
+static const GLushort face_indices[6] = { 0, 1, 2, 2, 1, 3 };
+
+static void init_vertex(struct cube_vertex *v, unsigned i,
+		enum cube_texcoords texcoords)
+{
+	unsigned face = i / 4;
+
+	for (unsigned c = 0; c < 3; c++) {
+		v->position[c] = positions[i][c];
+		v->normal[c] = normals[face][c];
+		/* the corner's position in the RGB cube: */
+		v->color[c] = positions[i][c] > 0 ? 255 : 0;
+	}
+	v->color[3] = 255;
+
+	v->texcoord[0] = video_texcoords[i % 4][0];
+	v->texcoord[1] = video_texcoords[i % 4][1];
+	/* for scenes with something different on each face: */
+	v->texcoord[2] = face;
+	if (texcoords == CUBE_TEXCOORDS_IMAGE) {
+		v->texcoord[0] = !v->texcoord[0];
+		if (face == 5)
+			v->texcoord[1] = !v->texcoord[1];
+	}
+}
+
+int cube_geometry_init(struct cube_geometry *geo, enum cube_texcoords texcoords,
+		unsigned copies)
+{
+	struct cube_vertex *vertices;
+	GLushort *indices;
+
+	/* the indices are 16 bit: */
+	if (!copies || copies * CUBE_VERTICES > 65536) {
+		printf("invalid cube count: %u\n", copies);
+		return -1;
+	}
+
+	vertices = malloc(copies * CUBE_VERTICES * sizeof(*vertices));
+	indices = malloc(copies * CUBE_INDICES * sizeof(*indices));
+	if (!vertices || !indices) {
+		printf("out of memory\n");
+		free(vertices);
+		free(indices);
+		return -1;
+	}
+
+	for (unsigned i = 0; i < CUBE_VERTICES; i++)
+		init_vertex(&vertices[i], i, texcoords);
+	for (unsigned i = CUBE_VERTICES; i < copies * CUBE_VERTICES; i++)
+		vertices[i] = vertices[i % CUBE_VERTICES];
+
+	for (unsigned i = 0; i < copies * CUBE_INDICES; i++)
+		indices[i] = (i / CUBE_INDICES) * CUBE_VERTICES +
+			(i / 6 % 6) * 4 + face_indices[i % 6];
+
+	geo->copies = copies;
+
+	glGenBuffers(1, &geo->vbo);
+	glBindBuffer(GL_ARRAY_BUFFER, geo->vbo);
+	glBufferData(GL_ARRAY_BUFFER, copies * CUBE_VERTICES * sizeof(*vertices),
+			vertices, GL_STATIC_DRAW);
+
+	glGenBuffers(1, &geo->ibo);
+	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, geo->ibo);
+	glBufferData(GL_ELEMENT_ARRAY_BUFFER, copies * CUBE_INDICES * sizeof(*indices),
+			indices, GL_STATIC_DRAW);
+
+	free(vertices);
+	free(indices);
+
+	cube_geometry_bind(geo);
+
+	return 0;
+}
+
+void cube_geometry_bind_attribs(GLuint program)
+{
+	bind_attrib_location(program, CUBE_ATTRIB_POSITION, "in_position");
+	bind_attrib_location(program, CUBE_ATTRIB_NORMAL, "in_normal");
+	bind_attrib_location(program, CUBE_ATTRIB_COLOR, "in_color");
+	bind_attrib_location(program, CUBE_ATTRIB_TEXCOORD, "in_TexCoord");
+}
+
+void cube_geometry_bind(const struct cube_geometry *geo)
+{
+	const GLsizei stride = sizeof(struct cube_vertex);
+
+	glBindBuffer(GL_ARRAY_BUFFER, geo->vbo);
+	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, geo->ibo);
+
+	glVertexAttribPointer(CUBE_ATTRIB_POSITION, 3, GL_BYTE, GL_FALSE, stride,
+			(const GLvoid *)offsetof(struct cube_vertex, position));
+	glEnableVertexAttribArray(CUBE_ATTRIB_POSITION);
+	glVertexAttribPointer(CUBE_ATTRIB_NORMAL, 3, GL_BYTE, GL_FALSE, stride,
+			(const GLvoid *)offsetof(struct cube_vertex, normal));
+	glEnableVertexAttribArray(CUBE_ATTRIB_NORMAL);
+	glVertexAttribPointer(CUBE_ATTRIB_COLOR, 4, GL_UNSIGNED_BYTE, GL_TRUE, stride,
+			(const GLvoid *)offsetof(struct cube_vertex, color));
+	glEnableVertexAttribArray(CUBE_ATTRIB_COLOR);
+	glVertexAttribPointer(CUBE_ATTRIB_TEXCOORD, 3, GL_UNSIGNED_BYTE, GL_FALSE, stride,
+			(const GLvoid *)offsetof(struct cube_vertex, texcoord));
+	glEnableVertexAttribArray(CUBE_ATTRIB_TEXCOORD);
+}
+
+void cube_geometry_draw(const struct cube_geometry *geo, unsigned copies)
+{
+	if (copies > geo->copies)
+		copies = geo->copies;
+
+	glDrawElements(GL_TRIANGLES, copies * CUBE_INDICES, GL_UNSIGNED_SHORT, 0);
+}
+
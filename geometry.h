@@ -0,0 +1,79 @@
+/*
+ * Copyright 2026 NXP
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sub license,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the
+ * next paragraph) shall be included in all copies or substantial portions
+ * of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT. IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+#ifndef _GEOMETRY_H
+#define _GEOMETRY_H
+
+#include <GLES2/gl2.h>
+
+/*
+ * The cube every scene draws, as one interleaved vertex buffer and an
+ * index buffer of triangles.  Vertices are 16 bytes: every attribute is
+ * a 4 byte aligned vector of bytes, which GLES2 converts exactly (the
+ * positions, normals and texcoords are all -1, 0 or 1), so vertex fetch
+ * is a quarter of what planar float arrays cost.
+ */
+
+#define CUBE_VERTICES 24
+#define CUBE_INDICES  36
+
+/* attribute locations, bound by cube_geometry_bind_attribs(): */
+enum cube_attrib {
+	CUBE_ATTRIB_POSITION,     /* in_position */
+	CUBE_ATTRIB_NORMAL,       /* in_normal */
+	CUBE_ATTRIB_COLOR,        /* in_color */
+	CUBE_ATTRIB_TEXCOORD,     /* in_TexCoord, with the face index in z */
+	CUBE_ATTRIB_COUNT         /* first free location for the scene's own */
+};
+
+/* The texture orientation on each face, which differs between the
+ * embedded images and decoded video frames:
+ */
+enum cube_texcoords {
+	CUBE_TEXCOORDS_IMAGE,
+	CUBE_TEXCOORDS_VIDEO,
+};
+
+struct cube_geometry {
+	GLuint vbo, ibo;
+	unsigned copies;
+};
+
+/* Upload 'copies' cubes back to back (for scenes batching several into
+ * one draw), and set up the attribute arrays for them.  The first four
+ * vertices are the front face as a triangle strip, usable as a full
+ * screen quad.
+ */
+int cube_geometry_init(struct cube_geometry *geo, enum cube_texcoords texcoords,
+		unsigned copies);
+
+/* Bind the attribute names above to their locations, before linking: */
+void cube_geometry_bind_attribs(GLuint program);
+
+/* Rebind the buffers and attribute arrays, after drawing something else: */
+void cube_geometry_bind(const struct cube_geometry *geo);
+
+/* Draw the first 'copies' cubes: */
+void cube_geometry_draw(const struct cube_geometry *geo, unsigned copies);
+
+#endif /* _GEOMETRY_H */
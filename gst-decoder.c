@@ -22,14 +22,24 @@
  * DEALINGS IN THE SOFTWARE.
  */
 
+#define _GNU_SOURCE
+
 #include <assert.h>
+#include <errno.h>
 #include <pthread.h>
+#include <semaphore.h>
+#include <stdatomic.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <unistd.h>
+#include <linux/dma-buf.h>
+#include <sys/ioctl.h>
+#include <sys/mman.h>
 
 #include "common.h"
+#include "stats.h"
+#include "upload.h"
 
 #include <drm_fourcc.h>
 
@@ -39,23 +49,77 @@
 #include <gst/allocators/gstdmabuf.h>
 #include <gst/app/gstappsink.h>
 #include <gst/video/gstvideometa.h>
+#include <gst/video/gstvideopool.h>
 
 GST_DEBUG_CATEGORY_EXTERN(kmscube_debug);
 #define GST_CAT_DEFAULT kmscube_debug
 
 #define MAX_NUM_PLANES 3
 
+/* Number of decoded frames that can be queued up between the GStreamer
+ * streaming thread and the render loop, must be a power of two:
+ */
+#define FRAME_QUEUE_SIZE 4
+
+/* Frames copied out of system memory can be queued, current, or held for
+ * scanout, plus the one being copied into:
+ */
+#define UPLOAD_POOL_SIZE (FRAME_QUEUE_SIZE + MAX_SWAP_DEPTH + 2)
+
+/* row length of the R8 BOs used as plain linear buffers: */
+#define LINEAR_BO_WIDTH 4096
+
 inline static const char *
 yesno(int yes)
 {
 	return yes ? "yes" : "no";
 }
 
+struct frame {
+	GstSample          *samp;
+	EGLImage            image;
+	gboolean            cached;
+	gboolean            is_dmabuf;
+	struct dmabuf_frame dmabuf;
+	struct upload_buf  *upload;    /* copied into, unless NULL */
+};
+
+/* EGLImage imported from a dmabuf GstMemory.  It is attached to the memory
+ * as qdata, so it lives exactly as long as the decoder's buffer does, and
+ * a decoder cycling through a fixed pool of dmabufs only pays for the
+ * import once per buffer.  The layout it was created with is kept so that
+ * a caps change which re-uses the same memory invalidates the image:
+ */
+struct cached_image {
+	const struct egl   *egl;
+	EGLImage            image;
+	uint32_t            format;
+	guint               width, height, nplanes;
+	int                 offset[MAX_NUM_PLANES];
+	int                 stride[MAX_NUM_PLANES];
+};
+
+/* Linear BO which frames from system memory get copied into, when the
+ * decoder didn't take our buffer pool.  Both the mapping and the
+ * EGLImage are kept around, for the buffer to be recycled:
+ */
+struct upload_buf {
+	atomic_int          busy;
+	int                 fd;          /* dmabuf, -1 until allocated */
+	size_t              size;
+	void               *map;
+	struct cached_image image;       /* image is NULL until imported */
+};
+
 struct decoder {
-	GMainLoop          *loop;
 	GstElement         *pipeline;
 	GstElement         *sink;
-	pthread_t           gst_thread;
+
+	/* the bus watch on the shared worker, and a semaphore posted once
+	 * it is gone (and its callback is no longer running):
+	 */
+	GSource            *bus_watch;
+	sem_t               bus_watch_done;
 
 	uint32_t            format;
 	GstVideoInfo        info;
@@ -64,10 +128,69 @@ struct decoder {
 	const struct egl   *egl;
 	unsigned            frame;
 
-	EGLImage            last_frame;
-	GstSample          *last_samp;
+	struct frame        last;
+
+	/* When the frames are scanned out directly, the display still uses
+	 * the previous frames while they wait in the swap chain, on screen
+	 * or queued to be flipped to, so they are held on to a bit longer:
+	 */
+	gboolean            scanout;
+	struct frame        held[MAX_SWAP_DEPTH];
+
+	/* ring of imported frames, written by the appsink streaming thread
+	 * and read by the render loop.  Both take frames off the tail, the
+	 * streaming thread when it is full, see claim_frame():
+	 */
+	struct frame        frames[FRAME_QUEUE_SIZE];
+	atomic_uint         head, tail;
+	atomic_int          eos;
+	atomic_int          prerolled;
+
+	/* frames dropped because we fell behind, and frames where no new
+	 * frame was ready so the previous one was shown again:
+	 */
+	atomic_uint         dropped;
+	unsigned            repeated;
+
+	struct upload_buf   uploads[UPLOAD_POOL_SIZE];
 };
 
+static GQuark
+cached_image_quark(void)
+{
+	static GQuark quark;
+
+	if (!quark)
+		quark = g_quark_from_static_string("kmscube-eglimage");
+
+	return quark;
+}
+
+static void
+cached_image_free(gpointer data)
+{
+	struct cached_image *cached = data;
+
+	cached->egl->eglDestroyImageKHR(cached->egl->display, cached->image);
+	free(cached);
+}
+
+/* The DRM format for the video, or 0 if we can't handle it: */
+static uint32_t
+drm_format(const GstVideoInfo *info)
+{
+	switch (GST_VIDEO_INFO_FORMAT(info)) {
+	case GST_VIDEO_FORMAT_I420:
+		return DRM_FORMAT_YUV420;
+	case GST_VIDEO_FORMAT_NV12:
+		return DRM_FORMAT_NV12;
+	case GST_VIDEO_FORMAT_YUY2:
+		return DRM_FORMAT_YUYV;
+	default:
+		return 0;
+	}
+}
+
 static GstPadProbeReturn
 pad_probe(GstPad *pad, GstPadProbeInfo *info, gpointer user_data)
 {
@@ -92,43 +215,81 @@ pad_probe(GstPad *pad, GstPadProbeInfo *info, gpointer user_data)
 		return GST_PAD_PROBE_OK;
 	}
 
-	switch (GST_VIDEO_INFO_FORMAT(&(dec->info))) {
-	case GST_VIDEO_FORMAT_I420:
-		dec->format = DRM_FORMAT_YUV420;
-		break;
-	case GST_VIDEO_FORMAT_NV12:
-		dec->format = DRM_FORMAT_NV12;
-		break;
-	case GST_VIDEO_FORMAT_YUY2:
-		dec->format = DRM_FORMAT_YUYV;
-		break;
-	default:
+	dec->format = drm_format(&dec->info);
+	if (!dec->format)
 		GST_ERROR("unknown format\n");
-		return GST_PAD_PROBE_OK;
-	}
 
 	return GST_PAD_PROBE_OK;
 }
 
+/* The part of the pipeline in front of the appsink, with the file name
+ * set as the "location" of the element named "src", if there is one:
+ */
+static const char *pipeline_desc = "filesrc name=\"src\" ! decodebin";
+
+/*
+ * One thread running the bus watches of every decoder, rather than a
+ * GMainLoop each: with several streams (and the next entry prerolling
+ * on top) those would just be threads waking up for the odd message.
+ */
+static struct {
+	pthread_mutex_t     lock;
+	unsigned            refs;
+	GMainContext       *context;
+	GMainLoop          *loop;
+	pthread_t           thread;
+} worker = { .lock = PTHREAD_MUTEX_INITIALIZER };
+
 static void *
-gst_thread_func(void *args)
+worker_thread_func(void *args)
 {
-	struct decoder *dec = args;
-	g_main_loop_run(dec->loop);
+	(void)args;
+
+	g_main_context_push_thread_default(worker.context);
+	g_main_loop_run(worker.loop);
+	g_main_context_pop_thread_default(worker.context);
+
 	return NULL;
 }
 
+static GMainContext *
+worker_get(void)
+{
+	pthread_mutex_lock(&worker.lock);
+	if (!worker.refs++) {
+		worker.context = g_main_context_new();
+		worker.loop = g_main_loop_new(worker.context, FALSE);
+		pthread_create(&worker.thread, NULL, worker_thread_func, NULL);
+	}
+	pthread_mutex_unlock(&worker.lock);
+
+	return worker.context;
+}
+
 static void
-element_added_cb(GstBin *bin, GstElement *element, gpointer user_data)
+worker_put(void)
 {
-	GstElementFactory *elem_factory;
-	gchar const *factory_name;
+	pthread_mutex_lock(&worker.lock);
+	if (!--worker.refs) {
+		g_main_loop_quit(worker.loop);
+		pthread_join(worker.thread, NULL);
+		g_main_loop_unref(worker.loop);
+		g_main_context_unref(worker.context);
+	}
+	pthread_mutex_unlock(&worker.lock);
+}
 
-	(void)user_data;
-	(void)bin;
+static void
+setup_decoder(GstElement *element)
+{
+	GstElementFactory *elem_factory;
+	gchar const *factory_name, *klass;
 
 	elem_factory = gst_element_get_factory(element);
+	if (!elem_factory)
+		return;
 	factory_name = gst_plugin_feature_get_name(elem_factory);
+	klass = gst_element_factory_get_metadata(elem_factory, GST_ELEMENT_METADATA_KLASS);
 
 	GST_DEBUG("added element %s (created with factory %s)", GST_OBJECT_NAME(element), factory_name);
 
@@ -139,9 +300,149 @@ element_added_cb(GstBin *bin, GstElement *element, gpointer user_data)
 		/* yes, "capture" rather than "output" because v4l2 is bonkers */
 		gst_util_set_object_arg(G_OBJECT(element), "capture-io-mode", "dmabuf");
 		printf("found GStreamer V4L2 video decoder element with name \"%s\"\n", GST_OBJECT_NAME(element));
+	} else if (klass && strstr(klass, "Decoder") && strstr(klass, "Hardware")) {
+		/* vpudec, the v4l2 stateless decoders..., which hand out
+		 * dmabufs by themselves:
+		 */
+		printf("found GStreamer hardware video decoder element with name \"%s\"\n", GST_OBJECT_NAME(element));
 	}
 }
 
+/* Elements decodebin (or any other bin in the pipeline) adds later on: */
+static void
+element_added_cb(GstBin *bin, GstBin *sub_bin, GstElement *element, gpointer user_data)
+{
+	(void)user_data;
+	(void)sub_bin;
+	(void)bin;
+
+	setup_decoder(element);
+}
+
+static void
+setup_decoder_cb(const GValue *value, gpointer user_data)
+{
+	(void)user_data;
+
+	setup_decoder(g_value_get_object(value));
+}
+
+/* The whole pipeline for 'desc', with the appsink the frames come out of.
+ * gst_parse_launch() may also return a partial pipeline (eg. with some
+ * elements left unlinked) along with a recoverable error, which counts
+ * as a failure here too:
+ */
+static GstElement *
+parse_pipeline(const char *desc)
+{
+	GstElement *pipeline;
+	GError *error = NULL;
+	gchar *full;
+
+	full = g_strdup_printf("%s ! video/x-raw ! appsink sync=true name=\"sink\"",
+			desc);
+	pipeline = gst_parse_launch(full, &error);
+	g_free(full);
+
+	if (!pipeline || error) {
+		printf("invalid video pipeline \"%s\": %s\n", desc,
+				error ? error->message : "unknown error");
+		g_clear_error(&error);
+		if (pipeline)
+			gst_object_unref(pipeline);
+		return NULL;
+	}
+
+	return pipeline;
+}
+
+int
+video_set_pipeline(const char *desc)
+{
+	GstElement *pipeline;
+
+	/* catch a broken description up front, rather than per file: */
+	pipeline = parse_pipeline(desc);
+	if (!pipeline)
+		return -1;
+	gst_object_unref(pipeline);
+
+	pipeline_desc = desc;
+
+	return 0;
+}
+
+static int
+parse_rank(const char *s, guint *rank)
+{
+	static const struct {
+		const char *name;
+		guint rank;
+	} ranks[] = {
+		{ "none", GST_RANK_NONE },
+		{ "marginal", GST_RANK_MARGINAL },
+		{ "secondary", GST_RANK_SECONDARY },
+		{ "primary", GST_RANK_PRIMARY },
+		/* above anything a plugin registers itself with: */
+		{ "max", GST_RANK_PRIMARY + 256 },
+	};
+	char *end;
+	unsigned i;
+
+	for (i = 0; i < G_N_ELEMENTS(ranks); i++) {
+		if (!strcmp(s, ranks[i].name)) {
+			*rank = ranks[i].rank;
+			return 0;
+		}
+	}
+
+	*rank = strtoul(s, &end, 0);
+
+	return (*s && !*end) ? 0 : -1;
+}
+
+int
+video_set_ranks(const char *ranks)
+{
+	char *list = strdup(ranks), *save = NULL, *s;
+	int ret = 0;
+
+	for (s = strtok_r(list, ",", &save); s; s = strtok_r(NULL, ",", &save)) {
+		GstPluginFeature *feature;
+		char *rank = strchr(s, ':');
+		guint value;
+
+		if (!rank || parse_rank(rank + 1, &value)) {
+			printf("invalid decoder rank \"%s\", expected NAME:RANK\n", s);
+			ret = -1;
+			break;
+		}
+		*rank = '\0';
+
+		feature = gst_registry_lookup_feature(gst_registry_get(), s);
+		if (!feature) {
+			printf("no GStreamer element \"%s\"\n", s);
+			ret = -1;
+			break;
+		}
+
+		gst_plugin_feature_set_rank(feature, value);
+		gst_object_unref(feature);
+	}
+
+	free(list);
+
+	return ret;
+}
+
+static void
+bus_watch_destroy(gpointer user_data)
+{
+	struct decoder *dec = user_data;
+
+	sem_post(&dec->bus_watch_done);
+}
+
 static gboolean
 bus_watch_cb(GstBus *bus, GstMessage *msg, gpointer user_data)
 {
@@ -161,6 +462,12 @@ bus_watch_cb(GstBus *bus, GstMessage *msg, gpointer user_data)
 
 		gst_message_parse_state_changed(msg, &old_gst_state, &cur_gst_state, &pending_gst_state);
 
+		if (cur_gst_state == GST_STATE_PAUSED && old_gst_state == GST_STATE_READY)
+			stats_startup("video preroll");
+
+		if (!verbose)
+			break;
+
 		printf(
 			"GStreamer state change:  old: %s  current: %s  pending: %s\n",
 			gst_element_state_get_name(old_gst_state),
@@ -223,12 +530,14 @@ bus_watch_cb(GstBus *bus, GstMessage *msg, gpointer user_data)
 		g_clear_error(&error);
 		g_free(debug_info);
 
+		/* nothing more is coming, so treat it like the end of the
+		 * stream, for the playlist to move on:
+		 */
 		if (GST_MESSAGE_TYPE(msg) == GST_MESSAGE_ERROR) {
 			GST_DEBUG_BIN_TO_DOT_FILE_WITH_TS(GST_BIN(dec->pipeline), GST_DEBUG_GRAPH_SHOW_ALL, "error");
+			atomic_store_explicit(&dec->eos, 1, memory_order_release);
 		}
 
-		// TODO: stop mainloop in case of an error
-
 		break;
 	}
 	default:
@@ -238,53 +547,232 @@ bus_watch_cb(GstBus *bus, GstMessage *msg, gpointer user_data)
 	return TRUE;
 }
 
+/* Allocate a linear buffer of at least 'size' bytes, which the GPU can
+ * import (and KMS scan out), returning its dmabuf fd.  Its actual size
+ * is returned in 'alloc_size':
+ */
+static int
+alloc_dmabuf(const struct gbm *gbm, size_t size, size_t *alloc_size)
+{
+	uint32_t rows = (size + LINEAR_BO_WIDTH - 1) / LINEAR_BO_WIDTH;
+	struct gbm_bo *bo;
+	int fd;
+
+	/* NOTE: do not actually use GBM_BO_USE_WRITE since that gets us a dumb buffer.
+	 * Ask for scanout too, for the plane path to be able to use the frames,
+	 * but settle for linear only where the driver won't combine the two:
+	 */
+	bo = gbm_bo_create(gbm->dev, LINEAR_BO_WIDTH, rows, GBM_FORMAT_R8,
+			GBM_BO_USE_LINEAR | GBM_BO_USE_SCANOUT);
+	if (!bo)
+		bo = gbm_bo_create(gbm->dev, LINEAR_BO_WIDTH, rows, GBM_FORMAT_R8,
+				GBM_BO_USE_LINEAR);
+	if (!bo)
+		return -1;
+
+	fd = gbm_bo_get_fd(bo);
+	*alloc_size = (size_t)gbm_bo_get_stride(bo) * rows;
+
+	/* we have the fd now, no longer need the bo: */
+	gbm_bo_destroy(bo);
+
+	return fd;
+}
+
+/*
+ * Buffer pool offered upstream in the allocation query, so that software
+ * decoders write their frames straight into dmabufs from our gbm device
+ * instead of system memory.  The frames can then be imported (and
+ * scanned out) like the ones from a hardware decoder, without a copy.
+ */
+typedef struct {
+	GstBufferPool       parent;
+	const struct gbm   *gbm;
+	GstAllocator       *allocator;
+	GstVideoInfo        info;
+} KmscubeGbmPool;
+
+typedef struct {
+	GstBufferPoolClass  parent_class;
+} KmscubeGbmPoolClass;
+
+G_DEFINE_TYPE(KmscubeGbmPool, kmscube_gbm_pool, GST_TYPE_BUFFER_POOL)
+
+static const gchar **
+gbm_pool_get_options(GstBufferPool *pool)
+{
+	static const gchar *options[] = { GST_BUFFER_POOL_OPTION_VIDEO_META, NULL };
+
+	(void)pool;
+
+	return options;
+}
+
+static gboolean
+gbm_pool_set_config(GstBufferPool *pool, GstStructure *config)
+{
+	KmscubeGbmPool *self = (KmscubeGbmPool *)pool;
+	GstCaps *caps;
+	guint size, min, max;
+
+	if (!gst_buffer_pool_config_get_params(config, &caps, &size, &min, &max) ||
+			!caps || !gst_video_info_from_caps(&self->info, caps) ||
+			!drm_format(&self->info))
+		return FALSE;
+
+	gst_buffer_pool_config_set_params(config, caps,
+			MAX(size, GST_VIDEO_INFO_SIZE(&self->info)), min, max);
+
+	return GST_BUFFER_POOL_CLASS(kmscube_gbm_pool_parent_class)->set_config(pool, config);
+}
+
+static GstFlowReturn
+gbm_pool_alloc_buffer(GstBufferPool *pool, GstBuffer **buffer,
+		GstBufferPoolAcquireParams *params)
+{
+	KmscubeGbmPool *self = (KmscubeGbmPool *)pool;
+	GstVideoInfo *info = &self->info;
+	size_t alloc_size;
+	int fd;
+
+	(void)params;
+
+	fd = alloc_dmabuf(self->gbm, GST_VIDEO_INFO_SIZE(info), &alloc_size);
+	if (fd < 0) {
+		GST_ERROR("could not allocate a gbm buffer");
+		return GST_FLOW_ERROR;
+	}
+
+	/* the memory takes over the fd: */
+	*buffer = gst_buffer_new();
+	gst_buffer_append_memory(*buffer, gst_dmabuf_allocator_alloc(self->allocator,
+			fd, GST_VIDEO_INFO_SIZE(info)));
+	gst_buffer_add_video_meta_full(*buffer, GST_VIDEO_FRAME_FLAG_NONE,
+			GST_VIDEO_INFO_FORMAT(info), GST_VIDEO_INFO_WIDTH(info),
+			GST_VIDEO_INFO_HEIGHT(info), GST_VIDEO_INFO_N_PLANES(info),
+			info->offset, info->stride);
+
+	GST_DEBUG("allocated gbm buffer of %zu bytes", alloc_size);
+
+	return GST_FLOW_OK;
+}
+
+static void
+gbm_pool_finalize(GObject *object)
+{
+	KmscubeGbmPool *self = (KmscubeGbmPool *)object;
+
+	gst_object_unref(self->allocator);
+
+	G_OBJECT_CLASS(kmscube_gbm_pool_parent_class)->finalize(object);
+}
+
+static void
+kmscube_gbm_pool_class_init(KmscubeGbmPoolClass *klass)
+{
+	GstBufferPoolClass *pool_class = (GstBufferPoolClass *)klass;
+
+	G_OBJECT_CLASS(klass)->finalize = gbm_pool_finalize;
+	pool_class->get_options = gbm_pool_get_options;
+	pool_class->set_config = gbm_pool_set_config;
+	pool_class->alloc_buffer = gbm_pool_alloc_buffer;
+}
+
+static void
+kmscube_gbm_pool_init(KmscubeGbmPool *self)
+{
+	self->allocator = gst_dmabuf_allocator_new();
+}
+
 static GstPadProbeReturn
 appsink_query_cb(GstPad *pad G_GNUC_UNUSED, GstPadProbeInfo *info,
-	gpointer user_data G_GNUC_UNUSED)
+	gpointer user_data)
 {
+	struct decoder *dec = user_data;
 	GstQuery *query = info->data;
+	GstVideoInfo vinfo;
+	GstCaps *caps;
 
 	if (GST_QUERY_TYPE (query) != GST_QUERY_ALLOCATION)
 	  return GST_PAD_PROBE_OK;
 
 	gst_query_add_allocation_meta(query, GST_VIDEO_META_API_TYPE, NULL);
 
+	gst_query_parse_allocation(query, &caps, NULL);
+	if (caps && gst_video_info_from_caps(&vinfo, caps) && drm_format(&vinfo)) {
+		KmscubeGbmPool *pool = g_object_new(kmscube_gbm_pool_get_type(), NULL);
+		GstStructure *config;
+
+		gst_object_ref_sink(pool);
+		pool->gbm = dec->gbm;
+
+		/* no upper limit, the frames are held on to for a while: */
+		config = gst_buffer_pool_get_config(GST_BUFFER_POOL(pool));
+		gst_buffer_pool_config_set_params(config, caps, vinfo.size, 0, 0);
+		gst_buffer_pool_config_add_option(config, GST_BUFFER_POOL_OPTION_VIDEO_META);
+		if (gst_buffer_pool_set_config(GST_BUFFER_POOL(pool), config))
+			gst_query_add_allocation_pool(query, GST_BUFFER_POOL(pool),
+					vinfo.size, 0, 0);
+		gst_object_unref(pool);
+	}
+
 	return GST_PAD_PROBE_HANDLED;
 }
 
+static void appsink_eos_cb(GstAppSink *appsink, gpointer user_data);
+static GstFlowReturn appsink_new_preroll_cb(GstAppSink *appsink, gpointer user_data);
+static GstFlowReturn appsink_new_sample_cb(GstAppSink *appsink, gpointer user_data);
+
 struct decoder *
 video_init(const struct egl *egl, const struct gbm *gbm, const char *filename)
 {
 	struct decoder *dec;
-	GstElement *src, *decodebin;
+	GstElement *src;
+	GstIterator *it;
+	unsigned i;
 	GstPad *pad;
 	GstBus *bus;
 
 	dec = calloc(1, sizeof(*dec));
-	dec->loop = g_main_loop_new(NULL, FALSE);
 	dec->gbm = gbm;
 	dec->egl = egl;
+	for (i = 0; i < UPLOAD_POOL_SIZE; i++)
+		dec->uploads[i].fd = -1;
 
-	/* Setup pipeline: */
-	static const char *pipeline =
-		"filesrc name=\"src\" ! decodebin name=\"decode\" ! video/x-raw ! appsink sync=false name=\"sink\"";
-	dec->pipeline = gst_parse_launch(pipeline, NULL);
+	/* Setup pipeline.  The sink is synchronized against the clock, the
+	 * render loop just picks up whatever frame is current at the time:
+	 */
+	static GstAppSinkCallbacks appsink_callbacks = {
+		.eos = appsink_eos_cb,
+		.new_preroll = appsink_new_preroll_cb,
+		.new_sample = appsink_new_sample_cb,
+	};
+	dec->pipeline = parse_pipeline(pipeline_desc);
+	if (!dec->pipeline) {
+		free(dec);
+		return NULL;
+	}
 
 	dec->sink = gst_bin_get_by_name(GST_BIN(dec->pipeline), "sink");
+	gst_app_sink_set_callbacks(GST_APP_SINK(dec->sink), &appsink_callbacks, dec, NULL);
 
 	/* Implement the allocation query using a pad probe. This probe will
 	 * adverstize support for GstVideoMeta, which avoid hardware accelerated
 	 * decoder that produce special strides and offsets from having to
-	 * copy the buffers.
+	 * copy the buffers, and offer software decoders our gbm buffer pool.
 	 */
 	pad = gst_element_get_static_pad(dec->sink, "sink");
 	gst_pad_add_probe(pad, GST_PAD_PROBE_TYPE_QUERY_DOWNSTREAM,
-		appsink_query_cb, NULL, NULL);
+		appsink_query_cb, dec, NULL);
 	gst_object_unref(pad);
 
+	/* a pipeline for something other than files may not have one: */
 	src = gst_bin_get_by_name(GST_BIN(dec->pipeline), "src");
-	g_object_set(G_OBJECT(src), "location", filename, NULL);
-	gst_object_unref(src);
+	if (src) {
+		if (g_object_class_find_property(G_OBJECT_GET_CLASS(src), "location"))
+			g_object_set(G_OBJECT(src), "location", filename, NULL);
+		gst_object_unref(src);
+	}
 
 	/* Configure the sink like a video sink (mimic GstVideoSink) */
 	gst_base_sink_set_max_lateness(GST_BASE_SINK(dec->sink), 20 * GST_MSECOND);
@@ -299,75 +787,99 @@ video_init(const struct egl *egl, const struct gbm *gbm, const char *filename)
 			GST_PAD_PROBE_TYPE_EVENT_DOWNSTREAM,
 			pad_probe, dec, NULL);
 
-	/* callback needed to make sure we get dmabuf's from v4l2videoNdec.. */
-	decodebin = gst_bin_get_by_name(GST_BIN(dec->pipeline), "decode");
-	g_signal_connect(decodebin, "element-added", G_CALLBACK(element_added_cb), dec);
+	/* needed to make sure we get dmabuf's from v4l2videoNdec, whether
+	 * it is in the pipeline description or decodebin plugs it later:
+	 */
+	it = gst_bin_iterate_recurse(GST_BIN(dec->pipeline));
+	gst_iterator_foreach(it, setup_decoder_cb, NULL);
+	gst_iterator_free(it);
+	g_signal_connect(dec->pipeline, "deep-element-added", G_CALLBACK(element_added_cb), dec);
 
 	/* add bus to be able to receive error message, handle latency
 	 * requests, produce pipeline dumps, etc. */
+	sem_init(&dec->bus_watch_done, 0, 0);
 	bus = gst_pipeline_get_bus(GST_PIPELINE(dec->pipeline));
-	gst_bus_add_watch(bus, bus_watch_cb, dec);
+	dec->bus_watch = gst_bus_create_watch(bus);
+	g_source_set_callback(dec->bus_watch, G_SOURCE_FUNC(bus_watch_cb), dec,
+			bus_watch_destroy);
+	g_source_attach(dec->bus_watch, worker_get());
 	gst_object_unref(GST_OBJECT(bus));
 
-	/* let 'er rip! */
-	gst_element_set_state(dec->pipeline, GST_STATE_PLAYING);
-
-	pthread_create(&dec->gst_thread, NULL, gst_thread_func, dec);
+	/* decode up to the first frame, and wait there for video_play(): */
+	gst_element_set_state(dec->pipeline, GST_STATE_PAUSED);
 
 	return dec;
 }
 
-static void
-set_last_frame(struct decoder *dec, EGLImage frame, GstSample *samp)
+/* The first frame is decoded, so video_play() shows it right away: */
+int
+video_prerolled(struct decoder *dec)
 {
-	if (dec->last_frame)
-		dec->egl->eglDestroyImageKHR(dec->egl->display, dec->last_frame);
-	dec->last_frame = frame;
-	if (dec->last_samp)
-		gst_sample_unref(dec->last_samp);
-	dec->last_samp = samp;
+	return atomic_load_explicit(&dec->prerolled, memory_order_acquire);
 }
 
-// TODO this could probably be a helper re-used by cube-tex:
-static int
-buf_to_fd(const struct gbm *gbm, int size, void *ptr)
+void
+video_play(struct decoder *dec)
 {
-	struct gbm_bo *bo;
-	void *map, *map_data = NULL;
-	uint32_t stride;
-	int fd;
+	/* let 'er rip! */
+	gst_element_set_state(dec->pipeline, GST_STATE_PLAYING);
+}
 
-	/* NOTE: do not actually use GBM_BO_USE_WRITE since that gets us a dumb buffer: */
-	bo = gbm_bo_create(gbm->dev, size, 1, GBM_FORMAT_R8, GBM_BO_USE_LINEAR);
+int64_t
+video_remaining(struct decoder *dec)
+{
+	gint64 position, duration;
 
-	map = gbm_bo_map(bo, 0, 0, size, 1, GBM_BO_TRANSFER_WRITE, &stride, &map_data);
+	if (!gst_element_query_position(dec->pipeline, GST_FORMAT_TIME, &position) ||
+			!gst_element_query_duration(dec->pipeline, GST_FORMAT_TIME, &duration) ||
+			duration <= 0)
+		return -1;
 
-	memcpy(map, ptr, size);
+	return duration > position ? duration - position : 0;
+}
 
-	gbm_bo_unmap(bo, map_data);
+static void
+release_frame(struct decoder *dec, struct frame *frame)
+{
+	/* cached images are owned by the GstMemory they were imported from: */
+	if (frame->image && !frame->cached)
+		dec->egl->eglDestroyImageKHR(dec->egl->display, frame->image);
+	if (frame->upload)
+		atomic_store_explicit(&frame->upload->busy, 0, memory_order_release);
+	if (frame->samp)
+		gst_sample_unref(frame->samp);
+	memset(frame, 0, sizeof(*frame));
+}
 
-	fd = gbm_bo_get_fd(bo);
+/* Takes ownership of frame's contents, or just drops the last frame if
+ * frame is NULL:
+ */
+static void
+set_last_frame(struct decoder *dec, struct frame *frame)
+{
+	if (dec->scanout) {
+		unsigned i;
 
-	/* we have the fd now, no longer need the bo: */
-	gbm_bo_destroy(bo);
+		release_frame(dec, &dec->held[MAX_SWAP_DEPTH - 1]);
+		for (i = MAX_SWAP_DEPTH - 1; i > 0; i--)
+			dec->held[i] = dec->held[i - 1];
+		dec->held[0] = dec->last;
+	} else {
+		release_frame(dec, &dec->last);
+	}
 
-	return fd;
+	if (frame) {
+		dec->last = *frame;
+		memset(frame, 0, sizeof(*frame));
+	} else {
+		memset(&dec->last, 0, sizeof(dec->last));
+	}
 }
 
 static EGLImage
-buffer_to_image(struct decoder *dec, GstBuffer *buf)
+create_image(struct decoder *dec, guint width, guint height, guint nplanes,
+		const int *fds, const int *offsets, const int *strides)
 {
-	struct { int fd, offset, stride; } planes[MAX_NUM_PLANES];
-	GstVideoMeta *meta = gst_buffer_get_video_meta(buf);
-	EGLImage image;
-	guint nmems = gst_buffer_n_memory(buf);
-	guint nplanes = GST_VIDEO_INFO_N_PLANES(&(dec->info));
-	guint i;
-	guint width, height;
-	gboolean is_dmabuf_mem;
-	GstMemory *mem;
-	int dmabuf_fd = -1;
-
 	static const EGLint egl_dmabuf_plane_fd_attr[MAX_NUM_PLANES] = {
 		EGL_DMA_BUF_PLANE0_FD_EXT,
 		EGL_DMA_BUF_PLANE1_FD_EXT,
@@ -384,6 +896,236 @@ buffer_to_image(struct decoder *dec, GstBuffer *buf)
 		EGL_DMA_BUF_PLANE2_PITCH_EXT,
 	};
 
+	/* Initialize the first 6 attributes with values that are
+	 * plane invariant (width, height, format) */
+	EGLint attr[6 + 6*(MAX_NUM_PLANES) + 1] = {
+		EGL_WIDTH, width,
+		EGL_HEIGHT, height,
+		EGL_LINUX_DRM_FOURCC_EXT, dec->format
+	};
+	guint i;
+
+	for (i = 0; i < nplanes; i++) {
+		attr[6 + 6*i + 0] = egl_dmabuf_plane_fd_attr[i];
+		attr[6 + 6*i + 1] = fds[i];
+		attr[6 + 6*i + 2] = egl_dmabuf_plane_offset_attr[i];
+		attr[6 + 6*i + 3] = offsets[i];
+		attr[6 + 6*i + 4] = egl_dmabuf_plane_pitch_attr[i];
+		attr[6 + 6*i + 5] = strides[i];
+	}
+
+	attr[6 + 6*nplanes] = EGL_NONE;
+
+	return dec->egl->eglCreateImageKHR(dec->egl->display, EGL_NO_CONTEXT,
+			EGL_LINUX_DMA_BUF_EXT, NULL, attr);
+}
+
+static gboolean
+cached_image_matches(const struct cached_image *cached, const struct decoder *dec,
+		guint width, guint height, guint nplanes,
+		const int *offsets, const int *strides)
+{
+	return cached->image && cached->egl == dec->egl &&
+			cached->format == dec->format &&
+			cached->width == width && cached->height == height &&
+			cached->nplanes == nplanes &&
+			!memcmp(cached->offset, offsets, nplanes * sizeof(*offsets)) &&
+			!memcmp(cached->stride, strides, nplanes * sizeof(*strides));
+}
+
+static void
+cached_image_set_layout(struct cached_image *cached, const struct decoder *dec,
+		guint width, guint height, guint nplanes,
+		const int *offsets, const int *strides)
+{
+	cached->egl = dec->egl;
+	cached->format = dec->format;
+	cached->width = width;
+	cached->height = height;
+	cached->nplanes = nplanes;
+	memcpy(cached->offset, offsets, nplanes * sizeof(*offsets));
+	memcpy(cached->stride, strides, nplanes * sizeof(*strides));
+}
+
+/* Look up the EGLImage attached to a dmabuf memory, (re)importing it if
+ * there is none yet or if it was created for a different layout:
+ */
+static EGLImage
+cached_image_get(struct decoder *dec, GstMemory *mem, guint width, guint height,
+		guint nplanes, const int *offsets, const int *strides)
+{
+	struct cached_image *cached;
+	int fds[MAX_NUM_PLANES];
+	guint i;
+
+	cached = gst_mini_object_get_qdata(GST_MINI_OBJECT(mem), cached_image_quark());
+	if (cached && cached_image_matches(cached, dec, width, height, nplanes,
+				offsets, strides))
+		return cached->image;
+
+	for (i = 0; i < nplanes; i++)
+		fds[i] = gst_dmabuf_memory_get_fd(mem);
+
+	cached = calloc(1, sizeof(*cached));
+	cached->image = create_image(dec, width, height, nplanes, fds, offsets, strides);
+	if (cached->image == EGL_NO_IMAGE_KHR) {
+		free(cached);
+		return EGL_NO_IMAGE_KHR;
+	}
+
+	cached_image_set_layout(cached, dec, width, height, nplanes, offsets, strides);
+
+	GST_DEBUG("importing new EGLImage %p for memory %p", cached->image, mem);
+
+	/* replacing the qdata destroys any stale image from before a caps change: */
+	gst_mini_object_set_qdata(GST_MINI_OBJECT(mem), cached_image_quark(),
+			cached, cached_image_free);
+
+	return cached->image;
+}
+
+/* Describe the frame's dmabuf, for it to be scanned out directly: */
+static void
+set_frame_dmabuf(const struct decoder *dec, struct frame *frame, int fd,
+		guint width, guint height, guint nplanes,
+		const int *offsets, const int *strides)
+{
+	struct dmabuf_frame *dmabuf = &frame->dmabuf;
+	guint i;
+
+	dmabuf->format = dec->format;
+	dmabuf->width = width;
+	dmabuf->height = height;
+	dmabuf->modifier = DRM_FORMAT_MOD_INVALID;
+	dmabuf->nplanes = nplanes;
+	for (i = 0; i < nplanes; i++) {
+		dmabuf->fd[i] = fd;
+		dmabuf->offset[i] = offsets[i];
+		dmabuf->pitch[i] = strides[i];
+	}
+
+	frame->is_dmabuf = TRUE;
+}
+
+static void
+upload_buf_free(struct decoder *dec, struct upload_buf *upload)
+{
+	if (upload->image.image)
+		dec->egl->eglDestroyImageKHR(dec->egl->display, upload->image.image);
+	if (upload->map)
+		munmap(upload->map, upload->size);
+	if (upload->fd >= 0)
+		close(upload->fd);
+	memset(&upload->image, 0, sizeof(upload->image));
+	upload->map = NULL;
+	upload->fd = -1;
+	upload->size = 0;
+}
+
+static void
+dmabuf_sync(int fd, uint64_t flags)
+{
+	struct dma_buf_sync sync = { .flags = flags };
+
+	while (ioctl(fd, DMA_BUF_IOCTL_SYNC, &sync) < 0 && errno == EINTR)
+		;
+}
+
+/* Copy a frame from system memory into a recycled linear BO, returning
+ * the (cached) EGLImage for it:
+ */
+static EGLImage
+upload_frame(struct decoder *dec, GstBuffer *buf, struct frame *frame,
+		guint width, guint height, guint nplanes,
+		const int *offsets, const int *strides)
+{
+	struct upload_buf *upload = NULL;
+	GstMapInfo map_info;
+	unsigned i;
+	int fds[MAX_NUM_PLANES];
+
+	for (i = 0; i < UPLOAD_POOL_SIZE && !upload; i++)
+		if (!atomic_exchange_explicit(&dec->uploads[i].busy, 1, memory_order_acquire))
+			upload = &dec->uploads[i];
+
+	if (!upload) {
+		GST_ERROR("no free upload buffer");
+		return EGL_NO_IMAGE_KHR;
+	}
+
+	if (!gst_buffer_map(buf, &map_info, GST_MAP_READ)) {
+		GST_ERROR("could not map buffer");
+		goto fail;
+	}
+
+	if (upload->size < map_info.size) {
+		upload_buf_free(dec, upload);
+
+		upload->fd = alloc_dmabuf(dec->gbm, map_info.size, &upload->size);
+		if (upload->fd < 0) {
+			GST_ERROR("could not obtain DMABUF FD");
+			upload->size = 0;
+			goto fail_unmap;
+		}
+
+		upload->map = mmap(NULL, upload->size, PROT_WRITE, MAP_SHARED,
+				upload->fd, 0);
+		if (upload->map == MAP_FAILED) {
+			GST_ERROR("could not map DMABUF");
+			upload->map = NULL;
+			upload_buf_free(dec, upload);
+			goto fail_unmap;
+		}
+	}
+
+	dmabuf_sync(upload->fd, DMA_BUF_SYNC_START | DMA_BUF_SYNC_WRITE);
+	upload_copy(upload->map, map_info.size, map_info.data, map_info.size,
+			map_info.size, 1);
+	dmabuf_sync(upload->fd, DMA_BUF_SYNC_END | DMA_BUF_SYNC_WRITE);
+
+	gst_buffer_unmap(buf, &map_info);
+
+	if (!cached_image_matches(&upload->image, dec, width, height, nplanes,
+				offsets, strides)) {
+		if (upload->image.image)
+			dec->egl->eglDestroyImageKHR(dec->egl->display, upload->image.image);
+
+		for (i = 0; i < nplanes; i++)
+			fds[i] = upload->fd;
+
+		upload->image.image = create_image(dec, width, height, nplanes,
+				fds, offsets, strides);
+		if (upload->image.image == EGL_NO_IMAGE_KHR)
+			goto fail;
+		cached_image_set_layout(&upload->image, dec, width, height, nplanes,
+				offsets, strides);
+	}
+
+	frame->upload = upload;
+	frame->cached = TRUE;
+
+	return upload->image.image;
+
+fail_unmap:
+	gst_buffer_unmap(buf, &map_info);
+fail:
+	atomic_store_explicit(&upload->busy, 0, memory_order_release);
+	return EGL_NO_IMAGE_KHR;
+}
+
+static EGLImage
+buffer_to_image(struct decoder *dec, GstBuffer *buf, struct frame *frame)
+{
+	int offsets[MAX_NUM_PLANES], strides[MAX_NUM_PLANES];
+	GstVideoMeta *meta = gst_buffer_get_video_meta(buf);
+	EGLImage image;
+	guint nmems = gst_buffer_n_memory(buf);
+	guint nplanes = GST_VIDEO_INFO_N_PLANES(&(dec->info));
+	guint i;
+	guint width, height;
+	gboolean is_dmabuf_mem;
+	GstMemory *mem;
+
 	/* Query gst_is_dmabuf_memory() here, since the gstmemory
 	 * block might get merged below by gst_buffer_map(), meaning
 	 * that the mem pointer would become invalid */
@@ -404,20 +1146,6 @@ buffer_to_image(struct decoder *dec, GstBuffer *buf)
 		 */
 	}
 
-	if (is_dmabuf_mem) {
-		dmabuf_fd = dup(gst_dmabuf_memory_get_fd(mem));
-	} else {
-		GstMapInfo map_info;
-		gst_buffer_map(buf, &map_info, GST_MAP_READ);
-		dmabuf_fd = buf_to_fd(dec->gbm, map_info.size, map_info.data);
-		gst_buffer_unmap(buf, &map_info);
-	}
-
-	if (dmabuf_fd < 0) {
-		GST_ERROR("could not obtain DMABUF FD");
-		return EGL_NO_IMAGE_KHR;
-	}
-
 	/* Usually, a videometa should be present, since by using the internal kmscube
 	 * video_appsink element instead of the regular appsink, it is guaranteed that
 	 * video meta support is declared in the video_appsink's allocation query.
@@ -429,15 +1157,13 @@ buffer_to_image(struct decoder *dec, GstBuffer *buf)
 	 */
 	if (meta) {
 		for (i = 0; i < nplanes; i++) {
-			planes[i].fd = dmabuf_fd;
-			planes[i].offset = meta->offset[i];
-			planes[i].stride = meta->stride[i];
+			offsets[i] = meta->offset[i];
+			strides[i] = meta->stride[i];
 		}
 	} else {
 		for (i = 0; i < nplanes; i++) {
-			planes[i].fd = dmabuf_fd;
-			planes[i].offset = GST_VIDEO_INFO_PLANE_OFFSET(&(dec->info), i);
-			planes[i].stride = GST_VIDEO_INFO_PLANE_STRIDE(&(dec->info), i);
+			offsets[i] = GST_VIDEO_INFO_PLANE_OFFSET(&(dec->info), i);
+			strides[i] = GST_VIDEO_INFO_PLANE_STRIDE(&(dec->info), i);
 		}
 	}
 
@@ -461,73 +1187,230 @@ buffer_to_image(struct decoder *dec, GstBuffer *buf)
 		printf("===================================\n");
 	}
 
-	{
-		/* Initialize the first 6 attributes with values that are
-		 * plane invariant (width, height, format) */
-		EGLint attr[6 + 6*(MAX_NUM_PLANES) + 1] = {
-			EGL_WIDTH, width,
-			EGL_HEIGHT, height,
-			EGL_LINUX_DRM_FOURCC_EXT, dec->format
-		};
+	if (is_dmabuf_mem) {
+		set_frame_dmabuf(dec, frame, gst_dmabuf_memory_get_fd(mem),
+				width, height, nplanes, offsets, strides);
+		frame->cached = TRUE;
+		return cached_image_get(dec, mem, width, height, nplanes, offsets, strides);
+	}
 
-		for (i = 0; i < nplanes; i++) {
-			attr[6 + 6*i + 0] = egl_dmabuf_plane_fd_attr[i];
-			attr[6 + 6*i + 1] = planes[i].fd;
-			attr[6 + 6*i + 2] = egl_dmabuf_plane_offset_attr[i];
-			attr[6 + 6*i + 3] = planes[i].offset;
-			attr[6 + 6*i + 4] = egl_dmabuf_plane_pitch_attr[i];
-			attr[6 + 6*i + 5] = planes[i].stride;
-		}
+	image = upload_frame(dec, buf, frame, width, height, nplanes, offsets, strides);
+	if (image != EGL_NO_IMAGE_KHR)
+		set_frame_dmabuf(dec, frame, frame->upload->fd,
+				width, height, nplanes, offsets, strides);
 
-		attr[6 + 6*nplanes] = EGL_NONE;
+	return image;
+}
 
-		image = dec->egl->eglCreateImageKHR(dec->egl->display, EGL_NO_CONTEXT,
-				EGL_LINUX_DMA_BUF_EXT, NULL, attr);
-	}
+static void
+appsink_eos_cb(GstAppSink *appsink, gpointer user_data)
+{
+	struct decoder *dec = user_data;
 
-	/* Cleanup */
-	for (unsigned i = 0; i < nmems; i++)
-		close(planes[i].fd);
+	(void)appsink;
 
-	return image;
+	atomic_store_explicit(&dec->eos, 1, memory_order_release);
 }
 
-EGLImage
-video_frame(struct decoder *dec)
+static GstFlowReturn
+appsink_new_preroll_cb(GstAppSink *appsink, gpointer user_data)
+{
+	struct decoder *dec = user_data;
+
+	(void)appsink;
+
+	/* the preroll sample stays in the sink, it is pulled again (through
+	 * new_sample) once playing:
+	 */
+	atomic_store_explicit(&dec->prerolled, 1, memory_order_release);
+
+	return GST_FLOW_OK;
+}
+
+/* Take the oldest queued frame off the queue, returning 0 if it is empty,
+ * along with how many were queued.  The streaming thread may take frames
+ * too, so the slot is copied before claiming it (once tail moves on, the
+ * slot may be reused), and the copy only counts if the claim succeeded:
+ */
+static int
+claim_frame(struct decoder *dec, struct frame *frame, unsigned *queued)
+{
+	unsigned tail = atomic_load_explicit(&dec->tail, memory_order_acquire);
+	unsigned head;
+
+	do {
+		head = atomic_load_explicit(&dec->head, memory_order_acquire);
+		if (head == tail)
+			return 0;
+		*frame = dec->frames[tail & (FRAME_QUEUE_SIZE - 1)];
+	} while (!atomic_compare_exchange_weak_explicit(&dec->tail, &tail, tail + 1,
+			memory_order_acq_rel, memory_order_acquire));
+
+	*queued = head - tail;
+
+	return 1;
+}
+
+static void
+drop_frame(struct decoder *dec, struct frame *frame)
 {
+	release_frame(dec, frame);
+	atomic_fetch_add_explicit(&dec->dropped, 1, memory_order_relaxed);
+	stats_count(STATS_VIDEO_DROPPED);
+}
+
+/* Runs on the streaming thread: import the frame and queue it for the
+ * render loop.  If the render loop has not kept up and the queue is full,
+ * the oldest queued frame makes room rather than stalling the decoder,
+ * so the newest frame always gets through:
+ */
+static GstFlowReturn
+appsink_new_sample_cb(GstAppSink *appsink, gpointer user_data)
+{
+	struct decoder *dec = user_data;
+	unsigned head = atomic_load_explicit(&dec->head, memory_order_relaxed);
+	unsigned tail = atomic_load_explicit(&dec->tail, memory_order_acquire);
+	struct frame *frame, old;
 	GstSample *samp;
-	GstBuffer *buf;
-	EGLImage   frame = NULL;
 
-	samp = gst_app_sink_pull_sample(GST_APP_SINK(dec->sink));
+	samp = gst_app_sink_pull_sample(appsink);
 	if (!samp) {
 		GST_DEBUG("got no appsink sample");
-		return NULL;
+		return GST_FLOW_OK;
 	}
 
-	buf = gst_sample_get_buffer(samp);
+	/* (unless the render loop made room in the meantime) */
+	while (head - tail == FRAME_QUEUE_SIZE) {
+		old = dec->frames[tail & (FRAME_QUEUE_SIZE - 1)];
+		if (atomic_compare_exchange_weak_explicit(&dec->tail, &tail, tail + 1,
+				memory_order_acq_rel, memory_order_acquire)) {
+			GST_DEBUG("frame queue full, dropping the oldest frame");
+			drop_frame(dec, &old);
+			break;
+		}
+	}
 
-	// TODO inline buffer_to_image??
-	frame = buffer_to_image(dec, buf);
+	frame = &dec->frames[head & (FRAME_QUEUE_SIZE - 1)];
+	frame->samp = samp;
+	frame->image = buffer_to_image(dec, gst_sample_get_buffer(samp), frame);
 
-	// TODO in the zero-copy dmabuf case it would be nice to associate
-	// the eglimg w/ the buffer to avoid recreating it every frame..
+	dec->frame++;
+	stats_count(STATS_VIDEO_DECODED);
 
-	set_last_frame(dec, frame, samp);
+	atomic_store_explicit(&dec->head, head + 1, memory_order_release);
 
-	dec->frame++;
+	return GST_FLOW_OK;
+}
 
-	return frame;
+/* End of stream has been signalled and all queued frames were consumed.
+ * The eos flag is set after the last frame was queued, so re-check the
+ * queue after seeing it:
+ */
+int
+video_eos(struct decoder *dec)
+{
+	return atomic_load_explicit(&dec->eos, memory_order_acquire) &&
+		atomic_load_explicit(&dec->head, memory_order_acquire) ==
+		atomic_load_explicit(&dec->tail, memory_order_relaxed);
+}
+
+/* Never blocks: returns the newest decoded frame, skipping any older ones
+ * still queued, or the previous frame again if nothing new is ready.
+ * Returns NULL before the first frame is decoded and at end of stream.
+ * *latched is set only if a new frame was taken off the queue.
+ */
+EGLImage
+video_frame(struct decoder *dec, int *latched)
+{
+	struct frame frame;
+	unsigned queued;
+
+	*latched = 0;
+	if (!claim_frame(dec, &frame, &queued)) {
+		if (video_eos(dec))
+			return NULL;
+		if (dec->last.samp) {
+			dec->repeated++;
+			stats_count(STATS_VIDEO_REPEATED);
+		}
+		return dec->last.image;
+	}
+
+	while (queued > 1) {
+		struct frame newer;
+
+		/* the streaming thread may drop the newer ones meanwhile: */
+		if (!claim_frame(dec, &newer, &queued))
+			break;
+		drop_frame(dec, &frame);
+		frame = newer;
+	}
+
+	set_last_frame(dec, &frame);
+	*latched = 1;
+
+	return dec->last.image;
+}
+
+/* The dmabuf backing the frame last returned by video_frame(), for
+ * scanning it out directly, or NULL if it is not in a dmabuf.  Once this
+ * is used, the decoder keeps frames around until the display is done
+ * with them.
+ */
+const struct dmabuf_frame *
+video_frame_dmabuf(struct decoder *dec)
+{
+	dec->scanout = TRUE;
+
+	return dec->last.is_dmabuf ? &dec->last.dmabuf : NULL;
 }
 
 void video_deinit(struct decoder *dec)
 {
-	set_last_frame(dec, NULL, NULL);
+	unsigned tail, head, i;
+
 	gst_element_set_state(dec->pipeline, GST_STATE_NULL);
+
+	/* streaming thread is stopped, so the queue can be drained: */
+	tail = atomic_load(&dec->tail);
+	head = atomic_load(&dec->head);
+	for (; tail != head; tail++)
+		release_frame(dec, &dec->frames[tail & (FRAME_QUEUE_SIZE - 1)]);
+	set_last_frame(dec, NULL);
+	for (i = 0; i < MAX_SWAP_DEPTH; i++)
+		release_frame(dec, &dec->held[i]);
+	for (i = 0; i < UPLOAD_POOL_SIZE; i++)
+		upload_buf_free(dec, &dec->uploads[i]);
+
+	printf("video: %u frames decoded, %u dropped, %u repeated\n",
+			dec->frame, atomic_load(&dec->dropped), dec->repeated);
+
+	/* the callback may be running on the worker right now, wait for it: */
+	g_source_destroy(dec->bus_watch);
+	g_source_unref(dec->bus_watch);
+	sem_wait(&dec->bus_watch_done);
+	sem_destroy(&dec->bus_watch_done);
+	worker_put();
+
 	gst_object_unref(dec->sink);
 	gst_object_unref(dec->pipeline);
-	g_main_loop_quit(dec->loop);
-	g_main_loop_unref(dec->loop);
-	pthread_join(dec->gst_thread, 0);
 	free(dec);
 }
+
+static void *
+deinit_thread_func(void *args)
+{
+	video_deinit(args);
+	return NULL;
+}
+
+void video_deinit_async(struct decoder *dec)
+{
+	pthread_t thread;
+
+	if (pthread_create(&thread, NULL, deinit_thread_func, dec)) {
+		video_deinit(dec);
+		return;
+	}
+	pthread_detach(thread);
+}
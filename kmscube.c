@@ -24,16 +24,24 @@
 
 /* Based on a egl cube test app originally written by Arvin Schnell */
 #define _GNU_SOURCE
+#include <errno.h>
 #include <string.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <getopt.h>
 #include <unistd.h>
 #include <fcntl.h>
+#include <pthread.h>
 #include <time.h>
 
 #include "common.h"
+#include "bench.h"
 #include "drm-common.h"
+#include "event-loop.h"
+#include "matrix.h"
+#include "metrics.h"
+#include "stats.h"
+#include "upload.h"
 
 #ifdef HAVE_GST
 #include <gst/gst.h>
@@ -42,13 +50,35 @@ GST_DEBUG_CATEGORY(kmscube_debug);
 
 #define ARRAY_SIZE(arr) (sizeof(arr) / sizeof((arr)[0]))
 
-static const char *device = "/dev/dri/card0";
+#define MAX_OUTPUTS 8
+
+static const char *device = NULL;
 static const char *video = NULL;
+static const char *video_pipeline = NULL;
+static const char *decoder_ranks = NULL;
+static unsigned int video_streams = 1;
 static enum mode mode = SMOOTH;
+static const char *mode_name = "smooth";
 static uint64_t modifier = DRM_FORMAT_MOD_INVALID;
 static int atomic = 0;
-
-static const char *shortopts = "AD:M:m:V:l";
+static int video_plane = 0;
+static int stats_interval = -1;
+static const char *metrics_path = NULL;
+static unsigned int benchmark = 0;
+static int offscreen = 0;
+static int offscreen_w = 1920, offscreen_h = 1080;
+static unsigned int swap_depth = 2;
+
+static int shared_context = 0;
+static int upload_benchmark = 0;
+static int matrix_benchmark = 0;
+static unsigned int cubes = 0;
+static int startup_profile = 0;
+static int low_latency = 0;
+static EGLint context_priority = 0;
+static unsigned int render_ahead = 0;
+
+static const char *shortopts = "AD:M:m:V:G:R:N:PS::E:b:O::s:F:Q:lcUTC:vpL";
 
 struct thread_data {
 	struct drm *drm;
@@ -63,17 +93,36 @@ static const struct option longopts[] = {
 	{"mode",   required_argument, 0, 'M'},
 	{"modifier", required_argument, 0, 'm'},
 	{"video",  required_argument, 0, 'V'},
+	{"video-pipeline", required_argument, 0, 'G'},
+	{"decoder-rank", required_argument, 0, 'R'},
+	{"video-streams", required_argument, 0, 'N'},
+	{"video-plane", no_argument,  0, 'P'},
+	{"stats",  optional_argument, 0, 'S'},
+	{"metrics", required_argument, 0, 'E'},
+	{"benchmark", required_argument, 0, 'b'},
+	{"offscreen", optional_argument, 0, 'O'},
+	{"swap-depth", required_argument, 0, 's'},
+	{"render-ahead", required_argument, 0, 'F'},
+	{"priority", required_argument, 0, 'Q'},
 	{"lease", no_argument, 0, 'l' },
+	{"shared-context", no_argument, 0, 'c'},
+	{"upload-bench", no_argument, 0, 'U'},
+	{"matrix-bench", no_argument, 0, 'T'},
+	{"cubes", required_argument, 0, 'C'},
+	{"verbose", no_argument, 0, 'v'},
+	{"startup-profile", no_argument, 0, 'p'},
+	{"low-latency", no_argument, 0, 'L'},
 	{0, 0, 0, 0}
 };
 
 static void usage(const char *name)
 {
-	printf("Usage: %s [-ADMmV]\n"
+	printf("Usage: %s [-ADMmVGRNPSEbOsFQlcUTCvpL]\n"
 			"\n"
 			"options:\n"
 			"    -A, --atomic             use atomic modesetting and fencing\n"
-			"    -D, --device=DEVICE      use the given device\n"
+			"    -D, --device=DEVICE      use the given device (default /dev/dri/card0,\n"
+			"                             or /dev/dri/renderD128 with -O)\n"
 			"    -M, --mode=MODE          specify mode, one of:\n"
 			"        smooth    -  smooth shaded cube (default)\n"
 			"        rgba      -  rgba textured cube\n"
@@ -81,74 +130,259 @@ static void usage(const char *name)
 			"        nv12-1img -  yuv textured (single nv12 texture)\n"
 			"    -m, --modifier=MODIFIER  hardcode the selected modifier\n"
 			"    -V, --video=FILE         video textured cube\n"
-			"    -l, lease		     Uses DRM leases to display two cubes\n",
+			"                             (comma separated files for a playlist)\n"
+			"    -G, --video-pipeline=DESC  decode with DESC instead of filesrc !\n"
+			"                             decodebin, eg. \"filesrc name=src !\n"
+			"                             qtdemux ! h264parse ! vpudec\"\n"
+			"    -R, --decoder-rank=NAME:RANK[,...]  rank decoders (none,\n"
+			"                             marginal, secondary, primary, max or\n"
+			"                             a number) for decodebin to pick\n"
+			"    -N, --video-streams=N    decode N playlist entries at once, one\n"
+			"                             per face (up to 6)\n"
+			"    -C, --cubes=N            N smooth shaded cubes in one draw call,\n"
+			"                             to measure vertex and draw throughput\n"
+			"    -P, --video-plane        scan out the video on an overlay plane\n"
+			"                             instead of blitting it (requires -A)\n"
+			"    -S, --stats[=SECS]       record frame timing histograms, dumped\n"
+			"                             every SECS seconds (default 5, 0 for\n"
+			"                             only at exit)\n"
+			"    -E, --metrics=PATH       serve live counters and histograms in the\n"
+			"                             Prometheus text format on a Unix socket\n"
+			"                             (a leading @ for the abstract namespace)\n"
+			"    -b, --benchmark=N        render N frames vsync locked and N frames\n"
+			"                             uncapped, then print the results as JSON\n"
+			"    -O, --offscreen[=WxH]    render headless on a render node, without\n"
+			"                             modesetting or vsync (default 1920x1080)\n"
+			"    -s, --swap-depth=N       buffers in the swap chain, 2 (lowest latency,\n"
+			"                             default) to 4 (GPU renders ahead the most)\n"
+			"    -F, --render-ahead=N     don't start a frame while the GPU hasn't\n"
+			"                             finished the last N yet (1 to 4), to bound\n"
+			"                             the latency when sharing the GPU\n"
+			"    -Q, --priority=LEVEL     GPU context priority, one of low, medium\n"
+			"                             or high (EGL_IMG_context_priority)\n"
+			"    -L, --low-latency        start rendering each frame as late as it\n"
+			"                             can and still make its vblank\n"
+			"    -l, --lease              drive every connected output, each from a\n"
+			"                             DRM lease and render thread of its own\n"
+			"    -c, --shared-context     with --lease, have the outputs share one\n"
+			"                             EGLDisplay and GL share group, so textures\n"
+			"                             are only uploaded once\n"
+			"    -U, --upload-bench       measure each texture upload path into\n"
+			"                             system memory and a mapped linear bo\n"
+			"    -T, --matrix-bench       compare the per frame matrix math against\n"
+			"                             esTransform.c\n"
+			"    -v, --verbose            print the EGL/GL extension strings and\n"
+			"                             GStreamer state changes\n"
+			"    -p, --startup-profile    print how long each init phase took, up\n"
+			"                             to the first flip\n",
 			name);
 }
 
-void
-run(int drm_fd, int leased_fd)
+static const char *backend_name(void)
 {
-	struct gbm *gbm;
+	if (offscreen)
+		return "offscreen";
+	return atomic ? "atomic" : "legacy";
+}
+
+/* Everything one display needs, set up front before any of them runs: */
+struct output {
 	struct drm *drm;
+	struct gbm *gbm;
 	struct egl *egl;
+	pthread_t thread;
+};
 
-	if (atomic)
-		drm = init_drm_atomic(drm_fd, leased_fd);
+/* Set up an output on drm_fd (the device, or a lease of it), with the
+ * buffers allocated from gbm_fd, which differs when the outputs share
+ * one gbm device and EGLDisplay:
+ */
+static int
+init_output(struct output *out, int drm_fd, int gbm_fd)
+{
+	struct gbm *gbm;
+	struct drm *drm;
+	struct egl *egl;
+	uint64_t *mods = NULL;
+	uint32_t format;
+	int scanout = 0, count = 0;
+
+	if (offscreen)
+		drm = init_drm_offscreen(offscreen_w, offscreen_h);
+	else if (atomic)
+		drm = init_drm_atomic(drm_fd);
 	else
-		drm = init_drm_legacy(drm_fd, leased_fd);
-
-	drm->fd = drm_fd;
-	drm->leased_fd = leased_fd;
+		drm = init_drm_legacy(drm_fd);
 
 	if (!drm) {
-		printf("failed to initialize %s DRM\n", atomic ? "atomic" : "legacy");
-		exit(EXIT_FAILURE);
+		printf("failed to initialize %s DRM\n", backend_name());
+		return -1;
 	}
 
-	gbm = init_gbm(drm_fd, drm->mode->hdisplay, drm->mode->vdisplay,
-			modifier);
+	drm->fd = drm_fd;
+	drm->swap_depth = swap_depth;
+	drm->low_latency = low_latency;
+	stats_startup("drm");
+
+	/* with the video on an overlay plane underneath, the primary plane
+	 * needs alpha so the video shows through around the cube:
+	 */
+	if (video_plane) {
+		scanout = drm_find_plane(drm, DRM_FORMAT_NV12, DRM_FORMAT_MOD_INVALID) ||
+			drm_find_plane(drm, DRM_FORMAT_YUV420, DRM_FORMAT_MOD_INVALID);
+		if (!scanout)
+			printf("no plane for video, using GL composition\n");
+	}
+	format = scanout ? GBM_FORMAT_ARGB8888 : GBM_FORMAT_XRGB8888;
+
+	/* the negotiation's test commits go first, as nothing else may
+	 * touch KMS while the early modeset runs:
+	 */
+	if (!offscreen && modifier == DRM_FORMAT_MOD_INVALID)
+		count = drm_negotiate_modifiers(drm, get_gbm_device(gbm_fd),
+				format, &mods);
+
+	/* light the output up while GBM, EGL and the scene get ready: */
+	if (!offscreen && drm_early_modeset(drm)) {
+		free(mods);
+		return -1;
+	}
+
+	if (offscreen) {
+		gbm = init_gbm_offscreen(gbm_fd, drm->mode->hdisplay,
+				drm->mode->vdisplay, GBM_FORMAT_XRGB8888);
+	} else if (modifier != DRM_FORMAT_MOD_INVALID) {
+		gbm = init_gbm(gbm_fd, drm->mode->hdisplay, drm->mode->vdisplay,
+				format, &modifier, 1);
+	} else {
+		gbm = init_gbm(gbm_fd, drm->mode->hdisplay, drm->mode->vdisplay,
+				format, mods, count);
+		free(mods);
+	}
 	if (!gbm) {
 		printf("failed to initialize GBM\n");
-		return;
+		return -1;
 	}
 
 	fprintf(stdout, "gbm @ %p\n", gbm);
+	stats_startup("gbm");
 
 	if (mode == SMOOTH)
 		egl = init_cube_smooth(gbm);
 	else if (mode == VIDEO)
-		egl = init_cube_video(gbm, video);
+		egl = init_cube_video(gbm, video, video_streams, scanout);
+	else if (mode == CUBES)
+		egl = init_cube_instanced(gbm, cubes);
 	else
 		egl = init_cube_tex(gbm, mode);
 
 	if (!egl) {
 		printf("failed to initialize EGL\n");
-		return;
+		return -1;
 	}
 
+	stats_startup("scene");
+
 	/* clear the color buffer */
 	glClearColor(0.5, 0.5, 0.5, 1.0);
 	glClear(GL_COLOR_BUFFER_BIT);
 
-	drm->run(drm, gbm, egl);
+	out->drm = drm;
+	out->gbm = gbm;
+	out->egl = egl;
+
+	return 0;
 }
 
 static void *
-thread_run(void *arg)
+output_thread(void *arg)
 {
-	int leased_fd = (intptr_t) arg;
+	struct output *out = arg;
+	struct egl *egl = out->egl;
+
+	/* the context was set up on the main thread: */
+	eglMakeCurrent(egl->display, egl->surface, egl->surface, egl->context);
 
-	/* passing -1 will not "force" to seek other connector, meaning that we
-	 * can use whatever objects have been leased */
-	run(leased_fd, -1);
+	out->drm->run(out->drm, out->gbm, egl);
 	return NULL;
 }
 
+/*
+ * Drive every connected output, each from a lease of its own (so that
+ * each has its own DRM events to wait on) with its own render thread,
+ * EGL context and swap chain.  All the KMS objects are divided up among
+ * the outputs and leased out before any of them starts.
+ */
+static int
+run_leases(int drm_fd)
+{
+	struct drm_resources res[MAX_OUTPUTS];
+	struct output outputs[MAX_OUTPUTS];
+	int count, i;
+
+	count = find_drm_outputs(drm_fd, res, MAX_OUTPUTS);
+	if (count <= 0) {
+		printf("no connected connector!\n");
+		return -1;
+	}
+
+	for (i = 0; i < count; i++) {
+		uint32_t objects[3 + MAX_OUTPUT_OVERLAYS];
+		uint32_t lessee_id;
+		unsigned n = 0, j;
+		int fd;
+
+		objects[n++] = res[i].connector_id;
+		objects[n++] = res[i].crtc_id;
+		if (res[i].plane_id)
+			objects[n++] = res[i].plane_id;
+		for (j = 0; j < res[i].count_overlays; j++)
+			objects[n++] = res[i].overlay_ids[j];
+
+		fd = drmModeCreateLease(drm_fd, objects, n, O_CLOEXEC, &lessee_id);
+		if (fd < 0) {
+			printf("failed to create lease for connector %u: %s\n",
+					res[i].connector_id, strerror(errno));
+			return -1;
+		}
+
+		if (init_output(&outputs[i], fd, shared_context ? drm_fd : fd))
+			return -1;
+
+		/* leave the context for the output's thread to bind: */
+		eglMakeCurrent(outputs[i].egl->display, EGL_NO_SURFACE,
+				EGL_NO_SURFACE, EGL_NO_CONTEXT);
+	}
+
+	printf("driving %d outputs\n", count);
+
+	for (i = 0; i < count; i++) {
+		int ret = pthread_create(&outputs[i].thread, NULL, output_thread, &outputs[i]);
+
+		if (ret) {
+			printf("failed to start output thread: %s\n", strerror(ret));
+			exit(EXIT_FAILURE);
+		}
+	}
+
+	for (i = 0; i < count; i++)
+		pthread_join(outputs[i].thread, NULL);
+
+	return 0;
+}
+
 int main(int argc, char *argv[])
 {
+	uint64_t start = get_time_ns();
 	int lease = 0;
 	int opt;
 
+	/* SIGINT/SIGTERM stop the run loops cleanly, whichever thread
+	 * they are delivered to:
+	 */
+	if (handle_exit_signals())
+		return EXIT_FAILURE;
+
 #ifdef HAVE_GST
 	gst_init(&argc, &argv);
 	GST_DEBUG_CATEGORY_INIT(kmscube_debug, "kmscube", 0, "kmscube video pipeline");
@@ -163,6 +397,7 @@ int main(int argc, char *argv[])
 			device = optarg;
 			break;
 		case 'M':
+			mode_name = optarg;
 			if (strcmp(optarg, "smooth") == 0) {
 				mode = SMOOTH;
 			} else if (strcmp(optarg, "rgba") == 0) {
@@ -182,56 +417,194 @@ int main(int argc, char *argv[])
 			break;
 		case 'V':
 			mode = VIDEO;
+			mode_name = "video";
 			video = optarg;
 			break;
+		case 'G':
+			video_pipeline = optarg;
+			break;
+		case 'R':
+			decoder_ranks = optarg;
+			break;
+		case 'N':
+			video_streams = strtoul(optarg, NULL, 0);
+			if (!video_streams || video_streams > 6) {
+				printf("invalid video stream count: %s\n", optarg);
+				usage(argv[0]);
+				return -1;
+			}
+			break;
+		case 'C':
+			cubes = strtoul(optarg, NULL, 0);
+			if (!cubes) {
+				printf("invalid cube count: %s\n", optarg);
+				usage(argv[0]);
+				return -1;
+			}
+			mode = CUBES;
+			mode_name = "cubes";
+			break;
+		case 'P':
+			video_plane = 1;
+			break;
+		case 'S':
+			stats_interval = optarg ? atoi(optarg) : 5;
+			break;
+		case 'E':
+			metrics_path = optarg;
+			break;
+		case 'b':
+			benchmark = strtoul(optarg, NULL, 0);
+			break;
+		case 'O':
+			offscreen = 1;
+			if (optarg && sscanf(optarg, "%dx%d", &offscreen_w, &offscreen_h) != 2) {
+				printf("invalid offscreen size: %s\n", optarg);
+				usage(argv[0]);
+				return -1;
+			}
+			break;
+		case 's':
+			swap_depth = strtoul(optarg, NULL, 0);
+			if (swap_depth < 2 || swap_depth > MAX_SWAP_DEPTH) {
+				printf("invalid swap depth: %s\n", optarg);
+				usage(argv[0]);
+				return -1;
+			}
+			break;
+		case 'F':
+			render_ahead = strtoul(optarg, NULL, 0);
+			if (!render_ahead || render_ahead > MAX_SWAP_DEPTH) {
+				printf("invalid render ahead: %s\n", optarg);
+				usage(argv[0]);
+				return -1;
+			}
+			break;
+		case 'Q':
+			if (strcmp(optarg, "low") == 0) {
+				context_priority = EGL_CONTEXT_PRIORITY_LOW_IMG;
+			} else if (strcmp(optarg, "medium") == 0) {
+				context_priority = EGL_CONTEXT_PRIORITY_MEDIUM_IMG;
+			} else if (strcmp(optarg, "high") == 0) {
+				context_priority = EGL_CONTEXT_PRIORITY_HIGH_IMG;
+			} else {
+				printf("invalid priority: %s\n", optarg);
+				usage(argv[0]);
+				return -1;
+			}
+			break;
 		case 'l':
 			lease = 1;
 			break;
+		case 'c':
+			shared_context = 1;
+			break;
+		case 'U':
+			upload_benchmark = 1;
+			break;
+		case 'T':
+			matrix_benchmark = 1;
+			break;
+		case 'v':
+			verbose = 1;
+			break;
+		case 'p':
+			startup_profile = 1;
+			break;
+		case 'L':
+			low_latency = 1;
+			break;
 		default:
 			usage(argv[0]);
 			return -1;
 		}
 	}
 
-	int leased_fd = -1;
-	int drm_fd = open(device, O_RDWR);
+	if (video_plane && (!atomic || mode != VIDEO)) {
+		printf("--video-plane requires --atomic and --video\n");
+		usage(argv[0]);
+		return -1;
+	}
 
-	if (lease) {
-		struct drm_resources drm_resources;
-		uint32_t objects[3];
-		uint32_t lessee_id;
-		pthread_t thread;
-		int i = 0;
+#ifdef HAVE_GST
+	if (video_pipeline && video_set_pipeline(video_pipeline))
+		return -1;
+	if (decoder_ranks && video_set_ranks(decoder_ranks))
+		return -1;
+#endif
 
-		find_drm_resources(&drm_resources, drm_fd, -1);
+	if (offscreen && (atomic || lease || modifier != DRM_FORMAT_MOD_INVALID)) {
+		printf("--offscreen can't be used with --atomic, --lease or --modifier\n");
+		usage(argv[0]);
+		return -1;
+	}
 
-		if (drm_resources.connector_id) {
-			objects[i++] = drm_resources.connector_id;
-		}
+	if (!device)
+		device = offscreen ? "/dev/dri/renderD128" : "/dev/dri/card0";
 
-		if (drm_resources.crtc_id) {
-			objects[i++] = drm_resources.crtc_id;
-		}
+	if (shared_context && !lease) {
+		printf("--shared-context requires --lease\n");
+		usage(argv[0]);
+		return -1;
+	}
 
-		/* 
-		 * we create a lease using the connector_id and crtc_id. The
-		 * thread will initialize drm using these values.
-		 */
-		leased_fd = drmModeCreateLease(drm_fd, objects, i, 0, &lessee_id);
-		if (leased_fd < 0) {
-			fprintf(stderr, "Failed to create lease\n");
-			exit(EXIT_FAILURE);
-		}
+	if (benchmark && lease) {
+		printf("--benchmark can't be used with --lease\n");
+		usage(argv[0]);
+		return -1;
+	}
 
-		pthread_create(&thread, NULL, thread_run, (void *) (intptr_t) leased_fd);
+	if (startup_profile)
+		stats_startup_begin(start);
 
-		/* wait until the first one starts */
-		nanosleep(&(struct timespec) { .tv_sec = 1, .tv_nsec = 1024 * 1024 * 10 }, NULL);
+	/* pure CPU, no device needed: */
+	if (matrix_benchmark)
+		return matrix_bench() ? EXIT_FAILURE : 0;
+
+	/* missed vblanks come from the stats flip tracking: */
+	if (benchmark && stats_interval < 0)
+		stats_interval = 0;
+
+	/* the benchmark prints its own results: */
+	if (stats_interval >= 0 && stats_init(stats_interval, !benchmark))
+		return -1;
+
+	/* metrics alone record the stats without printing them: */
+	if (metrics_path) {
+		if (stats_interval < 0 && stats_init(0, 0))
+			return -1;
+		if (metrics_init(metrics_path))
+			return -1;
 	}
 
+	int drm_fd = open(device, O_RDWR);
+	struct output output;
+
+	if (drm_fd < 0) {
+		printf("could not open %s: %s\n", device, strerror(errno));
+		return -1;
+	}
+
+	if (upload_benchmark)
+		return upload_bench(gbm_create_device(drm_fd)) ? EXIT_FAILURE : 0;
+
+	if (shared_context)
+		egl_share_contexts();
+	if (context_priority)
+		egl_context_priority(context_priority);
+	if (render_ahead)
+		egl_render_ahead(render_ahead);
+
+	if (lease)
+		return run_leases(drm_fd) ? EXIT_FAILURE : 0;
+
+	if (init_output(&output, drm_fd, drm_fd))
+		return EXIT_FAILURE;
+
+	if (benchmark)
+		return bench_run(output.drm, output.gbm, output.egl, benchmark,
+				mode_name, backend_name()) ? EXIT_FAILURE : 0;
 
-	/* we know have drm_fd and leased_fd. When we're going to initalize the
-	 * drm system we'll choose the other connector available */
-	run(drm_fd, leased_fd);
+	output.drm->run(output.drm, output.gbm, output.egl);
 	return 0;
 }
@@ -0,0 +1,320 @@
+/*
+ * Copyright 2026 NXP
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sub license,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the
+ * next paragraph) shall be included in all copies or substantial portions
+ * of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT. IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "common.h"
+#include "matrix.h"
+
+#if defined(__SSE__)
+#include <xmmintrin.h>
+#elif defined(__ARM_NEON)
+#include <arm_neon.h>
+#endif
+
+#define PI 3.1415926535897932384626433832795f
+
+void mat4_frustum(ESMatrix *result, float left, float right, float bottom,
+		float top, float nearZ, float farZ)
+{
+	float deltaX = right - left;
+	float deltaY = top - bottom;
+	float deltaZ = farZ - nearZ;
+
+	memset(result, 0, sizeof(*result));
+
+	result->m[0][0] = 2.0f * nearZ / deltaX;
+	result->m[1][1] = 2.0f * nearZ / deltaY;
+	result->m[2][0] = (right + left) / deltaX;
+	result->m[2][1] = (top + bottom) / deltaY;
+	result->m[2][2] = -(nearZ + farZ) / deltaZ;
+	result->m[2][3] = -1.0f;
+	result->m[3][2] = -2.0f * nearZ * farZ / deltaZ;
+}
+
+/* Each row of the result is a linear combination of b's rows, weighted
+ * by the same row of a.  All of b is loaded before anything is stored,
+ * and each row of a before its row of result, so either may alias it:
+ */
+void mat4_multiply(ESMatrix *result, const ESMatrix *a, const ESMatrix *b)
+{
+#if defined(__SSE__)
+	__m128 b0 = _mm_loadu_ps(b->m[0]);
+	__m128 b1 = _mm_loadu_ps(b->m[1]);
+	__m128 b2 = _mm_loadu_ps(b->m[2]);
+	__m128 b3 = _mm_loadu_ps(b->m[3]);
+
+	for (int i = 0; i < 4; i++) {
+		__m128 r = _mm_mul_ps(_mm_set1_ps(a->m[i][0]), b0);
+
+		r = _mm_add_ps(r, _mm_mul_ps(_mm_set1_ps(a->m[i][1]), b1));
+		r = _mm_add_ps(r, _mm_mul_ps(_mm_set1_ps(a->m[i][2]), b2));
+		r = _mm_add_ps(r, _mm_mul_ps(_mm_set1_ps(a->m[i][3]), b3));
+		_mm_storeu_ps(result->m[i], r);
+	}
+#elif defined(__ARM_NEON)
+	float32x4_t b0 = vld1q_f32(b->m[0]);
+	float32x4_t b1 = vld1q_f32(b->m[1]);
+	float32x4_t b2 = vld1q_f32(b->m[2]);
+	float32x4_t b3 = vld1q_f32(b->m[3]);
+
+	for (int i = 0; i < 4; i++) {
+		float32x4_t ai = vld1q_f32(a->m[i]);
+		float32x4_t r = vmulq_lane_f32(b0, vget_low_f32(ai), 0);
+
+		r = vmlaq_lane_f32(r, b1, vget_low_f32(ai), 1);
+		r = vmlaq_lane_f32(r, b2, vget_high_f32(ai), 0);
+		r = vmlaq_lane_f32(r, b3, vget_high_f32(ai), 1);
+		vst1q_f32(result->m[i], r);
+	}
+#else
+	ESMatrix bb = *b;
+
+	for (int i = 0; i < 4; i++) {
+		GLfloat a0 = a->m[i][0], a1 = a->m[i][1], a2 = a->m[i][2], a3 = a->m[i][3];
+
+		for (int j = 0; j < 4; j++)
+			result->m[i][j] = a0 * bb.m[0][j] + a1 * bb.m[1][j] +
+				a2 * bb.m[2][j] + a3 * bb.m[3][j];
+	}
+#endif
+}
+
+void mat4_multiply_array(ESMatrix *result, const ESMatrix *a, const ESMatrix *b,
+		unsigned count)
+{
+	/* b is constant across the array, keep a copy the compiler can see
+	 * isn't written through result:
+	 */
+	ESMatrix bb = *b;
+
+	for (unsigned k = 0; k < count; k++)
+		mat4_multiply(&result[k], &a[k], &bb);
+}
+
+/* The product Rz * Ry * Rx * T(0, 0, tz) that esTranslate() followed
+ * by three esRotate()s about x, y and z builds up, written out (with
+ * all the zero terms dropped) for angles in degrees:
+ */
+static void cube_modelview(ESMatrix *m, GLfloat tz, GLfloat ax, GLfloat ay, GLfloat az)
+{
+	GLfloat sx = sinf(ax * PI / 180.0f), cx = cosf(ax * PI / 180.0f);
+	GLfloat sy = sinf(ay * PI / 180.0f), cy = cosf(ay * PI / 180.0f);
+	GLfloat sz = sinf(az * PI / 180.0f), cz = cosf(az * PI / 180.0f);
+
+	m->m[0][0] = cz * cy;
+	m->m[0][1] = cz * sy * sx - sz * cx;
+	m->m[0][2] = cz * sy * cx + sz * sx;
+	m->m[0][3] = 0.0f;
+
+	m->m[1][0] = sz * cy;
+	m->m[1][1] = sz * sy * sx + cz * cx;
+	m->m[1][2] = sz * sy * cx - cz * sx;
+	m->m[1][3] = 0.0f;
+
+	m->m[2][0] = -sy;
+	m->m[2][1] = cy * sx;
+	m->m[2][2] = cy * cx;
+	m->m[2][3] = 0.0f;
+
+	m->m[3][0] = 0.0f;
+	m->m[3][1] = 0.0f;
+	m->m[3][2] = tz;
+	m->m[3][3] = 1.0f;
+}
+
+void cube_frame_update(struct cube_frame *frame, const ESMatrix *projection,
+		GLfloat distance, float t)
+{
+	ESMatrix *modelview = &frame->modelview;
+
+	cube_modelview(modelview, -distance, 45.0f + (0.25f * t),
+			45.0f - (0.5f * t), 10.0f + (0.15f * t));
+
+	mat4_multiply(&frame->modelviewprojection, modelview, projection);
+
+	/* there is no scaling, so the rotation is its own normal matrix: */
+	for (int r = 0; r < 3; r++)
+		for (int c = 0; c < 3; c++)
+			frame->normal[r * 3 + c] = modelview->m[r][c];
+}
+
+void cube_frame_bounds(const struct cube_frame *frame, int width, int height,
+		struct damage_rect *rect)
+{
+	const ESMatrix *mvp = &frame->modelviewprojection;
+	float x0 = 1.0f, y0 = 1.0f, x1 = -1.0f, y1 = -1.0f;
+	int left, bottom, right, top;
+
+	for (int i = 0; i < 8; i++) {
+		float v[3] = {
+			(i & 1) ? 1.0f : -1.0f,
+			(i & 2) ? 1.0f : -1.0f,
+			(i & 4) ? 1.0f : -1.0f,
+		};
+		float c[4];
+
+		/* column major, as uploaded to the shaders: */
+		for (int j = 0; j < 4; j++)
+			c[j] = mvp->m[0][j] * v[0] + mvp->m[1][j] * v[1] +
+				mvp->m[2][j] * v[2] + mvp->m[3][j];
+
+		/* a corner behind the camera, no meaningful bounds: */
+		if (c[3] <= 0.0f) {
+			*rect = (struct damage_rect){ 0, 0, width, height };
+			return;
+		}
+
+		x0 = fminf(x0, c[0] / c[3]);
+		x1 = fmaxf(x1, c[0] / c[3]);
+		y0 = fminf(y0, c[1] / c[3]);
+		y1 = fmaxf(y1, c[1] / c[3]);
+	}
+
+	/* to window coordinates, with a couple of pixels for the edges: */
+	left = (int)floorf((x0 + 1.0f) * 0.5f * width) - 2;
+	right = (int)ceilf((x1 + 1.0f) * 0.5f * width) + 2;
+	bottom = (int)floorf((y0 + 1.0f) * 0.5f * height) - 2;
+	top = (int)ceilf((y1 + 1.0f) * 0.5f * height) + 2;
+
+	if (left < 0)
+		left = 0;
+	if (bottom < 0)
+		bottom = 0;
+	if (right > width)
+		right = width;
+	if (top > height)
+		top = height;
+	if (right < left)
+		right = left;
+	if (top < bottom)
+		top = bottom;
+
+	*rect = (struct damage_rect){ left, bottom, right - left, top - bottom };
+}
+
+#define BENCH_FRAMES     1000000
+#define BENCH_INSTANCES  10000
+#define BENCH_REPEAT     100
+
+/* what the scenes did every frame before: */
+static void es_frame(struct cube_frame *frame, GLfloat aspect, unsigned i)
+{
+	ESMatrix projection;
+
+	esMatrixLoadIdentity(&frame->modelview);
+	esTranslate(&frame->modelview, 0.0f, 0.0f, -8.0f);
+	esRotate(&frame->modelview, 45.0f + (0.25f * i), 1.0f, 0.0f, 0.0f);
+	esRotate(&frame->modelview, 45.0f - (0.5f * i), 0.0f, 1.0f, 0.0f);
+	esRotate(&frame->modelview, 10.0f + (0.15f * i), 0.0f, 0.0f, 1.0f);
+
+	esMatrixLoadIdentity(&projection);
+	esFrustum(&projection, -2.8f, +2.8f, -2.8f * aspect, +2.8f * aspect, 6.0f, 10.0f);
+
+	esMatrixLoadIdentity(&frame->modelviewprojection);
+	esMatrixMultiply(&frame->modelviewprojection, &frame->modelview, &projection);
+
+	for (int r = 0; r < 3; r++)
+		for (int c = 0; c < 3; c++)
+			frame->normal[r * 3 + c] = frame->modelview.m[r][c];
+}
+
+static float max_error(const ESMatrix *a, const ESMatrix *b)
+{
+	float err = 0.0f;
+
+	for (int r = 0; r < 4; r++)
+		for (int c = 0; c < 4; c++)
+			err = fmaxf(err, fabsf(a->m[r][c] - b->m[r][c]));
+
+	return err;
+}
+
+int matrix_bench(void)
+{
+	/* volatile so the loops aren't optimized away: */
+	volatile GLfloat aspect = 1080.0f / 1920.0f;
+	struct cube_frame es, fast;
+	ESMatrix projection, *instances, *es_out, *fast_out;
+	uint64_t start, es_ns, fast_ns;
+	float err = 0.0f;
+
+	instances = malloc(3 * BENCH_INSTANCES * sizeof(ESMatrix));
+	if (!instances) {
+		printf("out of memory\n");
+		return -1;
+	}
+	es_out = &instances[BENCH_INSTANCES];
+	fast_out = &instances[2 * BENCH_INSTANCES];
+
+	mat4_frustum(&projection, -2.8f, +2.8f, -2.8f * aspect, +2.8f * aspect, 6.0f, 10.0f);
+
+	for (unsigned i = 0; i < 1000; i++) {
+		es_frame(&es, aspect, i);
+		cube_frame_update(&fast, &projection, 8.0f, i);
+		err = fmaxf(err, max_error(&es.modelviewprojection, &fast.modelviewprojection));
+	}
+
+	start = get_time_ns();
+	for (unsigned i = 0; i < BENCH_FRAMES; i++)
+		es_frame(&es, aspect, i);
+	es_ns = get_time_ns() - start;
+
+	start = get_time_ns();
+	for (unsigned i = 0; i < BENCH_FRAMES; i++)
+		cube_frame_update(&fast, &projection, 8.0f, i);
+	fast_ns = get_time_ns() - start;
+
+	printf("cube frame matrices (max error %g):\n", err);
+	printf("  esTransform: %7.1f ns/frame\n", (double)es_ns / BENCH_FRAMES);
+	printf("  matrix:      %7.1f ns/frame\n", (double)fast_ns / BENCH_FRAMES);
+
+	for (unsigned k = 0; k < BENCH_INSTANCES; k++)
+		cube_modelview(&instances[k], -8.0f, 0.1f * k, 0.2f * k, 0.3f * k);
+
+	start = get_time_ns();
+	for (unsigned n = 0; n < BENCH_REPEAT; n++)
+		for (unsigned k = 0; k < BENCH_INSTANCES; k++)
+			esMatrixMultiply(&es_out[k], &instances[k], &projection);
+	es_ns = get_time_ns() - start;
+
+	start = get_time_ns();
+	for (unsigned n = 0; n < BENCH_REPEAT; n++)
+		mat4_multiply_array(fast_out, instances, &projection, BENCH_INSTANCES);
+	fast_ns = get_time_ns() - start;
+
+	err = 0.0f;
+	for (unsigned k = 0; k < BENCH_INSTANCES; k++)
+		err = fmaxf(err, max_error(&es_out[k], &fast_out[k]));
+
+	printf("%u instance multiplies (max error %g):\n", BENCH_INSTANCES, err);
+	printf("  esTransform: %7.1f us\n", (double)es_ns / BENCH_REPEAT / 1000);
+	printf("  matrix:      %7.1f us\n", (double)fast_ns / BENCH_REPEAT / 1000);
+
+	free(instances);
+
+	return 0;
+}
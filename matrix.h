@@ -0,0 +1,76 @@
+/*
+ * Copyright 2026 NXP
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sub license,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the
+ * next paragraph) shall be included in all copies or substantial portions
+ * of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT. IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+#ifndef _MATRIX_H
+#define _MATRIX_H
+
+#include "esUtil.h"
+
+/*
+ * Per frame matrix math for the scenes, on the same ESMatrix layout as
+ * esTransform.c but without its temporaries: the cube's modelview is
+ * built directly from the three rotation angles instead of multiplying
+ * up generic rotations, the projection is built once at init, and the
+ * multiplies are SSE or NEON where available.
+ */
+
+/* Build a frustum projection directly, rather than multiplied onto an
+ * existing matrix like esFrustum():
+ */
+void mat4_frustum(ESMatrix *result, float left, float right, float bottom,
+		float top, float nearZ, float farZ);
+
+/* result = a * b, in esMatrixMultiply() order.  result may alias a or b. */
+void mat4_multiply(ESMatrix *result, const ESMatrix *a, const ESMatrix *b);
+
+/* result[k] = a[k] * b for 'count' matrices, eg. per instance transforms
+ * onto a shared view projection:
+ */
+void mat4_multiply_array(ESMatrix *result, const ESMatrix *a, const ESMatrix *b,
+		unsigned count);
+
+/* Everything a scene uploads for its spinning cube each frame: */
+struct cube_frame {
+	ESMatrix modelview;
+	ESMatrix modelviewprojection;
+	GLfloat normal[9];
+};
+
+/* The cube 'distance' in front of the camera, rotated as of animation
+ * time 't' (in 1/60 s steps, see PACING_RATE):
+ */
+void cube_frame_update(struct cube_frame *frame, const ESMatrix *projection,
+		GLfloat distance, float t);
+
+struct damage_rect;
+
+/* The part of a 'width' x 'height' surface the (2 x 2 x 2) cube covers,
+ * for egl_damage():
+ */
+void cube_frame_bounds(const struct cube_frame *frame, int width, int height,
+		struct damage_rect *rect);
+
+/* Compare against esTransform.c, for --matrix-bench: */
+int matrix_bench(void);
+
+#endif /* _MATRIX_H */
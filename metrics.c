@@ -0,0 +1,359 @@
+/*
+ * Copyright 2026 NXP
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sub license,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the
+ * next paragraph) shall be included in all copies or substantial portions
+ * of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT. IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+#define _GNU_SOURCE
+
+#include <errno.h>
+#include <poll.h>
+#include <pthread.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+
+#include "cpu.h"
+#include "metrics.h"
+#include "stats.h"
+
+#ifndef KMSCUBE_BUILD
+#define KMSCUBE_BUILD "unknown"
+#endif
+
+/* how often the fps gauge is updated, and how long a client gets to send
+ * its request (if any) and take the response:
+ */
+#define FPS_INTERVAL_MS   1000
+#define REQUEST_TIMEOUT_MS 100
+#define SEND_TIMEOUT_S      1
+
+static struct {
+	int fd;
+	struct sockaddr_un addr;
+	socklen_t addr_len;
+
+	/* flips per second over the last FPS_INTERVAL_MS: */
+	double fps;
+	uint64_t fps_flips;
+	uint64_t fps_time;
+} metrics;
+
+static const struct {
+	enum stats_counter counter;
+	const char *name;
+	const char *help;
+} counters[] = {
+	{ STATS_VIDEO_DECODED,  "kmscube_video_decoded_frames_total",
+	  "Frames queued by the video decoders." },
+	{ STATS_VIDEO_DROPPED,  "kmscube_video_dropped_frames_total",
+	  "Decoded video frames which were never shown." },
+	{ STATS_VIDEO_REPEATED, "kmscube_video_repeated_frames_total",
+	  "Frames where no new video frame was ready." },
+};
+
+static uint64_t monotonic_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return (uint64_t)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+static void update_fps(void)
+{
+	uint64_t now = monotonic_ns();
+	uint64_t flips = stats_flips();
+
+	if (now - metrics.fps_time < FPS_INTERVAL_MS * 1000000ull)
+		return;
+
+	if (metrics.fps_time)
+		metrics.fps = (double)(flips - metrics.fps_flips) * 1e9 /
+				(now - metrics.fps_time);
+
+	metrics.fps_flips = flips;
+	metrics.fps_time = now;
+}
+
+static void write_histograms(FILE *f)
+{
+	unsigned int i, j;
+
+	fprintf(f, "# HELP kmscube_stage_seconds Time spent in each stage of a frame.\n"
+			"# TYPE kmscube_stage_seconds histogram\n");
+
+	/* Prometheus buckets are cumulative, bucket j ends at 2^j ns: */
+	for (i = 0; i < STATS_STAGE_COUNT; i++) {
+		const char *name = stats_stage_name(i);
+		struct stats_histogram h;
+		uint64_t seen = 0;
+
+		stats_read(i, &h);
+
+		for (j = 0; j < STATS_BUCKETS - 1; j++) {
+			seen += h.bucket[j];
+			fprintf(f, "kmscube_stage_seconds_bucket{stage=\"%s\",le=\"%g\"} %llu\n",
+					name, (double)(1ull << j) / 1e9,
+					(unsigned long long)seen);
+		}
+		fprintf(f, "kmscube_stage_seconds_bucket{stage=\"%s\",le=\"+Inf\"} %llu\n"
+				"kmscube_stage_seconds_sum{stage=\"%s\"} %.9f\n"
+				"kmscube_stage_seconds_count{stage=\"%s\"} %llu\n",
+				name, (unsigned long long)h.count,
+				name, (double)h.sum / 1e9,
+				name, (unsigned long long)h.count);
+	}
+
+	fprintf(f, "# HELP kmscube_stage_max_seconds Longest time spent in each stage.\n"
+			"# TYPE kmscube_stage_max_seconds gauge\n");
+	for (i = 0; i < STATS_STAGE_COUNT; i++) {
+		struct stats_histogram h;
+
+		stats_read(i, &h);
+		fprintf(f, "kmscube_stage_max_seconds{stage=\"%s\"} %.9f\n",
+				stats_stage_name(i), (double)h.max / 1e9);
+	}
+}
+
+/* The whole exposition, in a malloc'ed buffer: */
+static char *format_metrics(size_t *len)
+{
+	char *buf = NULL;
+	unsigned int i;
+	FILE *f;
+
+	f = open_memstream(&buf, len);
+	if (!f)
+		return NULL;
+
+	fprintf(f, "# HELP kmscube_build_info Build configuration and CPU features.\n"
+			"# TYPE kmscube_build_info gauge\n"
+			"kmscube_build_info{build=\"%s\",cpu_features=\"%s\"} 1\n",
+			KMSCUBE_BUILD, cpu_features_string());
+
+	fprintf(f, "# HELP kmscube_flips_total Completed page flips.\n"
+			"# TYPE kmscube_flips_total counter\n"
+			"kmscube_flips_total %llu\n",
+			(unsigned long long)stats_flips());
+	fprintf(f, "# HELP kmscube_missed_vblanks_total Vblanks skipped between flips.\n"
+			"# TYPE kmscube_missed_vblanks_total counter\n"
+			"kmscube_missed_vblanks_total %llu\n",
+			(unsigned long long)stats_missed_vblanks());
+	fprintf(f, "# HELP kmscube_fps Page flips per second over the last second.\n"
+			"# TYPE kmscube_fps gauge\n"
+			"kmscube_fps %.2f\n", metrics.fps);
+
+	fprintf(f, "# HELP kmscube_context_priority Granted GPU context priority: "
+			"0 default, 1 low, 2 medium, 3 high.\n"
+			"# TYPE kmscube_context_priority gauge\n"
+			"kmscube_context_priority %lld\n",
+			(long long)stats_gauge(STATS_CONTEXT_PRIORITY));
+	fprintf(f, "# HELP kmscube_render_ahead_frames Frames the GPU may lag behind, "
+			"0 unlimited.\n"
+			"# TYPE kmscube_render_ahead_frames gauge\n"
+			"kmscube_render_ahead_frames %lld\n",
+			(long long)stats_gauge(STATS_RENDER_AHEAD));
+
+	for (i = 0; i < sizeof(counters) / sizeof(counters[0]); i++)
+		fprintf(f, "# HELP %s %s\n# TYPE %s counter\n%s %llu\n",
+				counters[i].name, counters[i].help,
+				counters[i].name, counters[i].name,
+				(unsigned long long)stats_counter(counters[i].counter));
+
+	write_histograms(f);
+
+	if (fclose(f)) {
+		free(buf);
+		return NULL;
+	}
+
+	return buf;
+}
+
+static int send_all(int fd, const char *buf, size_t len)
+{
+	while (len) {
+		ssize_t ret = send(fd, buf, len, MSG_NOSIGNAL);
+
+		if (ret < 0 && errno == EINTR)
+			continue;
+		if (ret <= 0)
+			return -1;
+
+		buf += ret;
+		len -= ret;
+	}
+
+	return 0;
+}
+
+static void serve(int fd)
+{
+	struct timeval timeout = { .tv_sec = SEND_TIMEOUT_S };
+	struct pollfd pfd = { .fd = fd, .events = POLLIN };
+	char request[512];
+	ssize_t n = 0;
+	size_t len;
+	char *body;
+
+	setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout));
+
+	/* an HTTP client sends its request first, a plain one may not send
+	 * anything at all, so only wait a little for it:
+	 */
+	if (poll(&pfd, 1, REQUEST_TIMEOUT_MS) > 0)
+		n = recv(fd, request, sizeof(request) - 1, 0);
+
+	body = format_metrics(&len);
+	if (!body)
+		return;
+
+	if (n >= 4 && !memcmp(request, "GET ", 4)) {
+		char header[128];
+		int hlen = snprintf(header, sizeof(header),
+				"HTTP/1.0 200 OK\r\n"
+				"Content-Type: text/plain; version=0.0.4\r\n"
+				"Content-Length: %zu\r\n\r\n", len);
+
+		if (send_all(fd, header, hlen)) {
+			free(body);
+			return;
+		}
+	}
+
+	send_all(fd, body, len);
+	free(body);
+}
+
+static void *metrics_thread(void *arg)
+{
+	struct pollfd pfd = { .fd = metrics.fd, .events = POLLIN };
+
+	(void)arg;
+
+	while (1) {
+		int fd;
+
+		update_fps();
+
+		if (poll(&pfd, 1, FPS_INTERVAL_MS) <= 0)
+			continue;
+
+		fd = accept4(metrics.fd, NULL, NULL, SOCK_CLOEXEC);
+		if (fd < 0)
+			continue;
+
+		update_fps();
+		serve(fd);
+		close(fd);
+	}
+
+	return NULL;
+}
+
+static void metrics_unlink(void)
+{
+	unlink(metrics.addr.sun_path);
+}
+
+/* Whether something still listens on the socket at 'path': */
+static int socket_in_use(const char *path)
+{
+	struct sockaddr_un addr = { .sun_family = AF_UNIX };
+	int fd, ret;
+
+	fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+	if (fd < 0)
+		return 0;
+
+	memcpy(addr.sun_path, path, strlen(path));
+	ret = !connect(fd, (struct sockaddr *)&addr, sizeof(addr));
+	close(fd);
+
+	return ret;
+}
+
+int metrics_init(const char *path)
+{
+	size_t len = strlen(path);
+	pthread_t thread;
+	struct stat st;
+	int ret;
+
+	if (len >= sizeof(metrics.addr.sun_path)) {
+		printf("metrics socket path too long: %s\n", path);
+		return -1;
+	}
+
+	metrics.addr.sun_family = AF_UNIX;
+	memcpy(metrics.addr.sun_path, path, len);
+	metrics.addr_len = offsetof(struct sockaddr_un, sun_path) + len;
+
+	/* '@' is the abstract namespace, which needs no cleanup.  Otherwise
+	 * only a stale socket gets replaced, never some other file:
+	 */
+	if (path[0] == '@') {
+		metrics.addr.sun_path[0] = '\0';
+	} else if (!lstat(path, &st)) {
+		if (!S_ISSOCK(st.st_mode)) {
+			printf("%s exists and is not a socket\n", path);
+			return -1;
+		}
+		if (socket_in_use(path)) {
+			printf("%s is in use by another instance\n", path);
+			return -1;
+		}
+		unlink(path);
+	}
+
+	metrics.fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+	if (metrics.fd < 0) {
+		printf("failed to create metrics socket: %s\n", strerror(errno));
+		return -1;
+	}
+
+	if (bind(metrics.fd, (struct sockaddr *)&metrics.addr, metrics.addr_len) ||
+	    listen(metrics.fd, 8)) {
+		printf("failed to listen on %s: %s\n", path, strerror(errno));
+		close(metrics.fd);
+		return -1;
+	}
+
+	if (path[0] != '@')
+		atexit(metrics_unlink);
+
+	ret = pthread_create(&thread, NULL, metrics_thread, NULL);
+	if (ret) {
+		printf("failed to start metrics thread: %d\n", ret);
+		close(metrics.fd);
+		return -1;
+	}
+	pthread_detach(thread);
+
+	return 0;
+}
@@ -0,0 +1,38 @@
+/*
+ * Copyright 2026 NXP
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sub license,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the
+ * next paragraph) shall be included in all copies or substantial portions
+ * of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT. IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+#ifndef _METRICS_H
+#define _METRICS_H
+
+/*
+ * Live metrics for monitoring agents: a thread of its own listens on a
+ * Unix socket at 'path' (a leading '@' for the abstract namespace) and
+ * answers every connection with the stats counters and histograms in the
+ * Prometheus text format, then closes it.  Clients which send an HTTP
+ * request (curl --unix-socket) get an HTTP response, anything else (eg.
+ * socat) just the text.  Everything is read from the stats atomics, so
+ * scraping never blocks or slows the render threads.
+ */
+int metrics_init(const char *path);
+
+#endif /* _METRICS_H */
@@ -0,0 +1,141 @@
+/*
+ * Copyright 2026 NXP
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sub license,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the
+ * next paragraph) shall be included in all copies or substantial portions
+ * of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT. IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+#include <stdio.h>
+#include <string.h>
+
+#include "common.h"
+#include "event-loop.h"
+#include "pacing.h"
+
+/* the least slack kept on top of the render time: */
+#define PACING_MIN_MARGIN_NS  500000ull
+
+void pacing_init(struct pacing *p, uint64_t period, int low_latency)
+{
+	memset(p, 0, sizeof(*p));
+	p->low_latency = low_latency;
+	p->period = period;
+	p->margin = period / 8;
+}
+
+/* The first vblank a frame rendered from 'now' can make, and after every
+ * frame already waiting to be shown:
+ */
+static uint64_t predict(const struct pacing *p, uint64_t now)
+{
+	uint64_t ready = now + p->render + p->margin;
+	uint64_t present;
+
+	if (p->vblank) {
+		uint64_t n = 1;
+
+		if (ready > p->vblank)
+			n = (ready - p->vblank + p->period - 1) / p->period;
+		present = p->vblank + n * p->period;
+	} else {
+		/* no flip yet, so no idea of the vblank phase: */
+		present = ready + p->period;
+	}
+
+	if (p->head != p->tail) {
+		uint64_t last = p->expected[(p->tail - 1) % PACING_QUEUE];
+
+		if (present < last + p->period)
+			present = last + p->period;
+	}
+
+	return present;
+}
+
+int pacing_begin(struct pacing *p, struct event_loop *loop, float *frame)
+{
+	uint64_t now = get_time_ns();
+	uint64_t present = predict(p, now);
+	int ret;
+
+	/* frames queued ahead are shown regardless, so render right away: */
+	if (p->low_latency && p->vblank && p->head == p->tail) {
+		uint64_t start = present - p->render - p->margin;
+
+		if (start > now) {
+			ret = event_loop_dispatch_until(loop, start);
+			if (ret)
+				return ret;
+
+			now = get_time_ns();
+			present = predict(p, now);
+		}
+	}
+
+	if (!p->base)
+		p->base = present;
+
+	p->render_start = now;
+	if (p->tail - p->head < PACING_QUEUE)
+		p->expected[p->tail++ % PACING_QUEUE] = present;
+
+	*frame = (double)(present - p->base) * PACING_RATE / 1e9;
+
+	return 0;
+}
+
+void pacing_end(struct pacing *p)
+{
+	uint64_t ns = get_time_ns() - p->render_start;
+
+	p->render = p->render ? (p->render * 7 + ns) / 8 : ns;
+}
+
+void pacing_flip(struct pacing *p, unsigned int sequence,
+		unsigned int sec, unsigned int usec)
+{
+	/* flip event timestamps are CLOCK_MONOTONIC: */
+	uint64_t vblank = (uint64_t)sec * 1000000000ull + usec * 1000ull;
+	uint64_t expected;
+
+	if (p->vblank && sequence != p->sequence && vblank > p->vblank) {
+		uint64_t measured = (vblank - p->vblank) / (sequence - p->sequence);
+
+		/* anything way off is more likely a mode change than drift: */
+		if (measured > p->period * 3 / 4 && measured < p->period * 5 / 4)
+			p->period = (p->period * 15 + measured) / 16;
+	}
+
+	p->vblank = vblank;
+	p->sequence = sequence;
+
+	if (p->head == p->tail)
+		return;
+
+	expected = p->expected[p->head++ % PACING_QUEUE];
+
+	if (vblank > expected + p->period / 2) {
+		p->missed++;
+		p->margin += p->period / 8;
+		if (p->margin > p->period / 2)
+			p->margin = p->period / 2;
+	} else if (p->margin > PACING_MIN_MARGIN_NS) {
+		p->margin -= (p->margin - PACING_MIN_MARGIN_NS) / 64;
+	}
+}
@@ -0,0 +1,88 @@
+/*
+ * Copyright 2026 NXP
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sub license,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the
+ * next paragraph) shall be included in all copies or substantial portions
+ * of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT. IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+#ifndef _PACING_H
+#define _PACING_H
+
+#include <stdint.h>
+
+/*
+ * Frame pacing for the KMS backends.  The page flip events say when each
+ * flip actually hit the screen, and from those (and the refresh period,
+ * measured as it goes) the presentation time of the frame about to be
+ * rendered is predicted.  The scenes animate by that time rather than by
+ * the frame count, so the speed doesn't depend on the refresh rate and a
+ * dropped frame skips ahead instead of stuttering.
+ *
+ * With 'low_latency' set, rendering is also held back until just before
+ * the last moment it can start and still make its vblank.  How long that
+ * is gets learned from the render times, plus a margin which grows on
+ * every missed vblank and slowly shrinks back while none are missed.
+ */
+
+/* the scenes' animation steps are per 1/60 s: */
+#define PACING_RATE   60
+
+/* predicted presentation times of the frames rendered but not yet on
+ * screen, more than the deepest swap chain:
+ */
+#define PACING_QUEUE  8
+
+struct pacing {
+	int low_latency;
+
+	uint64_t period;          /* refresh period, ns */
+	uint64_t vblank;          /* CLOCK_MONOTONIC time of the last flip, or 0 */
+	unsigned int sequence;    /* and its vblank count */
+	uint64_t base;            /* presentation time of animation frame 0 */
+
+	uint64_t render_start;
+	uint64_t render;          /* running average of the CPU render time */
+	uint64_t margin;          /* slack on top of that */
+	uint64_t missed;
+
+	uint64_t expected[PACING_QUEUE];
+	unsigned int head, tail;
+};
+
+/* Start over from the nominal refresh period of the mode: */
+void pacing_init(struct pacing *p, uint64_t period, int low_latency);
+
+struct event_loop;
+
+/* Predict when a frame rendered now will be on screen, returning its
+ * animation time in PACING_RATE frames in 'frame', and mark its render as
+ * started.  With low latency (and nothing else waiting to be shown), the
+ * loop's events are dispatched until it's time to start rendering first.
+ * Returns the loop's non-zero result if it stopped.
+ */
+int pacing_begin(struct pacing *p, struct event_loop *loop, float *frame);
+
+/* The frame pacing_begin() started is rendered and queued: */
+void pacing_end(struct pacing *p);
+
+/* The oldest frame rendered is on screen, as of the flip event's vblank: */
+void pacing_flip(struct pacing *p, unsigned int sequence,
+		unsigned int sec, unsigned int usec);
+
+#endif /* _PACING_H */
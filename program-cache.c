@@ -0,0 +1,339 @@
+/*
+ * Copyright 2026 NXP
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sub license,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the
+ * next paragraph) shall be included in all copies or substantial portions
+ * of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT. IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+#define _GNU_SOURCE
+
+#include <errno.h>
+#include <fcntl.h>
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#include "common.h"
+#include "program-cache.h"
+
+#define CACHE_MAGIC   0x4250434b  /* "KCPB" */
+#define CACHE_VERSION 1
+
+/* programs created but not linked yet, every scene has one or two: */
+#define MAX_PENDING  8
+#define MAX_BINDINGS 8
+
+struct cache_header {
+	uint32_t magic;
+	uint32_t version;
+	uint64_t key;
+	uint64_t build_ns;     /* what compiling and linking took */
+	uint32_t format;
+	uint32_t length;
+};
+
+struct pending {
+	GLuint program;
+	const char *vs_src, *fs_src;
+	unsigned int nbindings;
+	struct {
+		GLuint index;
+		const char *name;
+	} bindings[MAX_BINDINGS];
+};
+
+static struct {
+	int checked, enabled;
+	char dir[256];
+	PFNGLGETPROGRAMBINARYOESPROC glGetProgramBinaryOES;
+	PFNGLPROGRAMBINARYOESPROC glProgramBinaryOES;
+	struct pending pending[MAX_PENDING];
+} cache;
+
+/* mkdir -p, for the last component and its parent: */
+static int make_dir(const char *path)
+{
+	char parent[sizeof(cache.dir)];
+	char *slash;
+
+	if (!mkdir(path, 0755) || errno == EEXIST)
+		return 0;
+
+	snprintf(parent, sizeof(parent), "%s", path);
+	slash = strrchr(parent, '/');
+	if (!slash || slash == parent)
+		return -1;
+	*slash = '\0';
+
+	if (mkdir(parent, 0755) && errno != EEXIST)
+		return -1;
+
+	return mkdir(path, 0755) && errno != EEXIST ? -1 : 0;
+}
+
+static int cache_init(void)
+{
+	const char *exts = (const char *)glGetString(GL_EXTENSIONS);
+	const char *xdg = getenv("XDG_CACHE_HOME");
+	const char *home = getenv("HOME");
+	GLint formats = 0;
+
+	if (!exts || !strstr(exts, "GL_OES_get_program_binary"))
+		return 0;
+
+	glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS_OES, &formats);
+	if (formats < 1)
+		return 0;
+
+	cache.glGetProgramBinaryOES = (void *)eglGetProcAddress("glGetProgramBinaryOES");
+	cache.glProgramBinaryOES = (void *)eglGetProcAddress("glProgramBinaryOES");
+	if (!cache.glGetProgramBinaryOES || !cache.glProgramBinaryOES)
+		return 0;
+
+	if (xdg && xdg[0])
+		snprintf(cache.dir, sizeof(cache.dir), "%s/kmscube", xdg);
+	else if (home && home[0])
+		snprintf(cache.dir, sizeof(cache.dir), "%s/.cache/kmscube", home);
+	else
+		return 0;
+
+	if (make_dir(cache.dir)) {
+		printf("can't create %s: %s, not caching programs\n", cache.dir, strerror(errno));
+		return 0;
+	}
+
+	return 1;
+}
+
+static struct pending * find_pending(GLuint program)
+{
+	for (unsigned i = 0; i < MAX_PENDING; i++)
+		if (cache.pending[i].program == program)
+			return &cache.pending[i];
+
+	return NULL;
+}
+
+int program_cache_defer(GLuint program, const char *vs_src, const char *fs_src)
+{
+	struct pending *p;
+
+	if (!cache.checked) {
+		cache.checked = 1;
+		cache.enabled = cache_init();
+	}
+
+	if (!cache.enabled)
+		return 0;
+
+	/* a free slot, or just compile right away: */
+	p = find_pending(0);
+	if (!p)
+		return 0;
+
+	memset(p, 0, sizeof(*p));
+	p->program = program;
+	p->vs_src = vs_src;
+	p->fs_src = fs_src;
+
+	return 1;
+}
+
+void program_cache_bind_attrib(GLuint program, GLuint index, const char *name)
+{
+	struct pending *p = program ? find_pending(program) : NULL;
+
+	if (!p)
+		return;
+
+	/* with too many to key on, fall back to not caching this one: */
+	if (p->nbindings == MAX_BINDINGS) {
+		p->nbindings = MAX_BINDINGS + 1;
+		return;
+	}
+	if (p->nbindings > MAX_BINDINGS)
+		return;
+
+	p->bindings[p->nbindings].index = index;
+	p->bindings[p->nbindings].name = name;
+	p->nbindings++;
+}
+
+/* FNV-1a: */
+static uint64_t hash(uint64_t h, const void *data, size_t len)
+{
+	const uint8_t *p = data;
+
+	while (len--)
+		h = (h ^ *p++) * 0x100000001b3ull;
+
+	return h;
+}
+
+static uint64_t hash_str(uint64_t h, const char *s)
+{
+	/* including the terminator, so "ab" "c" differs from "a" "bc": */
+	return hash(h, s ? s : "", s ? strlen(s) + 1 : 1);
+}
+
+static uint64_t program_key(const struct pending *p)
+{
+	uint64_t h = 0xcbf29ce484222325ull;
+
+	h = hash_str(h, (const char *)glGetString(GL_RENDERER));
+	h = hash_str(h, (const char *)glGetString(GL_VERSION));
+	h = hash_str(h, p->vs_src);
+	h = hash_str(h, p->fs_src);
+
+	for (unsigned i = 0; i < p->nbindings; i++) {
+		h = hash(h, &p->bindings[i].index, sizeof(p->bindings[i].index));
+		h = hash_str(h, p->bindings[i].name);
+	}
+
+	return h;
+}
+
+/* Returns build time of the binary (ie. the time saved) if the driver
+ * took it, 0 otherwise:
+ */
+static uint64_t load_binary(GLuint program, const char *path, uint64_t key)
+{
+	struct cache_header hdr;
+	void *data = NULL;
+	GLint linked = 0;
+	int fd;
+
+	fd = open(path, O_RDONLY | O_CLOEXEC);
+	if (fd < 0)
+		return 0;
+
+	if (read(fd, &hdr, sizeof(hdr)) != sizeof(hdr) ||
+			hdr.magic != CACHE_MAGIC || hdr.version != CACHE_VERSION ||
+			hdr.key != key || !hdr.length || hdr.length > (64 << 20))
+		goto out;
+
+	data = malloc(hdr.length);
+	if (!data || read(fd, data, hdr.length) != (ssize_t)hdr.length)
+		goto out;
+
+	cache.glProgramBinaryOES(program, hdr.format, data, hdr.length);
+	glGetProgramiv(program, GL_LINK_STATUS, &linked);
+
+out:
+	free(data);
+	close(fd);
+
+	return linked ? (hdr.build_ns ? hdr.build_ns : 1) : 0;
+}
+
+static void store_binary(GLuint program, const char *path, uint64_t key,
+		uint64_t build_ns)
+{
+	struct cache_header hdr = {
+		.magic = CACHE_MAGIC,
+		.version = CACHE_VERSION,
+		.key = key,
+		.build_ns = build_ns,
+	};
+	char tmp[sizeof(cache.dir) + 64];
+	GLint length = 0;
+	GLenum format;
+	void *data;
+	int fd, ok;
+
+	glGetProgramiv(program, GL_PROGRAM_BINARY_LENGTH_OES, &length);
+	if (length <= 0)
+		return;
+
+	data = malloc(length);
+	if (!data)
+		return;
+
+	cache.glGetProgramBinaryOES(program, length, &length, &format, data);
+	hdr.format = format;
+	hdr.length = length;
+
+	/* write it aside and rename, so a reader never sees half a file: */
+	snprintf(tmp, sizeof(tmp), "%s.%d", path, getpid());
+	fd = open(tmp, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+	if (fd < 0) {
+		free(data);
+		return;
+	}
+
+	ok = write(fd, &hdr, sizeof(hdr)) == sizeof(hdr) &&
+		write(fd, data, length) == length;
+	close(fd);
+	free(data);
+
+	if (!ok || rename(tmp, path))
+		unlink(tmp);
+}
+
+int program_cache_link(GLuint program,
+		int (*build)(GLuint program, const char *vs_src, const char *fs_src))
+{
+	struct pending *p = program ? find_pending(program) : NULL;
+	struct pending deferred;
+	char path[sizeof(cache.dir) + 32];
+	uint64_t key, start, saved;
+	int ret;
+
+	if (!p)
+		return 1;
+
+	deferred = *p;
+	p->program = 0;
+
+	if (deferred.nbindings > MAX_BINDINGS)
+		return build(program, deferred.vs_src, deferred.fs_src);
+
+	key = program_key(&deferred);
+	snprintf(path, sizeof(path), "%s/%016" PRIx64 ".bin", cache.dir, key);
+
+	start = get_time_ns();
+	saved = load_binary(program, path, key);
+	if (saved) {
+		uint64_t load = get_time_ns() - start;
+
+		printf("program %016" PRIx64 " loaded from cache in %.1f ms, %.1f ms saved\n",
+				key, load / 1e6, saved > load ? (saved - load) / 1e6 : 0.0);
+		return 0;
+	}
+
+	/* rejected (eg. a driver update with the same version string), or
+	 * just not there yet:
+	 */
+	if (access(path, F_OK) == 0) {
+		printf("program %016" PRIx64 " binary rejected, compiling\n", key);
+		unlink(path);
+	}
+
+	start = get_time_ns();
+	ret = build(program, deferred.vs_src, deferred.fs_src);
+	if (ret)
+		return ret;
+
+	store_binary(program, path, key, get_time_ns() - start);
+
+	return 0;
+}
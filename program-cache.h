@@ -0,0 +1,55 @@
+/*
+ * Copyright 2026 NXP
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sub license,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the
+ * next paragraph) shall be included in all copies or substantial portions
+ * of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT. IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+#ifndef _PROGRAM_CACHE_H
+#define _PROGRAM_CACHE_H
+
+#include <GLES2/gl2.h>
+
+/*
+ * On-disk cache of linked program binaries (GL_OES_get_program_binary),
+ * under $XDG_CACHE_HOME/kmscube (or ~/.cache/kmscube).  Binaries are
+ * keyed by a hash of the shader sources, the attribute bindings and
+ * GL_RENDERER/GL_VERSION, so a driver update just misses the cache.
+ *
+ * With the cache active, create_program() defers compiling to
+ * link_program(), which skips it altogether when there is a binary the
+ * driver accepts, and falls back to the sources when it is rejected.
+ */
+
+/* Record a new program's sources instead of compiling them.  Returns
+ * 0 if there is no cache (no extension, or nowhere to put it):
+ */
+int program_cache_defer(GLuint program, const char *vs_src, const char *fs_src);
+
+/* Note an attribute binding of a deferred program, for the key: */
+void program_cache_bind_attrib(GLuint program, GLuint index, const char *name);
+
+/* Link a deferred program, from the cache or else by calling build()
+ * (compile, attach and link), and store the result.  Returns 1 if the
+ * program was not deferred, otherwise build()'s result:
+ */
+int program_cache_link(GLuint program,
+		int (*build)(GLuint program, const char *vs_src, const char *fs_src));
+
+#endif /* _PROGRAM_CACHE_H */
@@ -0,0 +1,370 @@
+/*
+ * Copyright 2026 NXP
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sub license,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the
+ * next paragraph) shall be included in all copies or substantial portions
+ * of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT. IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+#define _GNU_SOURCE
+
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include "stats.h"
+
+struct histogram {
+	atomic_uint_fast64_t count;
+	atomic_uint_fast64_t sum;
+	atomic_uint_fast64_t max;
+	atomic_uint_fast64_t bucket[STATS_BUCKETS];
+};
+
+static const char * const stage_names[STATS_STAGE_COUNT] = {
+	[STATS_AHEAD]  = "ahead",
+	[STATS_DRAW]   = "draw",
+	[STATS_SWAP]   = "swap",
+	[STATS_FENCE]  = "fence",
+	[STATS_LOCK]   = "lock",
+	[STATS_WAIT]   = "wait",
+	[STATS_COMMIT] = "commit",
+	[STATS_FLIP]   = "flip",
+	[STATS_VBLANK] = "vblank",
+	[STATS_GPU]    = "gpu",
+};
+
+static struct {
+	int enabled;
+	unsigned int interval;
+
+	struct histogram hist[STATS_STAGE_COUNT];
+	atomic_uint_fast64_t flips;
+	atomic_uint_fast64_t missed;      /* vblanks skipped between flips */
+	atomic_uint_fast64_t counter[STATS_COUNTER_COUNT];
+	atomic_int_fast64_t gauge[STATS_GAUGE_COUNT];
+} stats;
+
+/* -p: when each phase of the init finished, up to the first flip.  The
+ * phases of different outputs and threads overlap, so slots are claimed
+ * atomically and the report only shows the ones filled in by then:
+ */
+#define STARTUP_PHASES 32
+
+static struct {
+	uint64_t start;
+	atomic_uint count;
+	atomic_int reported;
+	struct {
+		const char *name;
+		uint64_t ns;
+		atomic_int valid;
+	} phase[STARTUP_PHASES];
+} startup;
+
+/* Each run loop (and its flip handler) has a thread of its own, so with
+ * leases every output tracks its own flips:
+ */
+static _Thread_local uint64_t last_commit;
+static _Thread_local uint64_t last_vblank;
+static _Thread_local unsigned int last_sequence;
+
+static uint64_t monotonic_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return (uint64_t)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+static void histogram_add(struct histogram *h, uint64_t ns)
+{
+	unsigned int i = ns ? 64 - __builtin_clzll(ns) : 0;
+	uint_fast64_t max;
+
+	if (i >= STATS_BUCKETS)
+		i = STATS_BUCKETS - 1;
+
+	atomic_fetch_add_explicit(&h->bucket[i], 1, memory_order_relaxed);
+	atomic_fetch_add_explicit(&h->sum, ns, memory_order_relaxed);
+	atomic_fetch_add_explicit(&h->count, 1, memory_order_relaxed);
+
+	max = atomic_load_explicit(&h->max, memory_order_relaxed);
+	while (ns > max && !atomic_compare_exchange_weak_explicit(&h->max,
+				&max, ns, memory_order_relaxed, memory_order_relaxed))
+		;
+}
+
+/* upper bound of the bucket the given percentile falls in (but no more
+ * than the largest sample), in us:
+ */
+static double histogram_percentile(const uint64_t *bucket, uint64_t count,
+		uint64_t max, unsigned int percent)
+{
+	uint64_t target = (count * percent + 99) / 100;
+	uint64_t seen = 0;
+	unsigned int i;
+
+	for (i = 0; i < STATS_BUCKETS; i++) {
+		seen += bucket[i];
+		if (seen >= target)
+			break;
+	}
+
+	if (i < 64 && (1ull << i) < max)
+		max = 1ull << i;
+
+	return (double)max / 1000.0;
+}
+
+void stats_read(enum stats_stage stage, struct stats_histogram *snap)
+{
+	struct histogram *h = &stats.hist[stage];
+	unsigned int i;
+
+	snap->count = 0;
+	for (i = 0; i < STATS_BUCKETS; i++) {
+		snap->bucket[i] = atomic_load_explicit(&h->bucket[i], memory_order_relaxed);
+		snap->count += snap->bucket[i];
+	}
+	snap->sum = atomic_load_explicit(&h->sum, memory_order_relaxed);
+	snap->max = atomic_load_explicit(&h->max, memory_order_relaxed);
+}
+
+const char *stats_stage_name(enum stats_stage stage)
+{
+	return stage_names[stage];
+}
+
+static void stats_dump(void)
+{
+	unsigned int i;
+
+	printf("stats: %llu flips, %llu missed vblanks\n",
+			(unsigned long long)atomic_load(&stats.flips),
+			(unsigned long long)atomic_load(&stats.missed));
+	printf("  %-8s %10s %10s %10s %10s %10s\n", "stage", "count",
+			"avg(us)", "p50(us)", "p99(us)", "max(us)");
+
+	for (i = 0; i < STATS_STAGE_COUNT; i++) {
+		struct histogram *h = &stats.hist[i];
+		struct stats_histogram snap;
+
+		stats_read(i, &snap);
+		if (!snap.count)
+			continue;
+
+		printf("  %-8s %10llu %10.1f %10.1f %10.1f %10.1f\n", stage_names[i],
+				(unsigned long long)snap.count,
+				(double)snap.sum / atomic_load(&h->count) / 1000.0,
+				histogram_percentile(snap.bucket, snap.count, snap.max, 50),
+				histogram_percentile(snap.bucket, snap.count, snap.max, 99),
+				(double)snap.max / 1000.0);
+	}
+
+	fflush(stdout);
+}
+
+static void *stats_thread(void *arg)
+{
+	struct timespec interval = { .tv_sec = stats.interval };
+
+	(void)arg;
+
+	while (1) {
+		nanosleep(&interval, NULL);
+		stats_dump();
+	}
+
+	return NULL;
+}
+
+int stats_init(unsigned int interval, int dump)
+{
+	pthread_t thread;
+	int ret;
+
+	stats.interval = interval;
+
+	if (dump && interval) {
+		ret = pthread_create(&thread, NULL, stats_thread, NULL);
+		if (ret) {
+			printf("failed to start stats thread: %d\n", ret);
+			return -1;
+		}
+		pthread_detach(thread);
+	}
+
+	/* the run loops return on SIGINT/SIGTERM, so this covers those too: */
+	if (dump)
+		atexit(stats_dump);
+
+	stats.enabled = 1;
+
+	return 0;
+}
+
+int stats_enabled(void)
+{
+	return stats.enabled;
+}
+
+uint64_t stats_flips(void)
+{
+	return atomic_load_explicit(&stats.flips, memory_order_relaxed);
+}
+
+uint64_t stats_missed_vblanks(void)
+{
+	return atomic_load_explicit(&stats.missed, memory_order_relaxed);
+}
+
+uint64_t stats_counter(enum stats_counter counter)
+{
+	return atomic_load_explicit(&stats.counter[counter], memory_order_relaxed);
+}
+
+uint64_t stats_now(void)
+{
+	if (!stats.enabled)
+		return 0;
+
+	return monotonic_ns();
+}
+
+uint64_t stats_record(enum stats_stage stage, uint64_t start)
+{
+	uint64_t now;
+
+	if (!stats.enabled)
+		return 0;
+
+	now = monotonic_ns();
+	histogram_add(&stats.hist[stage], now - start);
+
+	if (stage == STATS_COMMIT)
+		last_commit = now;
+
+	return now;
+}
+
+void stats_add(enum stats_stage stage, uint64_t ns)
+{
+	if (!stats.enabled)
+		return;
+
+	histogram_add(&stats.hist[stage], ns);
+}
+
+void stats_count(enum stats_counter counter)
+{
+	if (!stats.enabled)
+		return;
+
+	atomic_fetch_add_explicit(&stats.counter[counter], 1, memory_order_relaxed);
+}
+
+void stats_set(enum stats_gauge gauge, int64_t value)
+{
+	atomic_store_explicit(&stats.gauge[gauge], value, memory_order_relaxed);
+}
+
+int64_t stats_gauge(enum stats_gauge gauge)
+{
+	return atomic_load_explicit(&stats.gauge[gauge], memory_order_relaxed);
+}
+
+void stats_flip(unsigned int sequence, unsigned int sec, unsigned int usec)
+{
+	/* flip event timestamps are CLOCK_MONOTONIC too: */
+	uint64_t vblank = (uint64_t)sec * 1000000000ull + usec * 1000ull;
+
+	if (!stats.enabled)
+		return;
+
+	atomic_fetch_add_explicit(&stats.flips, 1, memory_order_relaxed);
+
+	if (last_commit && vblank > last_commit)
+		histogram_add(&stats.hist[STATS_FLIP], vblank - last_commit);
+
+	if (last_vblank) {
+		histogram_add(&stats.hist[STATS_VBLANK], vblank - last_vblank);
+		if (sequence - last_sequence > 1)
+			atomic_fetch_add_explicit(&stats.missed,
+					sequence - last_sequence - 1, memory_order_relaxed);
+	}
+
+	last_vblank = vblank;
+	last_sequence = sequence;
+}
+
+void stats_startup_begin(uint64_t start)
+{
+	startup.start = start;
+}
+
+void stats_startup(const char *phase)
+{
+	uint64_t now;
+	unsigned int n;
+
+	if (!startup.start)
+		return;
+
+	now = monotonic_ns();
+	n = atomic_fetch_add(&startup.count, 1);
+	if (n >= STARTUP_PHASES)
+		return;
+
+	startup.phase[n].name = phase;
+	startup.phase[n].ns = now - startup.start;
+	atomic_store_explicit(&startup.phase[n].valid, 1, memory_order_release);
+}
+
+void stats_startup_done(const char *phase)
+{
+	uint64_t last = 0;
+	unsigned int i, count;
+
+	if (!startup.start ||
+	    atomic_load_explicit(&startup.reported, memory_order_relaxed) ||
+	    atomic_exchange(&startup.reported, 1))
+		return;
+
+	stats_startup(phase);
+
+	count = atomic_load(&startup.count);
+	if (count > STARTUP_PHASES)
+		count = STARTUP_PHASES;
+
+	printf("startup: %s after %.1f ms\n", phase,
+			(monotonic_ns() - startup.start) / 1e6);
+	for (i = 0; i < count; i++) {
+		if (!atomic_load_explicit(&startup.phase[i].valid, memory_order_acquire))
+			continue;
+
+		printf("  %-14s %8.1f ms  (+%.1f)\n", startup.phase[i].name,
+				startup.phase[i].ns / 1e6,
+				(startup.phase[i].ns - last) / 1e6);
+		last = startup.phase[i].ns;
+	}
+	fflush(stdout);
+}
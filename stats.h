@@ -0,0 +1,134 @@
+/*
+ * Copyright 2026 NXP
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sub license,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the
+ * next paragraph) shall be included in all copies or substantial portions
+ * of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT. IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+#ifndef _STATS_H
+#define _STATS_H
+
+#include <stdint.h>
+
+/*
+ * Frame timing instrumentation.  The run loops timestamp each stage of a
+ * frame, the page flip handlers report the vblank the flip landed on and
+ * egl_draw() the GPU time of each draw, read back from timer queries.
+ * Everything goes into fixed size log2 histograms updated with atomics,
+ * so recording is cheap enough to leave on: no locks, allocation or
+ * printing on the hot path.  A separate thread dumps the histograms
+ * periodically, and they are dumped once more at exit.
+ */
+
+enum stats_stage {
+	STATS_AHEAD,          /* CPU wait for the GPU, egl_wait_render_ahead() */
+	STATS_DRAW,           /* egl->draw() */
+	STATS_SWAP,           /* eglSwapBuffers() */
+	STATS_FENCE,          /* eglDupNativeFenceFDANDROID() */
+	STATS_LOCK,           /* gbm_surface_lock_front_buffer() + fb lookup */
+	STATS_WAIT,           /* CPU wait for the previous flip to complete */
+	STATS_COMMIT,         /* atomic commit or page flip ioctl */
+	STATS_FLIP,           /* end of commit to the flip's vblank */
+	STATS_VBLANK,         /* vblank to vblank, between flips */
+	STATS_GPU,            /* egl->draw() on the GPU, from timer queries */
+	STATS_STAGE_COUNT
+};
+
+/* Event counters, from wherever they happen: */
+enum stats_counter {
+	STATS_VIDEO_DECODED,  /* frames queued by the decoder */
+	STATS_VIDEO_DROPPED,  /* decoded frames never shown */
+	STATS_VIDEO_REPEATED, /* frames where the video had nothing new */
+	STATS_COUNTER_COUNT
+};
+
+/* Settings which may end up other than asked for: */
+enum stats_gauge {
+	STATS_CONTEXT_PRIORITY, /* granted: 0 default, 1 low, 2 medium, 3 high */
+	STATS_RENDER_AHEAD,     /* frames the GPU may lag behind, 0 unlimited */
+	STATS_GAUGE_COUNT
+};
+
+/* Bucket i counts durations of [2^(i-1), 2^i) ns, the last one catches
+ * everything from ~4s up:
+ */
+#define STATS_BUCKETS 33
+
+/* A snapshot of one stage, for exporting: */
+struct stats_histogram {
+	uint64_t count;
+	uint64_t sum;
+	uint64_t max;
+	uint64_t bucket[STATS_BUCKETS];
+};
+
+/* Start the instrumentation.  With 'dump' set, the histograms are dumped
+ * every 'interval' seconds (0 for only at exit) and at exit, otherwise
+ * they are only recorded, for the likes of stats_missed_vblanks().
+ */
+int stats_init(unsigned int interval, int dump);
+
+/* CLOCK_MONOTONIC time in ns, or 0 if stats are not enabled: */
+uint64_t stats_now(void);
+
+/* Record a stage which began at 'start' (from stats_now() or a previous
+ * stats_record()) and ends now.  Returns the end time, so consecutive
+ * stages can be chained.
+ */
+uint64_t stats_record(enum stats_stage stage, uint64_t start);
+
+/* Record a stage timed some other way, eg. by the GPU: */
+void stats_add(enum stats_stage stage, uint64_t ns);
+
+/* Record a completed flip, with the vblank sequence and timestamp from
+ * the page flip event:
+ */
+void stats_flip(unsigned int sequence, unsigned int sec, unsigned int usec);
+
+void stats_count(enum stats_counter counter);
+
+/* Recorded whether or not stats are enabled, as they're set at init: */
+void stats_set(enum stats_gauge gauge, int64_t value);
+int64_t stats_gauge(enum stats_gauge gauge);
+
+int stats_enabled(void);
+uint64_t stats_flips(void);
+uint64_t stats_missed_vblanks(void);
+uint64_t stats_counter(enum stats_counter counter);
+
+/* Read one stage without stopping the writers, so the snapshot may be a
+ * few samples off, which is fine for monitoring.  count is the sum of the
+ * buckets, so the two always agree:
+ */
+void stats_read(enum stats_stage stage, struct stats_histogram *h);
+const char *stats_stage_name(enum stats_stage stage);
+
+/*
+ * Startup profile: stats_startup_begin() enables it, with the
+ * CLOCK_MONOTONIC time main() was entered, then each init phase marks its
+ * end with stats_startup(), from whichever thread it ran on.
+ * stats_startup_done() marks the first flip (or frame) and prints the
+ * time of every phase since the start, once.  These work independently
+ * of stats_init().
+ */
+void stats_startup_begin(uint64_t start);
+void stats_startup(const char *phase);
+void stats_startup_done(const char *phase);
+
+#endif /* _STATS_H */
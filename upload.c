@@ -0,0 +1,311 @@
+/*
+ * Copyright 2026 NXP
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sub license,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the
+ * next paragraph) shall be included in all copies or substantial portions
+ * of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT. IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+#define _GNU_SOURCE
+
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <gbm.h>
+
+#include "common.h"
+#include "cpu.h"
+#include "upload.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#endif
+
+struct upload_path {
+	const char *name;
+	int (*supported)(void);
+	void (*copy)(void *dst, const void *src, size_t n);
+	void (*fence)(void);      /* orders the non-temporal stores, or NULL */
+};
+
+static int always(void)
+{
+	return 1;
+}
+
+static void copy_memcpy(void *dst, const void *src, size_t n)
+{
+	memcpy(dst, src, n);
+}
+
+/* Plain stores until the destination is aligned for the streaming ones,
+ * returns how many bytes that took:
+ */
+static size_t copy_head(void *dst, const void *src, size_t n, size_t align)
+{
+	size_t head = (align - ((uintptr_t)dst & (align - 1))) & (align - 1);
+
+	if (head > n)
+		head = n;
+	memcpy(dst, src, head);
+
+	return head;
+}
+
+#if defined(__SSE2__)
+static int has_sse2(void)
+{
+	return cpu_features() & CPU_SSE2;
+}
+
+static void copy_sse2(void *dst, const void *src, size_t n)
+{
+	size_t head = copy_head(dst, src, n, 16);
+	uint8_t *d = (uint8_t *)dst + head;
+	const uint8_t *s = (const uint8_t *)src + head;
+
+	for (n -= head; n >= 64; n -= 64, d += 64, s += 64) {
+		__m128i a = _mm_loadu_si128((const __m128i *)s);
+		__m128i b = _mm_loadu_si128((const __m128i *)s + 1);
+		__m128i c = _mm_loadu_si128((const __m128i *)s + 2);
+		__m128i e = _mm_loadu_si128((const __m128i *)s + 3);
+
+		_mm_stream_si128((__m128i *)d, a);
+		_mm_stream_si128((__m128i *)d + 1, b);
+		_mm_stream_si128((__m128i *)d + 2, c);
+		_mm_stream_si128((__m128i *)d + 3, e);
+	}
+
+	for (; n >= 16; n -= 16, d += 16, s += 16)
+		_mm_stream_si128((__m128i *)d, _mm_loadu_si128((const __m128i *)s));
+
+	memcpy(d, s, n);
+}
+
+static void fence_sse(void)
+{
+	_mm_sfence();
+}
+#endif
+
+#if defined(__x86_64__) && defined(__GNUC__)
+static int has_avx2(void)
+{
+	return cpu_features() & CPU_AVX2;
+}
+
+__attribute__((target("avx2")))
+static void copy_avx2(void *dst, const void *src, size_t n)
+{
+	size_t head = copy_head(dst, src, n, 32);
+	uint8_t *d = (uint8_t *)dst + head;
+	const uint8_t *s = (const uint8_t *)src + head;
+
+	for (n -= head; n >= 128; n -= 128, d += 128, s += 128) {
+		__m256i a = _mm256_loadu_si256((const __m256i *)s);
+		__m256i b = _mm256_loadu_si256((const __m256i *)s + 1);
+		__m256i c = _mm256_loadu_si256((const __m256i *)s + 2);
+		__m256i e = _mm256_loadu_si256((const __m256i *)s + 3);
+
+		_mm256_stream_si256((__m256i *)d, a);
+		_mm256_stream_si256((__m256i *)d + 1, b);
+		_mm256_stream_si256((__m256i *)d + 2, c);
+		_mm256_stream_si256((__m256i *)d + 3, e);
+	}
+
+	for (; n >= 32; n -= 32, d += 32, s += 32)
+		_mm256_stream_si256((__m256i *)d, _mm256_loadu_si256((const __m256i *)s));
+
+	memcpy(d, s, n);
+}
+#endif
+
+#if defined(__aarch64__)
+static int has_neon(void)
+{
+	return cpu_features() & CPU_NEON;
+}
+
+/* there are no intrinsics for stnp, the non-temporal store pair: */
+static void copy_neon(void *dst, const void *src, size_t n)
+{
+	size_t head = copy_head(dst, src, n, 16);
+	uint8_t *d = (uint8_t *)dst + head;
+	const uint8_t *s = (const uint8_t *)src + head;
+
+	for (n -= head; n >= 64; n -= 64, d += 64, s += 64) {
+		__asm__ volatile(
+			"ldp q0, q1, [%[s]]\n"
+			"ldp q2, q3, [%[s], #32]\n"
+			"stnp q0, q1, [%[d]]\n"
+			"stnp q2, q3, [%[d], #32]\n"
+			: : [s] "r" (s), [d] "r" (d)
+			: "v0", "v1", "v2", "v3", "memory");
+	}
+
+	memcpy(d, s, n);
+}
+
+static void fence_neon(void)
+{
+	__asm__ volatile("dmb ishst" : : : "memory");
+}
+#endif
+
+/* in order of preference: */
+static const struct upload_path paths[] = {
+#if defined(__x86_64__) && defined(__GNUC__)
+	{ "avx2", has_avx2, copy_avx2, fence_sse },
+#endif
+#if defined(__SSE2__)
+	{ "sse2", has_sse2, copy_sse2, fence_sse },
+#endif
+#if defined(__aarch64__)
+	{ "neon", has_neon, copy_neon, fence_neon },
+#endif
+	{ "memcpy", always, copy_memcpy, NULL },
+};
+
+#define NUM_PATHS (sizeof(paths) / sizeof(paths[0]))
+
+static const struct upload_path *path;
+static pthread_once_t path_once = PTHREAD_ONCE_INIT;
+
+static void choose_path(void)
+{
+	const char *name = getenv("KMSCUBE_UPLOAD");
+	unsigned i;
+
+	for (i = 0; i < NUM_PATHS && !path; i++)
+		if (name && !strcmp(name, paths[i].name) && paths[i].supported())
+			path = &paths[i];
+
+	if (name && !path)
+		printf("upload path %s not available\n", name);
+
+	for (i = 0; i < NUM_PATHS && !path; i++)
+		if (paths[i].supported())
+			path = &paths[i];
+
+	printf("Using %s upload path\n", path->name);
+}
+
+static void copy_rows(const struct upload_path *p, void *dst, size_t dst_stride,
+		const void *src, size_t src_stride, size_t width, size_t rows)
+{
+	size_t i;
+
+	if (dst_stride == width && src_stride == width) {
+		p->copy(dst, src, width * rows);
+	} else {
+		for (i = 0; i < rows; i++)
+			p->copy((uint8_t *)dst + i * dst_stride,
+					(const uint8_t *)src + i * src_stride, width);
+	}
+
+	if (p->fence)
+		p->fence();
+}
+
+void upload_copy(void *dst, size_t dst_stride, const void *src, size_t src_stride,
+		size_t width, size_t rows)
+{
+	pthread_once(&path_once, choose_path);
+
+	copy_rows(path, dst, dst_stride, src, src_stride, width, rows);
+}
+
+#define BENCH_WIDTH   1920
+#define BENCH_HEIGHT  1080
+#define BENCH_REPEAT  50
+
+/* GB/s copying a BENCH_WIDTH x BENCH_HEIGHT ARGB frame, row by row when
+ * the strides differ:
+ */
+static double bench_path(const struct upload_path *p, void *dst, size_t dst_stride,
+		const void *src)
+{
+	size_t width = BENCH_WIDTH * 4;
+	uint64_t start;
+	unsigned i;
+
+	/* warm up (and fault in) both buffers: */
+	copy_rows(p, dst, dst_stride, src, width, width, BENCH_HEIGHT);
+
+	start = get_time_ns();
+	for (i = 0; i < BENCH_REPEAT; i++)
+		copy_rows(p, dst, dst_stride, src, width, width, BENCH_HEIGHT);
+
+	return (double)width * BENCH_HEIGHT * BENCH_REPEAT / (get_time_ns() - start);
+}
+
+int upload_bench(struct gbm_device *dev)
+{
+	size_t size = BENCH_WIDTH * 4 * BENCH_HEIGHT;
+	struct gbm_bo *bo = NULL;
+	void *map = NULL, *map_data = NULL;
+	uint8_t *src, *dst;
+	uint32_t stride = 0;
+	unsigned i;
+
+	src = malloc(size);
+	dst = malloc(size);
+	if (!src || !dst) {
+		printf("out of memory\n");
+		free(src);
+		free(dst);
+		return -1;
+	}
+	for (i = 0; i < size; i++)
+		src[i] = i;
+
+	if (dev)
+		bo = gbm_bo_create(dev, BENCH_WIDTH, BENCH_HEIGHT, GBM_FORMAT_ARGB8888,
+				GBM_BO_USE_LINEAR);
+	if (bo)
+		map = gbm_bo_map(bo, 0, 0, BENCH_WIDTH, BENCH_HEIGHT,
+				GBM_BO_TRANSFER_WRITE, &stride, &map_data);
+	if (dev && !map)
+		printf("could not map a linear bo, only benchmarking system memory\n");
+
+	printf("upload of %ux%u ARGB, GB/s:\n", BENCH_WIDTH, BENCH_HEIGHT);
+	printf("  %-8s %10s %10s\n", "path", "malloc", "gbm map");
+
+	for (i = 0; i < NUM_PATHS; i++) {
+		const struct upload_path *p = &paths[i];
+
+		if (!p->supported())
+			continue;
+
+		printf("  %-8s %10.2f", p->name, bench_path(p, dst, BENCH_WIDTH * 4, src));
+		if (map)
+			printf(" %10.2f", bench_path(p, map, stride, src));
+		printf("\n");
+	}
+
+	if (map)
+		gbm_bo_unmap(bo, map_data);
+	if (bo)
+		gbm_bo_destroy(bo);
+	free(src);
+	free(dst);
+
+	return 0;
+}
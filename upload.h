@@ -0,0 +1,52 @@
+/*
+ * Copyright 2026 NXP
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sub license,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the
+ * next paragraph) shall be included in all copies or substantial portions
+ * of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT. IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+#ifndef _UPLOAD_H
+#define _UPLOAD_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+struct gbm_device;
+
+/*
+ * CPU uploads into buffers the GPU (or display) reads, such as the gbm
+ * maps the textures and video frames get copied into.  Those are often
+ * write-combined or uncached, so the copies use non-temporal stores
+ * where the CPU has them (SSE2/AVX2 on x86, NEON on aarch64), picked at
+ * runtime from cpu_features().  The KMSCUBE_UPLOAD environment variable
+ * forces a path by name ("memcpy", "sse2", "avx2" or "neon").
+ */
+
+/* Copy 'rows' rows of 'width' bytes, in a single piece when neither side
+ * has any padding between the rows:
+ */
+void upload_copy(void *dst, size_t dst_stride, const void *src, size_t src_stride,
+		size_t width, size_t rows);
+
+/* Print the throughput of each path the CPU has, into system memory and
+ * into a mapped linear BO from 'dev' (if not NULL).
+ */
+int upload_bench(struct gbm_device *dev);
+
+#endif /* _UPLOAD_H */